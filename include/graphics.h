@@ -21,10 +21,16 @@
 #endif
 // clang-format on
 #include <gsl/gsl>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <future>
+#include <memory>
 #include <memory_resource>
+#include <string>
 #include <string_view>
 #include <system_error>
+#include <vector>
 // clang-format off
 #if __has_include(<vulkan/vulkan.h>)
 #  include <vulkan/vulkan.h>
@@ -62,6 +68,283 @@ _INTERFACE_ std::error_category& get_opengl_category() noexcept;
 _INTERFACE_ void get_extensions(EGLDisplay display, std::vector<std::string_view>& names) noexcept;
 _INTERFACE_ bool has_extension(EGLDisplay display, std::string_view name) noexcept;
 
+/**
+ * @brief Known EGL extensions. Use with `has_extension(EGLDisplay, egl_extension_t)`
+ * @note  EGL_NO_DISPLAY holds the client extensions
+ */
+enum class egl_extension_t : uint8_t {
+    ANGLE_d3d_share_handle_client_buffer,
+    ANGLE_surface_d3d_texture_2d_share_handle,
+    EXT_device_base,
+    EXT_device_enumeration,
+    EXT_platform_base,
+    EXT_platform_device,
+    KHR_create_context,
+    KHR_fence_sync,
+    KHR_gl_texture_2D_image,
+    KHR_image_base,
+    KHR_no_config_context,
+    KHR_surfaceless_context,
+    KHR_wait_sync,
+    MESA_platform_surfaceless,
+    count
+};
+
+/**
+ * @brief Known OpenGL ES extensions. Use with `has_extension(gl_extension_t)`
+ */
+enum class gl_extension_t : uint8_t {
+    EXT_buffer_storage,
+    EXT_color_buffer_float,
+    EXT_disjoint_timer_query,
+    EXT_read_format_bgra,
+    EXT_texture_format_BGRA8888,
+    KHR_debug,
+    KHR_parallel_shader_compile,
+    OES_EGL_image,
+    OES_EGL_image_external,
+    count
+};
+
+/// @return full name of the extension. "EGL_KHR_fence_sync" for `egl_extension_t::KHR_fence_sync`
+_INTERFACE_ std::string_view get_name(egl_extension_t name) noexcept;
+_INTERFACE_ std::string_view get_name(gl_extension_t name) noexcept;
+
+/**
+ * @brief Check the extension with the cached bitset of the display. 
+ *        The cache is built once for each EGLDisplay. `egl_context_t` rebuilds it after `eglInitialize`.
+ * @note  Unlike `has_extension(EGLDisplay, std::string_view)`, this doesn't scan the `eglQueryString` result.
+ *        The cache is not aware of `eglTerminate`. Use `reset_extensions` before it
+ */
+_INTERFACE_ bool has_extension(EGLDisplay display, egl_extension_t name) noexcept;
+
+/**
+ * @brief Drop the cached bitset of the display. Call it before `eglTerminate`.
+ *        The display can be initialized again with the other extensions, and the next lookup scans it again
+ * @see has_extension(EGLDisplay, egl_extension_t)
+ */
+_INTERFACE_ void reset_extensions(EGLDisplay display) noexcept;
+
+/**
+ * @brief Check the extension of the current EGLContext with the cached bitset.
+ *        The cache is built once for each EGLContext of `egl_context_t` with `glGetStringi(GL_EXTENSIONS, i)`
+ * @note  The other EGLContexts(GLFW, Qt, etc.) are scanned for each call.
+ *        Their destruction is unknown to this library, and the handle value can be reused for a new context.
+ *        The scan is `GL_NUM_EXTENSIONS` calls of `glGetStringi` and the name lookups,
+ *        so keep the result if the check is in a hot path of those contexts
+ * @return false if there is no current EGLContext
+ */
+_INTERFACE_ bool has_extension(gl_extension_t name) noexcept;
+
+/**
+ * @brief Enumerate EGLDeviceEXT. Use `count` 0 and `devices` nullptr to query the number of devices
+ * @param count     in: capacity of the `devices`. out: number of the devices
+ * @return EGLint   EGL_BAD_ACCESS if EGL_EXT_device_enumeration is not available
+ * @see https://www.khronos.org/registry/EGL/extensions/EXT/EGL_EXT_device_enumeration.txt
+ */
+_INTERFACE_ EGLint get_egl_devices(EGLDeviceEXT* devices, EGLint& count) noexcept;
+
+/**
+ * @brief Acquire EGLDisplay without window system. Use it with `egl_context_t::resume()` and FBO rendering
+ * 
+ * @param device_index  EGL_EXT_platform_device with the `device_index`th device of `get_egl_devices`.
+ *                      Negative value for EGL_MESA_platform_surfaceless
+ * @return EGLDisplay   EGL_NO_DISPLAY if the platform is not available. 
+ *                      The caller must `eglTerminate` it
+ * @see https://www.khronos.org/registry/EGL/extensions/EXT/EGL_EXT_platform_device.txt
+ * @see https://www.khronos.org/registry/EGL/extensions/MESA/EGL_MESA_platform_surfaceless.txt
+ */
+_INTERFACE_ EGLDisplay get_headless_display(EGLint device_index = -1) noexcept;
+
+/**
+ * @brief Create a shader object, compile the `code` and attach it to the `program`
+ * @throw std::runtime_error    the info log of the shader if the compile failed
+ * @return GLuint   the shader object. The caller must delete it
+ * @see glCompileShader
+ * @see glAttachShader
+ */
+_INTERFACE_ GLuint create_compile_attach(GLuint program, GLenum shader_type, std::string_view code) noexcept(false);
+_INTERFACE_ bool get_shader_info(std::string& message, GLuint shader, GLenum status_name = GL_COMPILE_STATUS) noexcept;
+_INTERFACE_ bool get_program_info(std::string& message, GLuint program, GLenum status_name = GL_LINK_STATUS) noexcept;
+
+/// @see program_batch_t
+struct program_source_t final {
+    std::string_view vert;
+    std::string_view frag;
+};
+
+/**
+ * @brief Compile and link the programs together. All shaders are submitted before any status query,
+ *        so the driver can use its compiler threads. The status is polled with GL_COMPLETION_STATUS_KHR.
+ * @note  Without KHR_parallel_shader_compile, `poll` reports all programs are completed 
+ *        and `get` waits for each one.
+ * 
+ * @see https://www.khronos.org/registry/OpenGL/extensions/KHR/KHR_parallel_shader_compile.txt
+ */
+class _INTERFACE_ program_batch_t final {
+  private:
+    struct item_t final {
+        GLuint program = 0;
+        GLuint shaders[2]{}; // vert, frag
+        bool completed = false;
+    };
+    std::vector<item_t> items{};
+    bool parallel = false;
+
+  public:
+    /**
+     * @brief Submit `glCompileShader` and `glLinkProgram` for all sources. No status query here
+     * @note  The source strings are copied by `glShaderSource`. They don't have to outlive the batch
+     * @see glMaxShaderCompilerThreadsKHR
+     */
+    explicit program_batch_t(gsl::span<const program_source_t> sources) noexcept;
+    /// @brief delete the programs which are not taken with `get`
+    ~program_batch_t() noexcept;
+    program_batch_t(program_batch_t const&) = delete;
+    program_batch_t& operator=(program_batch_t const&) = delete;
+    program_batch_t(program_batch_t&&) = delete;
+    program_batch_t& operator=(program_batch_t&&) = delete;
+
+    size_t size() const noexcept;
+
+    /// @return true if KHR_parallel_shader_compile is used
+    bool is_parallel() const noexcept;
+
+    /**
+     * @brief   Check GL_COMPLETION_STATUS_KHR of the programs. Never blocks
+     * @return  number of the completed programs
+     */
+    size_t poll() noexcept;
+
+    /**
+     * @brief   Take the linked program. Query the compile/link status and the info logs
+     * @note    This can block if the program is not completed
+     * 
+     * @param program   the linked program. The caller must `glDeleteProgram`. 0 if failed
+     * @param message   the info log if the compile/link failed
+     * @return GLenum   GL_INVALID_OPERATION if the compile/link failed. 
+     *                  GL_INVALID_VALUE if the `idx` is out of range or already taken
+     */
+    GLenum get(size_t idx, GLuint& program, std::string& message) noexcept;
+};
+
+/**
+ * @brief 32 bit FNV-1a hash for the names in `gl_program_t`. Use with the string literals for compile-time hash
+ * @code
+ * constexpr auto u_color = hash_name("u_color");
+ * glUniform4f(program.get_uniform(u_color), 1, 0, 0, 1);
+ * @endcode
+ */
+constexpr uint32_t hash_name(std::string_view name) noexcept {
+    uint32_t hash = 0x811c9dc5;
+    for (auto c : name) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+/**
+ * @brief Owner of the linked program object. The active uniforms, uniform blocks and attributes are reflected 
+ *        into the tables sorted by `hash_name`. The lookup is a binary search of integers.
+ * @note  For the arrays, both of "name[0]" and "name" are registered
+ */
+class _INTERFACE_ gl_program_t final {
+  public:
+    struct entry_t final {
+        uint32_t hash;
+        GLint location; // location for uniform/attribute, index for uniform block
+        GLenum type;    // GL_NONE for uniform block
+        GLint size;     // array length. byte length for uniform block
+    };
+
+  private:
+    GLuint program = 0;
+    std::vector<entry_t> uniforms{};
+    std::vector<entry_t> blocks{};
+    std::vector<entry_t> attributes{};
+
+  public:
+    /**
+     * @brief Take the ownership of the program and reflect it
+     * @param program   linked program object. `program_cache_t::create` or `program_batch_t::get`
+     * @see glGetActiveUniform
+     * @see glGetActiveUniformBlockName
+     * @see glGetActiveAttrib
+     */
+    explicit gl_program_t(GLuint program) noexcept;
+    /// @see glDeleteProgram
+    ~gl_program_t() noexcept;
+    gl_program_t(gl_program_t const&) = delete;
+    gl_program_t& operator=(gl_program_t const&) = delete;
+    gl_program_t(gl_program_t&&) = delete;
+    gl_program_t& operator=(gl_program_t&&) = delete;
+
+    /// @return GLenum  GL_INVALID_OPERATION if the program is not linked
+    GLenum is_valid() const noexcept;
+    GLuint handle() const noexcept;
+
+    /// @return GLint   -1 if not found. Same with `glGetUniformLocation`
+    GLint get_uniform(uint32_t hash) const noexcept;
+    /// @return GLuint  GL_INVALID_INDEX if not found. Same with `glGetUniformBlockIndex`
+    GLuint get_uniform_block(uint32_t hash) const noexcept;
+    /// @return GLint   -1 if not found. Same with `glGetAttribLocation`
+    GLint get_attribute(uint32_t hash) const noexcept;
+
+    /// @return nullptr if not found
+    const entry_t* find_uniform(uint32_t hash) const noexcept;
+    /// @return sorted reflection tables
+    gsl::span<const entry_t> get_uniforms() const noexcept;
+    gsl::span<const entry_t> get_uniform_blocks() const noexcept;
+    gsl::span<const entry_t> get_attributes() const noexcept;
+};
+
+/**
+ * @brief Program binary cache on the disk. The key is a hash of the sources and the driver(GL_RENDERER, GL_VERSION).
+ *        The cached binary is loaded with `glProgramBinary`. If the driver rejects it, the sources are compiled again
+ *        and the cache is replaced.
+ * 
+ * @see glGetProgramBinary
+ * @see glProgramBinary
+ */
+class _INTERFACE_ program_cache_t final {
+  private:
+    std::filesystem::path directory;
+    std::string driver; // GL_RENDERER + GL_VERSION of the current context
+    GLint num_formats = 0;
+    uint32_t hit = 0, miss = 0;
+
+  public:
+    /**
+     * @param directory   the folder for the binaries. Created if not exists
+     * @note  requires current EGLContext
+     */
+    explicit program_cache_t(const std::filesystem::path& directory) noexcept;
+    ~program_cache_t() noexcept = default;
+    program_cache_t(program_cache_t const&) = delete;
+    program_cache_t& operator=(program_cache_t const&) = delete;
+    program_cache_t(program_cache_t&&) = delete;
+    program_cache_t& operator=(program_cache_t&&) = delete;
+
+    /**
+     * @brief   FNV-1a hash of the driver and the sources
+     */
+    uint64_t get_key(std::string_view vert, std::string_view frag) const noexcept;
+
+    /**
+     * @brief   Create a linked program object with the cached binary, or from the sources
+     * 
+     * @param program   the linked program. The caller must `glDeleteProgram`
+     * @param message   the info log if the compile/link failed
+     * @return GLenum   GL_INVALID_OPERATION if the compile/link failed
+     */
+    GLenum create(GLuint& program, std::string_view vert, std::string_view frag, std::string& message) noexcept;
+
+    /// @param hit  number of `create` with the cached binary
+    /// @param miss number of `create` with the source compile
+    void get_statistics(uint32_t& hit, uint32_t& miss) const noexcept;
+};
+
 /**
  * @brief `EGLContext` and `EGLSurface` owner.
  *        Bind/unbind with `EGLNativeWindowType` using `resume`/`suspend` 
@@ -136,6 +419,16 @@ class _INTERFACE_ egl_context_t final {
      */
     EGLint resume(gsl::owner<EGLSurface> es_surface, EGLConfig es_config) noexcept;
 
+    /**
+     * @brief   Bind EGLContext without EGLSurface. The caller must render to the FBO.
+     * 
+     * @return  EGLint  EGL_BAD_MATCH if EGL_KHR_surfaceless_context is not available.
+     *                  `EGL_NOT_INITIALIZED` if `terminate` is invoked.
+     * @see https://www.khronos.org/registry/EGL/extensions/KHR/EGL_KHR_surfaceless_context.txt
+     * @see get_headless_display
+     */
+    EGLint resume() noexcept;
+
     /**
      * @brief   Unbind EGLSurface and EGLContext.
      * 
@@ -160,10 +453,251 @@ class _INTERFACE_ egl_context_t final {
     EGLint get_configs(EGLConfig* configs, EGLint& count, const EGLint* attrs = nullptr) const noexcept;
 };
 
+/// @see egl_worker_pool_t::submit
+using egl_task_t = void (*)(void* user_data);
+
+/**
+ * @brief Worker threads which own PBufferSurface-backed EGLContexts sharing the same object namespace.
+ *        Use them to move the resource uploads(`pbo_writer_t`, shader compile) off the render thread.
+ * 
+ * @see egl_context_t
+ * @see https://www.khronos.org/registry/EGL/extensions/KHR/EGL_KHR_fence_sync.txt
+ * @see https://www.khronos.org/registry/EGL/extensions/KHR/EGL_KHR_wait_sync.txt
+ */
+class _INTERFACE_ egl_worker_pool_t final {
+  public:
+    static constexpr uint16_t max_capacity = 16;
+
+  private:
+    struct impl_t;
+    EGLDisplay display = EGL_NO_DISPLAY;
+    gsl::owner<impl_t*> impl = nullptr;
+    uint16_t capacity = 0;
+    EGLint ec = EGL_SUCCESS;
+
+  public:
+    /**
+     * @brief Start `count` threads. Each one creates its own EGLContext with `share_context` and makes it current
+     * @note  The constructor returns after all contexts are ready(or failed)
+     * 
+     * @param count     1 ~ `max_capacity`
+     */
+    egl_worker_pool_t(EGLDisplay display, EGLContext share_context, uint16_t count) noexcept;
+    /**
+     * @brief Finish the queued tasks, then join the threads
+     */
+    ~egl_worker_pool_t() noexcept;
+    egl_worker_pool_t(egl_worker_pool_t const&) = delete;
+    egl_worker_pool_t& operator=(egl_worker_pool_t const&) = delete;
+    egl_worker_pool_t(egl_worker_pool_t&&) = delete;
+    egl_worker_pool_t& operator=(egl_worker_pool_t&&) = delete;
+
+    /**
+     * @return EGLint   EGL_SUCCESS if all workers have their EGLContext. 
+     *                  EGL_BAD_PARAMETER for the invalid `count`
+     */
+    EGLint is_valid() const noexcept;
+
+    uint16_t size() const noexcept;
+
+    /**
+     * @brief   Run the task in one of the worker's EGLContext. 
+     *          After the task, the worker inserts an EGL fence and flushes it.
+     * 
+     * @return std::future<EGLSync>  The fence for the task's GL commands. 
+     *                               EGL_NO_SYNC if the fence is not available. Then the worker `glFinish`ed.
+     * @throw std::runtime_error if `is_valid` is not EGL_SUCCESS
+     * @see eglCreateSync
+     * @see wait
+     */
+    std::future<EGLSync> submit(egl_task_t task, void* user_data) noexcept(false);
+
+    /**
+     * @brief   Make the current EGLContext wait for the fence in the GPU. Then destroy the fence.
+     *          The render thread won't be blocked.
+     * 
+     * @param fence     The result of `submit`. EGL_NO_SYNC is ignored.
+     * @return EGLint   Redirected from `eglGetError`
+     * @see eglWaitSync
+     * @see eglDestroySync
+     */
+    EGLint wait(EGLSync fence) noexcept;
+};
+
+/**
+ * @brief Host-side handle of a point in the GPU timeline.
+ *        The GL/EGL fence and the Vulkan timeline semaphore can be waited with the same interface.
+ * @note  The GL/EGL fence is owned and deleted in the destructor. The Vulkan semaphore is not owned.
+ *        The `GLsync` must be used in the thread which has the current EGLContext(of the same share group).
+ * 
+ * @see https://www.khronos.org/registry/EGL/extensions/KHR/EGL_KHR_fence_sync.txt
+ * @see https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VK_KHR_timeline_semaphore.html
+ */
+class _INTERFACE_ gpu_future_t final {
+  public:
+    enum class type_t : uint8_t {
+        none,
+        gl,     // glFenceSync
+        egl,    // eglCreateSync
+        vulkan, // timeline semaphore + value
+    };
+
+  private:
+    type_t type = type_t::none;
+    GLsync gl_fence = nullptr;
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLSync egl_fence = EGL_NO_SYNC;
+    // VkDevice and VkSemaphore. The layout must not depend on the Vulkan headers of the user
+    uint64_t device = 0;
+    uint64_t timeline = 0;
+    uint64_t value = 0;
+
+  public:
+    gpu_future_t() noexcept = default;
+    /// @param fence  `glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)`. The future takes its ownership
+    explicit gpu_future_t(GLsync fence) noexcept;
+    /// @param fence  `eglCreateSync(display, EGL_SYNC_FENCE, nullptr)`. The future takes its ownership
+    gpu_future_t(EGLDisplay display, EGLSync fence) noexcept;
+    /**
+     * @brief The point is reached when the counter of the `timeline` is equal or greater than the `value`
+     * @param device    VkDevice as an opaque handle
+     * @param timeline  VkSemaphore as an opaque handle. 0 makes an invalid future
+     * @see make_gpu_future
+     * @see gpu_timeline_t::get_future
+     */
+    gpu_future_t(uint64_t device, uint64_t timeline, uint64_t value) noexcept;
+    ~gpu_future_t() noexcept;
+    gpu_future_t(gpu_future_t&& rhs) noexcept;
+    gpu_future_t& operator=(gpu_future_t&& rhs) noexcept;
+    gpu_future_t(const gpu_future_t&) = delete;
+    gpu_future_t& operator=(const gpu_future_t&) = delete;
+
+    type_t get_type() const noexcept;
+    bool valid() const noexcept;
+
+    /**
+     * @brief   Query the point without blocking
+     * @note    `glClientWaitSync` with 0 timeout flushes the GL commands
+     */
+    bool is_ready() noexcept;
+
+    /**
+     * @brief   Block the host until the GPU reaches the point
+     * @return  uint32_t    0 if reached. ETIMEDOUT if the `timeout` is expired.
+     *                      EINVAL for the invalid future, EIO if the API failed(device lost, etc.)
+     * @see glClientWaitSync
+     * @see eglClientWaitSync
+     * @see vkWaitSemaphores
+     */
+    uint32_t wait(std::chrono::nanoseconds timeout) noexcept;
+
+    /**
+     * @brief   Make the GPU of the current EGLContext wait for the point. The host is not blocked.
+     * @return  uint32_t    ENOTSUP for the Vulkan timeline. Use `timeline_submit` for the queues.
+     * @see glWaitSync
+     * @see eglWaitSync
+     */
+    uint32_t wait_gpu() noexcept;
+};
+
+#if defined(USE_VULKAN) // defined with the Vulkan::Vulkan link
+/**
+ * @brief `gpu_future_t` of the timeline semaphore
+ * @see gpu_future_t(uint64_t, uint64_t, uint64_t)
+ */
+_INTERFACE_ gpu_future_t make_gpu_future(VkDevice device, VkSemaphore timeline, uint64_t value) noexcept;
+
+/**
+ * @brief A point of the timeline semaphore. Used for both wait and signal of `timeline_submit`
+ */
+struct timeline_point_t final {
+    VkSemaphore semaphore;
+    uint64_t value;
+    VkPipelineStageFlags stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT; // ignored for the signal
+};
+
+/**
+ * @brief Monotonically increasing GPU timeline with `VK_KHR_timeline_semaphore`. Usually 1 for each VkQueue.
+ *        The submits signal the reserved points(`advance`). The other queues wait for them in the GPU,
+ *        so the cross-queue dependency doesn't need the fence round trip to the CPU.
+ * @note  The device must enable `timelineSemaphore`. `advance` is thread-safe.
+ */
+class _INTERFACE_ gpu_timeline_t final {
+  public:
+    const VkDevice device;
+    VkSemaphore handle = VK_NULL_HANDLE;
+
+  private:
+    std::atomic<uint64_t> last; // the last reserved point
+    VkResult ec = VK_SUCCESS;
+
+  public:
+    gpu_timeline_t(VkDevice device, uint64_t initial_value = 0) noexcept;
+    ~gpu_timeline_t() noexcept;
+    gpu_timeline_t(const gpu_timeline_t&) = delete;
+    gpu_timeline_t(gpu_timeline_t&&) = delete;
+    gpu_timeline_t& operator=(const gpu_timeline_t&) = delete;
+    gpu_timeline_t& operator=(gpu_timeline_t&&) = delete;
+
+    /// @return VkResult    cached `ec` from the constructor
+    VkResult is_valid() const noexcept;
+
+    /**
+     * @brief Reserve the next point. The caller must signal it with `timeline_submit` or `signal`
+     *        Waiting for the point which is never signaled will block until the timeout
+     */
+    uint64_t advance() noexcept;
+    /// @return the last reserved point
+    uint64_t get_last() const noexcept;
+
+    /// @brief The current counter value. The GPU progress of the timeline
+    VkResult query(uint64_t& value) const noexcept;
+    /// @brief Signal the point from the host. `value` must be greater than the current counter
+    VkResult signal(uint64_t value) noexcept;
+    /// @return VkResult    VK_TIMEOUT if the `timeout` is expired
+    VkResult wait(uint64_t value, std::chrono::nanoseconds timeout) const noexcept;
+
+    gpu_future_t get_future(uint64_t value) const noexcept;
+};
+
+/**
+ * @brief `vkQueueSubmit` with the timeline points
+ * @param waits     the queue waits for them before the `stage`
+ * @param signals   the queue signals them after the `commands`
+ */
+_INTERFACE_ VkResult timeline_submit(VkQueue queue, gsl::span<const VkCommandBuffer> commands,
+                                     gsl::span<const timeline_point_t> waits, gsl::span<const timeline_point_t> signals,
+                                     VkFence fence = VK_NULL_HANDLE) noexcept;
+
+/**
+ * @brief Block the host until the points are reached
+ * @param any   return when one of the points is reached
+ * @return VkResult VK_TIMEOUT if the `timeout` is expired
+ */
+_INTERFACE_ VkResult wait_timeline_points(VkDevice device, gsl::span<const timeline_point_t> points,
+                                          std::chrono::nanoseconds timeout, bool any = false) noexcept;
+#endif
+
 /// @see memcpy
 using reader_callback_t = void (*)(void* user_data, const void* mapping, size_t length);
 
 /**
+ * @param tile      area of the tile in the framebuffer. x, y, width, height
+ * @param mapping   the first pixel of the tile
+ * @param stride    byte distance between the rows in the `mapping`
+ */
+using tile_callback_t = void (*)(void* user_data, const GLint tile[4], const void* mapping, size_t stride);
+
+/**
+ * @brief byte size of a pixel for `glReadPixels`/`glTexSubImage2D`
+ * @return uint32_t 0 if the combination is unknown
+ */
+_INTERFACE_ uint32_t get_pixel_size(GLenum format, GLenum type) noexcept;
+
+/**
+ * @brief Ring of pixel buffer objects for `glReadPixels`.
+ *        Each `pack` inserts a fence so `map_and_invoke` can skip the slots which are still in use by the GPU.
+ * 
  * @see http://docs.gl/es3/glReadPixels 
  * 
  * @todo Test rendering surfaces with normalized fixed point - GL_RGBA/GL_UNSIGNED_BYTE
@@ -172,18 +706,38 @@ using reader_callback_t = void (*)(void* user_data, const void* mapping, size_t
  *
  * @see GL_PIXEL_PACK_BUFFER
  * @see GL_EXT_map_buffer_range https://www.khronos.org/registry/OpenGL/extensions/EXT/EXT_map_buffer_range.txt
+ * @see glFenceSync http://docs.gl/es3/glFenceSync
  */
 class _INTERFACE_ pbo_reader_t final {
-    static constexpr uint16_t capacity = 2;
+  public:
+    static constexpr uint16_t max_capacity = 8;
 
   private:
-    GLuint pbos[capacity];
-    uint32_t length; // byte length of the buffer modification
+    struct async_context_t; // states for `read_async`. see pbo.cpp
+
+  private:
+    GLuint pbos[max_capacity];
+    GLsync fences[max_capacity]; // `glFenceSync` after the last `pack`. nullptr if there is nothing to wait
+    uint16_t capacity;           // number of pixel buffer objects in use
+    uint32_t length;             // byte length of the buffer modification
     GLintptr offset;
     GLenum ec = GL_NO_ERROR;
+    uint32_t hit = 0;   // `map_and_invoke` mapped the packed slot without waiting
+    uint32_t stall = 0; // `map_and_invoke` found the slot busy
+    gsl::owner<async_context_t*> async = nullptr;
+    uint32_t strides[max_capacity]{};     // row length in bytes of the latest `pack_tiles`
+    uint16_t pixel_sizes[max_capacity]{}; // pixel size in bytes of the latest `pack_tiles`
+
+  private:
+    /// @return GL_NO_ERROR if pbo[idx] is ready, GL_TIMEOUT_EXPIRED if not. Or redirected from `glGetError`
+    GLenum try_wait(uint16_t idx) noexcept;
 
   public:
-    explicit pbo_reader_t(GLuint length) noexcept;
+    /**
+     * @param length    byte length of each pixel buffer object
+     * @param count     number of pixel buffer objects in the ring. Must be in [1, max_capacity]
+     */
+    explicit pbo_reader_t(GLuint length, uint16_t count = 2) noexcept;
     ~pbo_reader_t() noexcept;
     pbo_reader_t(pbo_reader_t const&) = delete;
     pbo_reader_t& operator=(pbo_reader_t const&) = delete;
@@ -196,8 +750,14 @@ class _INTERFACE_ pbo_reader_t final {
      */
     GLenum is_valid() const noexcept;
 
+    /**
+     * @brief number of pixel buffer objects in the ring
+     */
+    uint16_t size() const noexcept;
+
     /**
      * @brief fbo -> pbo[idx]
+     * @note  The previous fence of pbo[idx] is replaced with a new one
      * 
      * @param idx   index of the pixel buffer object to receive pixels
      * @param fbo   target framebuffer object to run `glReadPixels`
@@ -206,22 +766,92 @@ class _INTERFACE_ pbo_reader_t final {
      *                  GL_OUT_OF_MEMORY if `frame` is larger than `length`.
      *                  Or, redirected from `glGetError` for the other cases.
      * @see glReadPixels  http://docs.gl/es3/glReadPixels
+     * @see glFenceSync
      */
     GLenum pack(uint16_t idx, GLuint fbo, const GLint frame[4], //
                 GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE) noexcept;
 
     /**
      * @brief create a mapping for pbo[idx] and invoke the `callback`
-     * @note  the mapping will be destroyed when the function returns
+     * @note  the mapping will be destroyed when the function returns.
+     *        This function doesn't block. If the `pack` for pbo[idx] is not finished, it returns immediately
 
      * @param idx   index of the pixel buffer object to create temporary mapping
      * @return GLenum   GL_INVALID_VALUE if `idx` is wrong.
+     *                  GL_TIMEOUT_EXPIRED if the GPU is still writing to pbo[idx]. Try again later.
      *                  Or, redirected from `glGetError`
+     * @see glClientWaitSync http://docs.gl/es3/glClientWaitSync
      * @see glBindBuffer
      * @see glMapBufferRange
      * @see glUnmapBuffer
      */
     GLenum map_and_invoke(uint16_t idx, reader_callback_t callback, void* user_data) noexcept;
+
+    /**
+     * @brief fbo -> pbo[idx] for each tile.
+     *        The pbo keeps the layout of the framebuffer(row length is `width`), 
+     *        so only the bytes of the tiles are written and the others are left untouched.
+     * 
+     * @param width     width of the framebuffer. `length` must be larger than `width * height * pixel size`
+     * @param tiles     areas to read. 4 values(x, y, width, height) for each tile
+     * @return GLenum   GL_INVALID_VALUE if `idx`/`tiles` is wrong or the `format`/`type` is unknown.
+     *                  GL_OUT_OF_MEMORY if a tile is out of `length`.
+     *                  Or, redirected from `glGetError` for the other cases.
+     * @see GL_PACK_ROW_LENGTH
+     * @see GL_PACK_SKIP_PIXELS
+     * @see GL_PACK_SKIP_ROWS
+     */
+    GLenum pack_tiles(uint16_t idx, GLuint fbo, GLint width, gsl::span<const GLint> tiles, //
+                      GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE) noexcept;
+
+    /**
+     * @brief create a mapping for the byte range of each tile and invoke the `callback` with it
+     * @note  Use the same `tiles` with `pack_tiles`. This function doesn't block like `map_and_invoke`
+     * 
+     * @return GLenum   GL_INVALID_VALUE if `idx` is wrong, or a tile is out of the area of `pack_tiles`.
+     *                  GL_TIMEOUT_EXPIRED if the GPU is still writing to pbo[idx]. Try again later.
+     *                  Or, redirected from `glGetError`
+     */
+    GLenum map_tiles_and_invoke(uint16_t idx, gsl::span<const GLint> tiles, //
+                                tile_callback_t callback, void* user_data) noexcept;
+
+    /**
+     * @brief Counters of `map_and_invoke` to tune the depth of the ring.
+     * @note  The slots without `pack` are not counted. The ring is not full yet
+     * @param ready number of the calls which mapped the packed slot
+     * @param busy  number of the calls which returned `GL_TIMEOUT_EXPIRED`
+     */
+    void get_statistics(uint32_t& ready, uint32_t& busy) const noexcept;
+
+    /**
+     * @brief `pack` to the next free slot and return a completion handle for it.
+     *        When `poll`/`drain` finds the slot ready, its mapping is delivered to a worker thread
+     *        and the `callback` is invoked there. The mapping is valid until the `callback` returns.
+     * @note  Don't mix with the index based `pack`/`map_and_invoke`. They share the same slots.
+     * 
+     * @return std::future<GLenum>  GL_NO_ERROR after the `callback` returned.
+     *                              GL_OUT_OF_MEMORY if all slots are in use. `poll` and try again.
+     *                              Or, redirected from `glGetError` if `pack` or mapping failed.
+     * @see pack
+     * @see poll
+     */
+    auto read_async(GLuint fbo, const GLint frame[4], reader_callback_t callback, void* user_data, //
+                    GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE) noexcept(false)
+        -> std::future<GLenum>;
+
+    /**
+     * @brief Pump for `read_async`. Must be invoked in the thread which owns the EGLContext.
+     *        Hand over the ready slots to the workers and recycle the slots which are consumed.
+     *        This function doesn't block.
+     * @return uint16_t number of slots still in flight
+     */
+    uint16_t poll() noexcept;
+
+    /**
+     * @brief `poll` until all `read_async` requests are completed
+     * @note  This function is invoked in the destructor
+     */
+    void drain() noexcept;
 };
 
 /// @see memcpy
@@ -256,5 +886,360 @@ class _INTERFACE_ pbo_writer_t final {
     /// @see GL_TEXTURE_2D
     GLenum unpack(uint16_t idx, GLuint tex2d, const GLint frame[4], //
                   GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE) noexcept;
+    /**
+     * @brief create a write-only mapping for pbo[idx] and invoke the `callback`
+     * @note  The previous contents are invalidated. The `callback` must fill the whole `length`
+     * @see GL_MAP_INVALIDATE_BUFFER_BIT
+     */
     GLenum map_and_invoke(uint16_t idx, writer_callback_t callback, void* user_data) noexcept;
 };
+
+/**
+ * @brief Streaming mode of `pbo_writer_t` for the textures updated every frame.
+ *        One pixel buffer object is sub-allocated as a ring of segments and each upload is guarded with a fence.
+ *        If `GL_EXT_buffer_storage` is available, the buffer is mapped once with persistent/coherent flags.
+ *        If not, each segment is mapped with `GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT`.
+ * 
+ * @see GL_PIXEL_UNPACK_BUFFER
+ * @see GL_EXT_buffer_storage https://www.khronos.org/registry/OpenGL/extensions/EXT/EXT_buffer_storage.txt
+ * @see https://www.khronos.org/opengl/wiki/Buffer_Object_Streaming
+ */
+class _INTERFACE_ pbo_stream_writer_t final {
+  public:
+    static constexpr uint16_t max_capacity = 8;
+
+  private:
+    GLuint pbo = 0;
+    GLsync fences[max_capacity]{}; // `glFenceSync` after the last `upload` of each segment
+    uint16_t capacity;             // number of segments
+    uint16_t head = 0;             // next segment to write
+    uint32_t length;               // byte length of each segment
+    uint32_t stride;               // byte distance between segments
+    void* persistent = nullptr;    // mapping of whole buffer. nullptr if `GL_EXT_buffer_storage` is not available
+    GLenum ec = GL_NO_ERROR;
+    uint32_t hit = 0;   // the segment was ready and mapped
+    uint32_t stall = 0; // the segment was still in use by the GPU
+
+  public:
+    /**
+     * @param length    byte length of each segment
+     * @param count     number of segments in the ring. Must be in [1, max_capacity]
+     */
+    explicit pbo_stream_writer_t(GLuint length, uint16_t count = 3) noexcept;
+    ~pbo_stream_writer_t() noexcept;
+    pbo_stream_writer_t(pbo_stream_writer_t const&) = delete;
+    pbo_stream_writer_t& operator=(pbo_stream_writer_t const&) = delete;
+    pbo_stream_writer_t(pbo_stream_writer_t&&) = delete;
+    pbo_stream_writer_t& operator=(pbo_stream_writer_t&&) = delete;
+
+    /**
+     * @brief check whether the construction was successful
+     * @return GLenum   cached `ec` from the constructor
+     */
+    GLenum is_valid() const noexcept;
+
+    /**
+     * @brief the buffer is mapped with `GL_MAP_PERSISTENT_BIT_EXT`?
+     */
+    bool is_persistent() const noexcept;
+
+    /**
+     * @brief write the next segment with the `callback`, then `glTexSubImage2D` from the segment
+     * @note  This function doesn't block. If the segment is still in use, it returns immediately
+     * 
+     * @return GLenum   GL_TIMEOUT_EXPIRED if the GPU is still reading the next segment. Try again later.
+     *                  Or, redirected from `glGetError`
+     * @see glMapBufferRange
+     * @see glTexSubImage2D
+     * @see glFenceSync
+     */
+    GLenum upload(GLuint tex2d, const GLint frame[4], writer_callback_t callback, void* user_data, //
+                  GLenum format = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE) noexcept;
+
+    /**
+     * @brief Counters of `upload` to tune the depth of the ring.
+     * @param ready number of the calls which found the segment ready and wrote it
+     * @param busy  number of the calls which returned `GL_TIMEOUT_EXPIRED`
+     */
+    void get_statistics(uint32_t& ready, uint32_t& busy) const noexcept;
+};
+
+enum class yuv_layout_t : int32_t {
+    nv12 = 0, // Y plane, then interleaved UV plane
+    i420 = 1, // Y plane, U plane, then V plane
+};
+
+/**
+ * @brief Convert RGBA texture to planar YUV(BT.601, limited range) with OpenGL ES 3.0.
+ *        The result is rendered to a RGBA8 framebuffer of (width/4, height*3/2) 
+ *        whose bytes are exactly the NV12/I420 layout. Read it with `pbo_reader_t::pack` and GL_RGBA/GL_UNSIGNED_BYTE.
+ * 
+ * @see https://www.fourcc.org/pixel-format/yuv-i420/
+ * @see https://www.fourcc.org/pixel-format/yuv-nv12/
+ */
+class _INTERFACE_ yuv_converter_t final {
+  private:
+    GLuint program = 0;
+    GLuint shaders[2]{}; // vert, frag
+    GLuint sampler = 0;  // GL_LINEAR to average 2x2 pixels for chroma
+    GLuint texture = 0;  // GL_RGBA8 render target
+    GLuint fbo = 0;
+    GLint locations[4]{}; // u_image, u_size, u_layout, u_flip
+    GLsizei width, height;
+    yuv_layout_t layout;
+    GLenum ec = GL_NO_ERROR;
+
+  public:
+    /**
+     * @param width     width of the source. Must be a multiple of 8
+     * @param height    height of the source. Must be a multiple of 2
+     */
+    yuv_converter_t(GLsizei width, GLsizei height, yuv_layout_t layout) noexcept;
+    ~yuv_converter_t() noexcept;
+    yuv_converter_t(yuv_converter_t const&) = delete;
+    yuv_converter_t& operator=(yuv_converter_t const&) = delete;
+    yuv_converter_t(yuv_converter_t&&) = delete;
+    yuv_converter_t& operator=(yuv_converter_t&&) = delete;
+
+    /**
+     * @brief check whether the construction was successful
+     * @return GLenum   cached `ec` from the constructor. 
+     *                  GL_INVALID_OPERATION if the shader compile/link failed
+     */
+    GLenum is_valid() const noexcept;
+
+    /**
+     * @brief render the `tex2d` to the framebuffer
+     * @note  The viewport, framebuffer binding, GL_BLEND and GL_DEPTH_TEST are restored on return.
+     *        The program, texture, and sampler bindings are reset to 0
+     * 
+     * @param tex2d     GL_TEXTURE_2D with the same size of the converter
+     * @param flip      flip vertically. Use `true` for the rendered(bottom-up) textures 
+     *                  so the first row of the result is the top of the image
+     * @see glDrawArrays
+     */
+    GLenum convert(GLuint tex2d, bool flip = true) noexcept;
+
+    /// @brief framebuffer object which holds the result
+    GLuint handle() const noexcept;
+
+    /// @brief area for `pbo_reader_t::pack`
+    void get_frame(GLint frame[4]) const noexcept;
+
+    /// @brief byte length of the result. `width * height * 3 / 2`
+    uint32_t get_length() const noexcept;
+};
+
+/**
+ * @brief Name of the pixel conversion kernels selected at runtime.
+ * @return "avx2", "ssse3", "sse2", "neon", or "scalar"
+ * @see swizzle_rgba_bgra
+ * @see convert_rgba_rgb
+ * @see premultiply_rgba
+ */
+_INTERFACE_ std::string_view get_pixel_kernel_name() noexcept;
+
+/**
+ * @brief Replace the pixel conversion kernels of all threads. Use it to test or compare each instruction set
+ * 
+ * @param name  one of the names of `get_pixel_kernel_name`
+ * @return false if the kernels are not in this build or the CPU doesn't support them
+ */
+_INTERFACE_ bool use_pixel_kernels(std::string_view name) noexcept;
+
+/**
+ * @brief Swap R and B channels of 4 byte pixels. RGBA <-> BGRA
+ * @note  `src` and `dst` can be the same memory
+ * 
+ * @param count   number of pixels. `src`, `dst` must hold `count * 4` bytes
+ */
+_INTERFACE_ void swizzle_rgba_bgra(const void* src, void* dst, size_t count) noexcept;
+
+/**
+ * @brief Drop the alpha channel. RGBA -> RGB24
+ * @note  `src` and `dst` can be the same memory
+ * 
+ * @param count   number of pixels. `src` must hold `count * 4`, `dst` must hold `count * 3` bytes
+ */
+_INTERFACE_ void convert_rgba_rgb(const void* src, void* dst, size_t count) noexcept;
+
+/**
+ * @brief Multiply color channels with the alpha. The result is rounded like `c * a / 255.0f`
+ * @note  `src` and `dst` can be the same memory
+ * 
+ * @param count   number of pixels. `src`, `dst` must hold `count * 4` bytes
+ */
+_INTERFACE_ void premultiply_rgba(const void* src, void* dst, size_t count) noexcept;
+
+/**
+ * @brief Reverse the row order. GL's origin is bottom-left
+ * @note  `src` and `dst` can be the same memory
+ * 
+ * @param stride  byte length of a row
+ * @param rows    number of rows
+ */
+_INTERFACE_ void flip_rows(const void* src, void* dst, size_t stride, uint32_t rows) noexcept;
+
+/**
+ * @brief Read-only view of the whole file. `mmap` on POSIX, `CreateFileMapping` on Windows.
+ *        If the mapping is not available(empty file, special files), the contents are read into a heap buffer.
+ * @note  The span is valid until the destruction.
+ * 
+ * @see mmap
+ * @see CreateFileMappingW
+ */
+class _INTERFACE_ mapped_file_t final {
+  private:
+    const std::byte* mapping = nullptr;
+    size_t length = 0;
+    std::unique_ptr<std::byte[]> fallback{};
+
+  public:
+    /**
+     * @throw std::system_error  the file can't be opened
+     */
+    explicit mapped_file_t(const std::filesystem::path& fpath) noexcept(false);
+    ~mapped_file_t() noexcept;
+    mapped_file_t(mapped_file_t const&) = delete;
+    mapped_file_t& operator=(mapped_file_t const&) = delete;
+    mapped_file_t(mapped_file_t&&) = delete;
+    mapped_file_t& operator=(mapped_file_t&&) = delete;
+
+    /// @return false if the contents are in the fallback buffer
+    bool is_mapped() const noexcept;
+
+    gsl::span<const std::byte> get() const noexcept;
+};
+
+/**
+ * @see asset_loader_t::submit
+ * @param contents  Valid only in the callback. Decode or copy it before return
+ * @param ec        `errno` of the read. `contents` is empty if not 0
+ */
+using asset_callback_t = void (*)(void* user_data, gsl::span<const std::byte> contents, uint32_t ec);
+
+/**
+ * @brief Batch the file reads and hand the contents to the decode workers.
+ *        On Linux the reads are submitted to io_uring with the registered buffers.
+ *        If io_uring is not available, the decode workers read the files with the same buffers.
+ * 
+ * @see https://kernel.dk/io_uring.pdf
+ */
+class _INTERFACE_ asset_loader_t final {
+  public:
+    static constexpr uint16_t max_capacity = 16;
+
+  private:
+    struct impl_t;
+    gsl::owner<impl_t*> impl = nullptr;
+
+  public:
+    /**
+     * @param worker_count  1 ~ `max_capacity`. Number of the decode workers
+     * @param buffer_count  Number of the reads in flight
+     * @param buffer_size   The files larger than this are read into the heap memory
+     * @throw std::system_error
+     */
+    asset_loader_t(uint16_t worker_count, uint16_t buffer_count = 16, size_t buffer_size = 8 << 20) noexcept(false);
+    /**
+     * @brief Finish the submitted reads, then join the threads
+     */
+    ~asset_loader_t() noexcept;
+    asset_loader_t(asset_loader_t const&) = delete;
+    asset_loader_t& operator=(asset_loader_t const&) = delete;
+    asset_loader_t(asset_loader_t&&) = delete;
+    asset_loader_t& operator=(asset_loader_t&&) = delete;
+
+    /// @return false if the workers are reading the files themselves
+    bool uses_io_uring() const noexcept;
+
+    /**
+     * @brief Read the whole file and invoke the `callback` in one of the decode workers
+     * @note  The `callback` and the `user_data` must be alive until the callback is invoked
+     */
+    void submit(const std::filesystem::path& fpath, asset_callback_t callback, void* user_data) noexcept(false);
+
+    /**
+     * @brief Block until all submitted callbacks are returned
+     */
+    void wait() noexcept;
+};
+
+/// @see asset_archive_t
+enum class archive_codec_t : uint32_t {
+    none = 0,
+    lz4 = 1,
+    zstd = 2,
+};
+
+/**
+ * @brief Index entry of the `asset_archive_t`. The entries are sorted by `hash`
+ */
+struct archive_entry_t final {
+    uint64_t hash;        // 64 bit FNV-1a of the name
+    uint64_t offset;      // from the beginning of the archive. aligned to the header's alignment
+    uint64_t size;        // length of the original contents
+    uint64_t stored_size; // length in the archive. same with `size` if not compressed
+    archive_codec_t codec;
+    uint32_t name_offset; // in the name table
+    uint32_t name_length;
+    uint32_t reserved;
+};
+
+/// @see write_archive
+struct archive_source_t final {
+    std::string name; // the key for `asset_archive_t::find`. Use '/' for the separator
+    std::filesystem::path fpath;
+};
+
+/**
+ * @brief Pack the files into one archive. The entries are compressed with the `codec` only if it makes them smaller
+ * @param alignment power of 2. offset of each blob
+ * @throw std::system_error     I/O error or the `codec` is not available in this build
+ * @throw std::invalid_argument duplicated names
+ * @see asset_packer
+ */
+_INTERFACE_ void write_archive(const std::filesystem::path& output, gsl::span<const archive_source_t> sources,
+                               archive_codec_t codec = archive_codec_t::none, uint32_t alignment = 64) noexcept(false);
+
+/**
+ * @brief Read-only view of the archive from `write_archive`. One open and one mmap for all entries.
+ *        The uncompressed entries can be used without a copy.
+ * 
+ * @see mapped_file_t
+ */
+class _INTERFACE_ asset_archive_t final {
+  private:
+    mapped_file_t file;
+    gsl::span<const archive_entry_t> entries{};
+    gsl::span<const char> names{};
+
+  public:
+    /**
+     * @throw std::system_error  the file can't be opened
+     * @throw std::runtime_error the file is not a valid archive
+     */
+    explicit asset_archive_t(const std::filesystem::path& fpath) noexcept(false);
+    asset_archive_t(asset_archive_t const&) = delete;
+    asset_archive_t& operator=(asset_archive_t const&) = delete;
+    asset_archive_t(asset_archive_t&&) = delete;
+    asset_archive_t& operator=(asset_archive_t&&) = delete;
+
+    size_t size() const noexcept;
+    gsl::span<const archive_entry_t> get_entries() const noexcept;
+    std::string_view get_name(const archive_entry_t& entry) const noexcept;
+
+    /// @return nullptr if there is no entry for the `name`
+    const archive_entry_t* find(std::string_view name) const noexcept;
+
+    /// @return Empty if the entry is compressed. Use `read` for it
+    gsl::span<const std::byte> get(const archive_entry_t& entry) const noexcept;
+
+    /**
+     * @brief Decompress(or copy) the entry to the `dst`
+     * @param dst   at least `entry.size` bytes
+     * @return uint32_t  0 if successful. EINVAL for the short `dst`, ENOTSUP for the codec not in this build,
+     *                   EILSEQ for the broken contents
+     */
+    uint32_t read(const archive_entry_t& entry, gsl::span<std::byte> dst) const noexcept;
+};
@@ -0,0 +1,252 @@
+#include <graphics.h>
+#include <spdlog/spdlog.h>
+
+#include "hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#if defined(USE_LZ4)
+#include <lz4.h>
+#endif
+#if defined(USE_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+constexpr uint32_t archive_magic = 0x41504c47; // "GLPA"
+constexpr uint32_t archive_version = 1;
+
+/// @brief The index(entries, then the names) follows the blobs
+struct archive_header_t final {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t alignment;
+    uint32_t count;
+    uint64_t index_offset;
+    uint64_t names_length;
+};
+static_assert(sizeof(archive_header_t) == 32);
+static_assert(sizeof(archive_entry_t) == 48);
+
+bool is_codec_available(archive_codec_t codec) noexcept {
+    switch (codec) {
+    case archive_codec_t::none:
+        return true;
+#if defined(USE_LZ4)
+    case archive_codec_t::lz4:
+        return true;
+#endif
+#if defined(USE_ZSTD)
+    case archive_codec_t::zstd:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+/// @return empty if the codec is not available or the result is not smaller than the `src`
+auto compress(archive_codec_t codec, gsl::span<const std::byte> src) noexcept(false) -> std::vector<std::byte> {
+    std::vector<std::byte> dst{};
+    const auto length = static_cast<size_t>(src.size());
+    switch (codec) {
+#if defined(USE_LZ4)
+    case archive_codec_t::lz4: {
+        if (length > LZ4_MAX_INPUT_SIZE)
+            break;
+        dst.resize(LZ4_compressBound(static_cast<int>(length)));
+        const auto sz = LZ4_compress_default(reinterpret_cast<const char*>(src.data()), reinterpret_cast<char*>(dst.data()),
+                                             static_cast<int>(length), static_cast<int>(dst.size()));
+        dst.resize(sz > 0 ? static_cast<size_t>(sz) : 0);
+        break;
+    }
+#endif
+#if defined(USE_ZSTD)
+    case archive_codec_t::zstd: {
+        dst.resize(ZSTD_compressBound(length));
+        const auto sz = ZSTD_compress(dst.data(), dst.size(), src.data(), length, ZSTD_CLEVEL_DEFAULT);
+        dst.resize(ZSTD_isError(sz) ? 0 : sz);
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+    if (dst.size() >= length)
+        dst.clear();
+    return dst;
+}
+
+void write_padding(std::ofstream& fout, uint64_t& offset, uint32_t alignment) noexcept(false) {
+    const auto aligned = (offset + alignment - 1) & ~static_cast<uint64_t>(alignment - 1);
+    const char zeros[256]{};
+    while (offset < aligned) {
+        const auto sz = std::min<uint64_t>(aligned - offset, sizeof(zeros));
+        fout.write(zeros, static_cast<std::streamsize>(sz));
+        offset += sz;
+    }
+}
+
+void write_archive(const fs::path& output, gsl::span<const archive_source_t> sources, archive_codec_t codec,
+                   uint32_t alignment) noexcept(false) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        throw std::invalid_argument{"alignment must be power of 2"};
+    if (is_codec_available(codec) == false)
+        throw std::system_error{ENOTSUP, std::system_category(), "archive_codec_t"};
+
+    std::vector<archive_entry_t> entries(static_cast<size_t>(sources.size()));
+    std::vector<size_t> order(entries.size());
+    std::string names{};
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const auto& name = sources[i].name;
+        entries[i].hash = fnv1a(name);
+        entries[i].name_offset = gsl::narrow<uint32_t>(names.size());
+        entries[i].name_length = gsl::narrow<uint32_t>(name.size());
+        names += name;
+        order[i] = i;
+    }
+    // the blobs are written in the index order, so the neighbor entries are close in the file
+    std::sort(order.begin(), order.end(), [&sources, &entries](size_t lhs, size_t rhs) {
+        if (entries[lhs].hash != entries[rhs].hash)
+            return entries[lhs].hash < entries[rhs].hash;
+        return sources[lhs].name < sources[rhs].name;
+    });
+    for (size_t i = 1; i < order.size(); ++i)
+        if (sources[order[i - 1]].name == sources[order[i]].name)
+            throw std::invalid_argument{sources[order[i]].name};
+
+    // write to the temporary file, then rename it. The readers won't see the incomplete archive
+    auto tmp = output;
+    tmp += ".tmp";
+    {
+        std::ofstream fout{tmp, std::ios::binary | std::ios::trunc};
+        if (fout.is_open() == false)
+            throw std::system_error{errno, std::system_category(), "ofstream"};
+        fout.exceptions(std::ios::badbit | std::ios::failbit);
+        archive_header_t header{archive_magic, archive_version, alignment, gsl::narrow<uint32_t>(entries.size()), 0, 0};
+        fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t offset = sizeof(header);
+        std::vector<archive_entry_t> sorted{};
+        for (auto i : order) {
+            auto& entry = sorted.emplace_back(entries[i]);
+            const mapped_file_t file{sources[i].fpath};
+            const auto contents = file.get();
+            const auto compressed = compress(codec, contents);
+            const auto blob = compressed.empty() ? contents : gsl::span<const std::byte>{compressed};
+            write_padding(fout, offset, alignment);
+            entry.offset = offset;
+            entry.size = static_cast<uint64_t>(contents.size());
+            entry.stored_size = static_cast<uint64_t>(blob.size());
+            entry.codec = compressed.empty() ? archive_codec_t::none : codec;
+            fout.write(reinterpret_cast<const char*>(blob.data()), static_cast<std::streamsize>(blob.size()));
+            offset += entry.stored_size;
+            SPDLOG_DEBUG("archive: {} {} -> {}", sources[i].name, entry.size, entry.stored_size);
+        }
+        write_padding(fout, offset, alignment);
+        header.index_offset = offset;
+        header.names_length = names.size();
+        fout.write(reinterpret_cast<const char*>(sorted.data()),
+                   static_cast<std::streamsize>(sorted.size() * sizeof(archive_entry_t)));
+        fout.write(names.data(), static_cast<std::streamsize>(names.size()));
+        fout.seekp(0);
+        fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    std::error_code ec{};
+    fs::rename(tmp, output, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        throw std::system_error{ec, "rename"};
+    }
+}
+
+asset_archive_t::asset_archive_t(const fs::path& fpath) noexcept(false) : file{fpath} {
+    const auto blob = file.get();
+    const auto length = static_cast<uint64_t>(blob.size());
+    if (length < sizeof(archive_header_t))
+        throw std::runtime_error{"archive: too short"};
+    archive_header_t header{};
+    std::memcpy(&header, blob.data(), sizeof(header));
+    if (header.magic != archive_magic || header.version != archive_version)
+        throw std::runtime_error{"archive: unknown format"};
+    if (header.alignment == 0 || (header.alignment & (header.alignment - 1)) != 0)
+        throw std::runtime_error{"archive: broken alignment"};
+    const uint64_t index_length = header.count * sizeof(archive_entry_t);
+    if (header.index_offset % alignof(archive_entry_t) != 0 || header.index_offset > length ||
+        index_length > length - header.index_offset ||
+        header.names_length > length - header.index_offset - index_length)
+        throw std::runtime_error{"archive: broken index"};
+    entries = {reinterpret_cast<const archive_entry_t*>(blob.data() + header.index_offset), header.count};
+    names = {reinterpret_cast<const char*>(blob.data() + header.index_offset + index_length),
+             static_cast<size_t>(header.names_length)};
+    for (const auto& entry : entries) {
+        if (entry.offset > header.index_offset || entry.stored_size > header.index_offset - entry.offset ||
+            entry.offset % header.alignment != 0 || //
+            entry.name_offset > header.names_length || entry.name_length > header.names_length - entry.name_offset)
+            throw std::runtime_error{"archive: broken entry"};
+        // `get` returns the stored bytes for `size`
+        if (entry.codec == archive_codec_t::none && entry.size != entry.stored_size)
+            throw std::runtime_error{"archive: broken entry"};
+    }
+    // `find` is a binary search
+    if (std::is_sorted(entries.begin(), entries.end(), [](const archive_entry_t& lhs, const archive_entry_t& rhs) {
+            return lhs.hash < rhs.hash;
+        }) == false)
+        throw std::runtime_error{"archive: unsorted index"};
+}
+
+size_t asset_archive_t::size() const noexcept {
+    return static_cast<size_t>(entries.size());
+}
+
+gsl::span<const archive_entry_t> asset_archive_t::get_entries() const noexcept {
+    return entries;
+}
+
+std::string_view asset_archive_t::get_name(const archive_entry_t& entry) const noexcept {
+    return {names.data() + entry.name_offset, entry.name_length};
+}
+
+const archive_entry_t* asset_archive_t::find(std::string_view name) const noexcept {
+    const auto hash = fnv1a(name);
+    auto it = std::lower_bound(entries.begin(), entries.end(), hash,
+                               [](const archive_entry_t& entry, uint64_t hash) { return entry.hash < hash; });
+    for (; it != entries.end() && it->hash == hash; ++it)
+        if (get_name(*it) == name)
+            return &(*it);
+    return nullptr;
+}
+
+gsl::span<const std::byte> asset_archive_t::get(const archive_entry_t& entry) const noexcept {
+    if (entry.codec != archive_codec_t::none)
+        return {};
+    return file.get().subspan(entry.offset, entry.size);
+}
+
+uint32_t asset_archive_t::read(const archive_entry_t& entry, gsl::span<std::byte> dst) const noexcept {
+    if (static_cast<uint64_t>(dst.size()) < entry.size)
+        return EINVAL;
+    const auto src = file.get().subspan(entry.offset, entry.stored_size);
+    switch (entry.codec) {
+    case archive_codec_t::none:
+        std::memcpy(dst.data(), src.data(), entry.size);
+        return 0;
+#if defined(USE_LZ4)
+    case archive_codec_t::lz4: {
+        const auto sz = LZ4_decompress_safe(reinterpret_cast<const char*>(src.data()), reinterpret_cast<char*>(dst.data()),
+                                            gsl::narrow_cast<int>(entry.stored_size), gsl::narrow_cast<int>(entry.size));
+        return sz >= 0 && static_cast<uint64_t>(sz) == entry.size ? 0 : EILSEQ;
+    }
+#endif
+#if defined(USE_ZSTD)
+    case archive_codec_t::zstd: {
+        const auto sz = ZSTD_decompress(dst.data(), entry.size, src.data(), entry.stored_size);
+        return ZSTD_isError(sz) == 0 && sz == entry.size ? 0 : EILSEQ;
+    }
+#endif
+    default:
+        return ENOTSUP;
+    }
+}
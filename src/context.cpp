@@ -3,10 +3,30 @@
  */
 #include <graphics.h>
 #include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <mutex>
 #if __has_include(<EGL/eglext_angle.h>)
 #include <EGL/eglext_angle.h>
 #endif
 
+// clang-format off
+#ifndef EGL_PLATFORM_DEVICE_EXT
+#  define EGL_PLATFORM_DEVICE_EXT 0x313F
+#endif
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#  define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#ifndef EGL_DRM_DEVICE_FILE_EXT
+#  define EGL_DRM_DEVICE_FILE_EXT 0x3233
+#endif
+#ifndef EGL_DRM_RENDER_NODE_FILE_EXT
+#  define EGL_DRM_RENDER_NODE_FILE_EXT 0x3377
+#endif
+// clang-format on
+
 class opengl_error_category_t final : public std::error_category {
     const char* name() const noexcept override {
         return "OpenGL";
@@ -29,8 +49,12 @@ EGLint report_egl_error(gsl::czstring<> fname, EGLint ec = eglGetError()) {
     return ec;
 }
 
+void cache_extensions(EGLDisplay display) noexcept;
+void track_extensions(EGLContext context) noexcept;
+void forget_extensions(EGLContext context) noexcept;
+
 egl_context_t::egl_context_t(EGLDisplay display, EGLContext share_context) noexcept {
-    spdlog::debug(__FUNCTION__);
+    SPDLOG_DEBUG(__FUNCTION__);
     // remember the EGLDisplay
     this->display = display;
     EGLint version[2]{};
@@ -40,7 +64,8 @@ egl_context_t::egl_context_t(EGLDisplay display, EGLContext share_context) noexc
     }
     major = gsl::narrow<uint16_t>(version[0]);
     minor = gsl::narrow<uint16_t>(version[1]);
-    spdlog::debug("EGLDisplay {} {}.{}", display, major, minor);
+    SPDLOG_DEBUG("EGLDisplay {} {}.{}", display, major, minor);
+    cache_extensions(display);
 
     // acquire EGLConfigs
     EGLint num_config = 3;
@@ -51,8 +76,10 @@ egl_context_t::egl_context_t(EGLDisplay display, EGLContext share_context) noexc
 
     // create context for OpenGL ES 3.0+
     EGLint attrs[]{EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 0, EGL_NONE};
-    if (context = eglCreateContext(display, configs[0], share_context, attrs); context != EGL_NO_CONTEXT)
-        spdlog::debug("EGL create: context {} {}", context, share_context);
+    if (context = eglCreateContext(display, configs[0], share_context, attrs); context != EGL_NO_CONTEXT) {
+        SPDLOG_DEBUG("EGL create: context {} {}", context, share_context);
+        track_extensions(context);
+    }
 }
 
 bool egl_context_t::is_valid() const noexcept {
@@ -60,12 +87,12 @@ bool egl_context_t::is_valid() const noexcept {
 }
 
 egl_context_t::~egl_context_t() noexcept {
-    spdlog::debug(__FUNCTION__);
+    SPDLOG_DEBUG(__FUNCTION__);
     destroy();
 }
 
 EGLint egl_context_t::resume(gsl::owner<EGLSurface> es_surface, EGLConfig) noexcept {
-    spdlog::trace(__FUNCTION__);
+    SPDLOG_TRACE(__FUNCTION__);
     if (context == EGL_NO_CONTEXT)
         return EGL_NOT_INITIALIZED;
     if (es_surface == EGL_NO_SURFACE)
@@ -77,14 +104,27 @@ EGLint egl_context_t::resume(gsl::owner<EGLSurface> es_surface, EGLConfig) noexc
     if (auto ec = eglGetError(); ec != EGL_SUCCESS)
         return report_egl_error("eglQuerySurface", ec);
 
-    spdlog::debug("EGL current: {}/{} {}", surface, surface, context);
+    SPDLOG_DEBUG("EGL current: {}/{} {}", surface, surface, context);
     if (eglMakeCurrent(display, surface, surface, context) == EGL_FALSE)
         return report_egl_error("eglMakeCurrent", eglGetError());
     return EGL_SUCCESS;
 }
 
+EGLint egl_context_t::resume() noexcept {
+    SPDLOG_TRACE(__FUNCTION__);
+    if (context == EGL_NO_CONTEXT)
+        return EGL_NOT_INITIALIZED;
+    if (has_extension(display, egl_extension_t::KHR_surfaceless_context) == false)
+        return EGL_BAD_MATCH;
+
+    SPDLOG_DEBUG("EGL current: EGL_NO_SURFACE/EGL_NO_SURFACE {}", context);
+    if (eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_FALSE)
+        return report_egl_error("eglMakeCurrent", eglGetError());
+    return EGL_SUCCESS;
+}
+
 EGLint egl_context_t::resume(gsl::not_null<EGLNativeWindowType> window) noexcept {
-    spdlog::trace(__FUNCTION__);
+    SPDLOG_TRACE(__FUNCTION__);
     if (context == EGL_NO_CONTEXT)
         return EGL_NOT_INITIALIZED;
 
@@ -98,22 +138,22 @@ EGLint egl_context_t::resume(gsl::not_null<EGLNativeWindowType> window) noexcept
     eglQuerySurface(display, surface, EGL_HEIGHT, &surface_height);
     if (auto ec = eglGetError(); ec != EGL_SUCCESS)
         return report_egl_error("eglQuerySurface", ec);
-    spdlog::debug("EGL create: surface {} {} {}", surface, surface_width, surface_height);
+    SPDLOG_DEBUG("EGL create: surface {} {} {}", surface, surface_width, surface_height);
 
     // bind surface and context
-    spdlog::debug("EGL current: {}/{} {}", surface, surface, context);
+    SPDLOG_DEBUG("EGL current: {}/{} {}", surface, surface, context);
     if (eglMakeCurrent(display, surface, surface, context) == EGL_FALSE)
         return report_egl_error("eglMakeCurrent", eglGetError());
     return EGL_SUCCESS;
 }
 
 EGLint egl_context_t::suspend() noexcept {
-    spdlog::trace(__FUNCTION__);
+    SPDLOG_TRACE(__FUNCTION__);
     if (context == EGL_NO_CONTEXT)
         return EGL_NOT_INITIALIZED;
 
     // unbind surface. OpenGL ES 3.1 will return true
-    spdlog::debug("EGL current: EGL_NO_SURFACE/EGL_NO_SURFACE {}", context);
+    SPDLOG_DEBUG("EGL current: EGL_NO_SURFACE/EGL_NO_SURFACE {}", context);
     if (eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_FALSE) {
         // OpenGL ES 3.0 will report error. consume it
         // then unbind both surface and context.
@@ -133,18 +173,19 @@ EGLint egl_context_t::suspend() noexcept {
 }
 
 void egl_context_t::destroy() noexcept {
-    spdlog::trace(__FUNCTION__);
+    SPDLOG_TRACE(__FUNCTION__);
     if (display == EGL_NO_DISPLAY) // already terminated
         return;
 
     // unbind surface and context
-    spdlog::debug("EGL current: EGL_NO_SURFACE/EGL_NO_SURFACE EGL_NO_CONTEXT");
+    SPDLOG_DEBUG("EGL current: EGL_NO_SURFACE/EGL_NO_SURFACE EGL_NO_CONTEXT");
     if (eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT) == EGL_FALSE) {
         report_egl_error("eglMakeCurrent", eglGetError());
         return;
     }
     // destroy known context
     if (context != EGL_NO_CONTEXT) {
+        forget_extensions(context);
         spdlog::warn("EGL destroy: context {}", context);
         if (eglDestroyContext(display, context) == EGL_FALSE)
             report_egl_error("eglDestroyContext", eglGetError());
@@ -190,17 +231,24 @@ EGLint egl_context_t::get_configs(EGLConfig* configs, EGLint& count, const EGLin
                           EGL_BLUE_SIZE,       color_size,         EGL_GREEN_SIZE,   color_size,
                           EGL_RED_SIZE,        color_size,         EGL_ALPHA_SIZE,   color_size,
                           EGL_DEPTH_SIZE,      depth_size,         EGL_NONE};
+    const auto capacity = count;
     if (attrs == nullptr)
         attrs = backup_attrs;
-    if (eglChooseConfig(this->display, attrs, configs, count, &count) == EGL_FALSE)
+    if (eglChooseConfig(this->display, attrs, configs, capacity, &count) == EGL_FALSE)
         return eglGetError();
+    // headless displays(surfaceless, device) don't have EGL_WINDOW_BIT configs. accept any surface type
+    if (count == 0 && attrs == backup_attrs) {
+        backup_attrs[3] = 0;
+        if (eglChooseConfig(this->display, attrs, configs, capacity, &count) == EGL_FALSE)
+            return eglGetError();
+    }
     return 0;
 }
 
 bool for_each_extension(EGLDisplay display, bool (*handler)(std::string_view, void* ptr), void* ptr) noexcept {
     if (const auto txt = eglQueryString(display, EGL_EXTENSIONS)) {
         const auto txtlen = strlen(txt);
-        auto offset = 0;
+        size_t offset = 0;
         for (auto i = 0u; i < txtlen; ++i) {
             if (isspace(txt[i]) == false)
                 continue;
@@ -208,6 +256,9 @@ bool for_each_extension(EGLDisplay display, bool (*handler)(std::string_view, vo
                 return true;
             offset = ++i;
         }
+        // the last one may not have a trailing space
+        if (offset < txtlen)
+            return handler({txt + offset, txtlen - offset}, ptr);
     }
     return false;
 }
@@ -232,3 +283,257 @@ bool has_extension(EGLDisplay display, std::string_view name) noexcept {
         },
         &name);
 }
+
+// sorted. the index is the value of `egl_extension_t`
+constexpr std::string_view egl_extension_names[]{
+    "EGL_ANGLE_d3d_share_handle_client_buffer",
+    "EGL_ANGLE_surface_d3d_texture_2d_share_handle",
+    "EGL_EXT_device_base",
+    "EGL_EXT_device_enumeration",
+    "EGL_EXT_platform_base",
+    "EGL_EXT_platform_device",
+    "EGL_KHR_create_context",
+    "EGL_KHR_fence_sync",
+    "EGL_KHR_gl_texture_2D_image",
+    "EGL_KHR_image_base",
+    "EGL_KHR_no_config_context",
+    "EGL_KHR_surfaceless_context",
+    "EGL_KHR_wait_sync",
+    "EGL_MESA_platform_surfaceless",
+};
+// sorted. the index is the value of `gl_extension_t`
+constexpr std::string_view gl_extension_names[]{
+    "GL_EXT_buffer_storage",
+    "GL_EXT_color_buffer_float",
+    "GL_EXT_disjoint_timer_query",
+    "GL_EXT_read_format_bgra",
+    "GL_EXT_texture_format_BGRA8888",
+    "GL_KHR_debug",
+    "GL_KHR_parallel_shader_compile",
+    "GL_OES_EGL_image",
+    "GL_OES_EGL_image_external",
+};
+
+template <size_t N>
+constexpr bool is_sorted_names(const std::string_view (&names)[N]) noexcept {
+    for (size_t i = 1; i < N; ++i)
+        if (names[i - 1] >= names[i])
+            return false;
+    return true;
+}
+static_assert(std::size(egl_extension_names) == static_cast<size_t>(egl_extension_t::count));
+static_assert(std::size(gl_extension_names) == static_cast<size_t>(gl_extension_t::count));
+static_assert(is_sorted_names(egl_extension_names));
+static_assert(is_sorted_names(gl_extension_names));
+static_assert(static_cast<size_t>(egl_extension_t::count) <= 64 && static_cast<size_t>(gl_extension_t::count) <= 64);
+
+std::string_view get_name(egl_extension_t name) noexcept {
+    return egl_extension_names[static_cast<size_t>(name)];
+}
+std::string_view get_name(gl_extension_t name) noexcept {
+    return gl_extension_names[static_cast<size_t>(name)];
+}
+
+/// @return -1 if the name is unknown
+template <size_t N>
+int32_t find_name(const std::string_view (&names)[N], std::string_view name) noexcept {
+    const auto it = std::lower_bound(std::begin(names), std::end(names), name);
+    if (it == std::end(names) || *it != name)
+        return -1;
+    return static_cast<int32_t>(it - std::begin(names));
+}
+
+/// @return false if the extension string is not available. The result must not be cached then
+bool scan_egl_extensions(const void* display, uint64_t& bits) noexcept {
+    if (eglQueryString(const_cast<EGLDisplay>(display), EGL_EXTENSIONS) == nullptr) {
+        eglGetError(); // consume EGL_NOT_INITIALIZED
+        return false;
+    }
+    bits = 0;
+    for_each_extension(
+        const_cast<EGLDisplay>(display),
+        [](std::string_view name, void* ptr) {
+            if (auto idx = find_name(egl_extension_names, name); idx >= 0)
+                *reinterpret_cast<uint64_t*>(ptr) |= uint64_t{1} << idx;
+            return false; // continue loop
+        },
+        &bits);
+    return true;
+}
+
+bool scan_gl_extensions(const void*, uint64_t& bits) noexcept {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    if (glGetError() != GL_NO_ERROR)
+        return false;
+    bits = 0;
+    for (auto i = 0; i < count; ++i) {
+        const auto name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (name == nullptr)
+            continue;
+        if (auto idx = find_name(gl_extension_names, name); idx >= 0)
+            bits |= uint64_t{1} << idx;
+    }
+    return true;
+}
+
+/// @brief extension bitsets for each EGLDisplay(or EGLContext)
+struct extension_cache_t final {
+    struct item_t final {
+        const void* key;
+        uint64_t bits;
+        bool scanned; // false until the first lookup. the EGLContext must be current for the scan
+    };
+    std::mutex mtx{};
+    std::vector<item_t> items{};
+    std::atomic<uint32_t> generation{1}; // increased when an item is removed
+};
+/// @brief the last lookup result of the thread. This makes the hot path lock-free
+struct extension_lookup_t final {
+    const void* key = nullptr;
+    uint64_t bits = 0;
+    uint32_t generation = 0;
+};
+
+extension_cache_t egl_extensions{};
+extension_cache_t gl_extensions{}; // only for the EGLContext of `egl_context_t`
+
+/// @param insert   cache the unknown `key`. If false, only the tracked keys are cached and the others are scanned
+bool get_extension_bits(extension_cache_t& cache, extension_lookup_t& last, const void* key,
+                        bool (*scan)(const void*, uint64_t&) noexcept, bool insert, uint64_t& bits) noexcept {
+    if (last.generation == cache.generation.load(std::memory_order_acquire) && last.key == key) {
+        bits = last.bits;
+        return true;
+    }
+    std::unique_lock lck{cache.mtx};
+    auto it = std::find_if(cache.items.begin(), cache.items.end(), [key](const auto& item) { //
+        return item.key == key;
+    });
+    if (it == cache.items.end()) {
+        if (insert == false) {
+            lck.unlock();
+            return scan(key, bits);
+        }
+        if (scan(key, bits) == false)
+            return false;
+        cache.items.emplace_back(extension_cache_t::item_t{key, bits, true});
+    } else if (it->scanned == false) {
+        if (scan(key, bits) == false)
+            return false;
+        it->bits = bits;
+        it->scanned = true;
+    } else {
+        bits = it->bits;
+    }
+    last = {key, bits, cache.generation.load(std::memory_order_relaxed)};
+    return true;
+}
+
+/// @brief remove the `key`. The last lookup results of the threads are invalidated with the generation
+void evict_extension_bits(extension_cache_t& cache, const void* key) noexcept {
+    std::lock_guard lck{cache.mtx};
+    auto& items = cache.items;
+    items.erase(std::remove_if(items.begin(), items.end(), [key](const auto& item) { //
+                    return item.key == key;
+                }),
+                items.end());
+    cache.generation.fetch_add(1, std::memory_order_release);
+}
+
+/// @brief rebuild the cache after `eglInitialize`. The display may have been terminated and initialized again
+void cache_extensions(EGLDisplay display) noexcept {
+    evict_extension_bits(egl_extensions, display);
+    thread_local extension_lookup_t last{};
+    uint64_t bits = 0;
+    if (get_extension_bits(egl_extensions, last, display, &scan_egl_extensions, true, bits))
+        SPDLOG_DEBUG("EGL extensions: {} {:#x}", display, bits);
+}
+
+/// @brief start caching for the `context`. Call after `eglCreateContext`
+void track_extensions(EGLContext context) noexcept {
+    std::lock_guard lck{gl_extensions.mtx};
+    gl_extensions.items.emplace_back(extension_cache_t::item_t{context, 0, false});
+}
+
+/// @brief stop caching for the `context`. Call before `eglDestroyContext`. The handle value can be reused after it
+void forget_extensions(EGLContext context) noexcept {
+    evict_extension_bits(gl_extensions, context);
+}
+
+void reset_extensions(EGLDisplay display) noexcept {
+    evict_extension_bits(egl_extensions, display);
+}
+
+bool has_extension(EGLDisplay display, egl_extension_t name) noexcept {
+    thread_local extension_lookup_t last{};
+    uint64_t bits = 0;
+    if (get_extension_bits(egl_extensions, last, display, &scan_egl_extensions, true, bits) == false)
+        return false;
+    return bits & (uint64_t{1} << static_cast<uint32_t>(name));
+}
+
+bool has_extension(gl_extension_t name) noexcept {
+    const EGLContext context = eglGetCurrentContext();
+    if (context == EGL_NO_CONTEXT)
+        return false;
+    thread_local extension_lookup_t last{};
+    uint64_t bits = 0;
+    // the other EGLContexts are not cached. their handles may be reused without `forget_extensions`
+    if (get_extension_bits(gl_extensions, last, context, &scan_gl_extensions, false, bits) == false)
+        return false;
+    return bits & (uint64_t{1} << static_cast<uint32_t>(name));
+}
+
+EGLint get_egl_devices(EGLDeviceEXT* devices, EGLint& count) noexcept {
+    auto query_devices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(eglGetProcAddress("eglQueryDevicesEXT"));
+    if (query_devices == nullptr) {
+        count = 0;
+        return EGL_BAD_ACCESS;
+    }
+    if (devices == nullptr) {
+        if (query_devices(0, nullptr, &count) == EGL_FALSE)
+            return report_egl_error("eglQueryDevicesEXT", eglGetError());
+        return EGL_SUCCESS;
+    }
+    if (query_devices(count, devices, &count) == EGL_FALSE)
+        return report_egl_error("eglQueryDevicesEXT", eglGetError());
+    return EGL_SUCCESS;
+}
+
+EGLDisplay get_headless_display(EGLint device_index) noexcept {
+    auto get_platform_display =
+        reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (get_platform_display == nullptr) {
+        spdlog::error("{}: EGL_EXT_platform_base is not available", __FUNCTION__);
+        return EGL_NO_DISPLAY;
+    }
+    if (device_index < 0) {
+        if (has_extension(EGL_NO_DISPLAY, egl_extension_t::MESA_platform_surfaceless) == false) {
+            spdlog::error("{}: EGL_MESA_platform_surfaceless is not available", __FUNCTION__);
+            return EGL_NO_DISPLAY;
+        }
+        return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (has_extension(EGL_NO_DISPLAY, egl_extension_t::EXT_platform_device) == false) {
+        spdlog::error("{}: EGL_EXT_platform_device is not available", __FUNCTION__);
+        return EGL_NO_DISPLAY;
+    }
+    constexpr auto max_device_count = 16;
+    EGLDeviceEXT devices[max_device_count]{};
+    EGLint count = max_device_count;
+    if (get_egl_devices(devices, count) != EGL_SUCCESS || device_index >= count) {
+        spdlog::error("{}: device {} is not available", __FUNCTION__, device_index);
+        return EGL_NO_DISPLAY;
+    }
+    EGLDeviceEXT device = devices[device_index];
+    // the render node is useful to check which device is shared with the other processes
+    if (auto query_string =
+            reinterpret_cast<PFNEGLQUERYDEVICESTRINGEXTPROC>(eglGetProcAddress("eglQueryDeviceStringEXT"))) {
+        const auto extensions = query_string(device, EGL_EXTENSIONS);
+        if (extensions && strstr(extensions, "EGL_EXT_device_drm_render_node"))
+            SPDLOG_DEBUG("EGL device {}: {}", device_index, query_string(device, EGL_DRM_RENDER_NODE_FILE_EXT));
+        else if (extensions && strstr(extensions, "EGL_EXT_device_drm"))
+            SPDLOG_DEBUG("EGL device {}: {}", device_index, query_string(device, EGL_DRM_DEVICE_FILE_EXT));
+    }
+    return get_platform_display(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+}
@@ -0,0 +1,144 @@
+#include <graphics.h>
+#include <spdlog/spdlog.h>
+
+#include "worker_pool.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+
+EGLint report_egl_error(gsl::czstring<> fname, EGLint ec);
+
+struct egl_worker_pool_t::impl_t final {
+    struct work_t final {
+        egl_task_t task;
+        void* user_data;
+        std::promise<EGLSync> fence;
+    };
+
+    EGLDisplay display;
+    std::mutex mtx{};
+    std::deque<work_t> works{};
+    std::unique_ptr<worker_pool_t> workers{};
+
+    EGLSync run(work_t& work) noexcept {
+        work.task(work.user_data);
+        // the fence must be flushed before the other context waits for it
+        EGLSync fence = eglCreateSync(display, EGL_SYNC_FENCE, nullptr);
+        if (fence == EGL_NO_SYNC) {
+            report_egl_error("eglCreateSync", eglGetError());
+            glFinish();
+            return EGL_NO_SYNC;
+        }
+        glFlush();
+        return fence;
+    }
+
+    /// @brief the task of the `workers`. 1 task for each `submit`
+    void run_front() noexcept {
+        std::unique_lock lck{mtx};
+        work_t work = std::move(works.front());
+        works.pop_front();
+        lck.unlock();
+        work.fence.set_value(run(work));
+    }
+
+    /// @note the EGLContext is created and destroyed in the worker thread
+    void start(worker_pool_t& pool, EGLContext share_context, std::promise<EGLint>& ready) noexcept {
+        egl_context_t context{display, share_context};
+        if (context.is_valid() == false)
+            return ready.set_value(EGL_BAD_CONTEXT);
+        EGLConfig config{};
+        EGLint count = 1;
+        if (auto ec = context.get_configs(&config, count))
+            return ready.set_value(report_egl_error("eglChooseConfig", ec));
+        const EGLint attrs[]{EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        EGLSurface surface = eglCreatePbufferSurface(display, config, attrs);
+        if (surface == EGL_NO_SURFACE)
+            return ready.set_value(report_egl_error("eglCreatePbufferSurface", eglGetError()));
+        if (auto ec = context.resume(surface, config); ec != EGL_SUCCESS)
+            return ready.set_value(ec);
+        SPDLOG_DEBUG("EGL worker: context {}", context.handle());
+        ready.set_value(EGL_SUCCESS);
+        pool.loop();
+    }
+};
+
+egl_worker_pool_t::egl_worker_pool_t(EGLDisplay display, EGLContext share_context, uint16_t count) noexcept
+    : display{display} {
+    SPDLOG_DEBUG(__FUNCTION__);
+    if (count == 0 || count > max_capacity) {
+        ec = EGL_BAD_PARAMETER;
+        return;
+    }
+    impl = new (std::nothrow) impl_t{};
+    if (impl == nullptr) {
+        ec = EGL_BAD_ALLOC;
+        return;
+    }
+    impl->display = display;
+    std::promise<EGLint> promises[max_capacity]{};
+    std::future<EGLint> futures[max_capacity]{};
+    try {
+        for (auto i = 0u; i < count; ++i)
+            futures[i] = promises[i].get_future();
+        impl->workers = std::make_unique<worker_pool_t>(
+            count, [impl = impl, share_context, &promises](worker_pool_t& pool, uint32_t index) {
+                impl->start(pool, share_context, promises[index]);
+            });
+    } catch (const std::exception& ex) {
+        spdlog::error("{} {}", __FUNCTION__, ex.what());
+        ec = EGL_BAD_ALLOC; // the started threads are joined
+        return;
+    }
+    // the threads are referencing the promises. wait for all of them
+    capacity = gsl::narrow_cast<uint16_t>(impl->workers->size());
+    for (auto i = 0u; i < capacity; ++i)
+        if (auto result = futures[i].get(); result != EGL_SUCCESS)
+            ec = result;
+}
+
+egl_worker_pool_t::~egl_worker_pool_t() noexcept {
+    SPDLOG_DEBUG(__FUNCTION__);
+    if (impl == nullptr)
+        return;
+    impl->workers = nullptr; // finish the queued tasks, then join
+    delete impl;
+}
+
+EGLint egl_worker_pool_t::is_valid() const noexcept {
+    return ec;
+}
+
+uint16_t egl_worker_pool_t::size() const noexcept {
+    return capacity;
+}
+
+std::future<EGLSync> egl_worker_pool_t::submit(egl_task_t task, void* user_data) noexcept(false) {
+    if (ec != EGL_SUCCESS)
+        throw std::runtime_error{"egl_worker_pool_t is not valid"};
+    std::promise<EGLSync> fence{};
+    auto result = fence.get_future();
+    {
+        std::lock_guard lck{impl->mtx};
+        impl->works.emplace_back(impl_t::work_t{task, user_data, std::move(fence)});
+    }
+    try {
+        impl->workers->submit([impl = impl]() { impl->run_front(); });
+    } catch (...) {
+        std::lock_guard lck{impl->mtx};
+        impl->works.pop_back();
+        throw;
+    }
+    return result;
+}
+
+EGLint egl_worker_pool_t::wait(EGLSync fence) noexcept {
+    if (fence == EGL_NO_SYNC)
+        return EGL_SUCCESS;
+    auto on_return = gsl::finally([this, fence]() { eglDestroySync(display, fence); });
+    if (eglWaitSync(display, fence, 0) == EGL_FALSE)
+        return report_egl_error("eglWaitSync", eglGetError());
+    return EGL_SUCCESS;
+}
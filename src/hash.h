@@ -0,0 +1,16 @@
+/**
+ * @brief Internal hash functions. `hash_name` in graphics.h is the public one for `gl_program_t`
+ * @see http://www.isthe.com/chongo/tech/comp/fnv/index.html
+ */
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+/// @brief 64 bit FNV-1a. Chain the calls with the `hash` to hash multiple strings
+constexpr uint64_t fnv1a(std::string_view text, uint64_t hash = 0xcbf29ce484222325) noexcept {
+    for (auto c : text) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
@@ -0,0 +1,555 @@
+#include <graphics.h>
+#include <spdlog/spdlog.h>
+
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+auto open(const fs::path& p) -> std::unique_ptr<FILE, int (*)(FILE*)>;
+uint32_t get_size(FILE* stream, size_t& sz) noexcept;
+
+struct asset_request_t final {
+    fs::path fpath;
+    asset_callback_t callback;
+    void* user_data;
+    int fd = -1;
+    int32_t slot = -1; // index of the buffer. -1 for the heap memory
+    std::byte* buffer = nullptr;
+    std::unique_ptr<std::byte[]> heap{};
+    size_t length = 0;
+    size_t offset = 0;
+    uint32_t ec = 0;
+};
+
+#if defined(__linux__)
+/**
+ * @brief Minimal io_uring without liburing. Only the io thread touches the rings
+ * @see https://man7.org/linux/man-pages/man7/io_uring.7.html
+ */
+class uring_t final {
+    int fd = -1;
+    io_uring_params params{};
+    void* sq_ring = MAP_FAILED;
+    size_t sq_ring_size = 0;
+    void* cq_ring = MAP_FAILED;
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size = 0;
+    unsigned *sq_head{}, *sq_tail{}, *sq_mask{}, *sq_array{};
+    unsigned *cq_head{}, *cq_tail{}, *cq_mask{};
+    io_uring_cqe* cqes = nullptr;
+    unsigned pending = 0; // pushed, but not submitted
+
+  public:
+    bool registered = false;
+
+  public:
+    uring_t() noexcept = default;
+    ~uring_t() noexcept {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED)
+            munmap(sq_ring, sq_ring_size);
+        if (fd != -1)
+            close(fd);
+    }
+    uring_t(uring_t const&) = delete;
+    uring_t& operator=(uring_t const&) = delete;
+    uring_t(uring_t&&) = delete;
+    uring_t& operator=(uring_t&&) = delete;
+
+    uint32_t setup(unsigned entries) noexcept {
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0)
+            return errno;
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED)
+            return errno;
+        cq_ring = sq_ring;
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+            cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                           IORING_OFF_CQ_RING);
+            if (cq_ring == MAP_FAILED)
+                return errno;
+        }
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(
+            mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED)
+            return errno;
+        auto sq = static_cast<std::byte*>(sq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        auto cq = static_cast<std::byte*>(cq_ring);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return 0;
+    }
+
+    /// @note the memory must be alive until the destruction
+    uint32_t register_buffers(const iovec* buffers, unsigned count) noexcept {
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, buffers, count) < 0)
+            return errno;
+        registered = true;
+        return 0;
+    }
+
+    /// @note `IORING_REGISTER_PROBE` is from Linux 5.6. The older kernels fail and the opcode is not supported
+    bool supports(uint8_t opcode) const noexcept {
+        constexpr unsigned count = 256;
+        alignas(io_uring_probe) std::byte storage[sizeof(io_uring_probe) + count * sizeof(io_uring_probe_op)]{};
+        auto probe = reinterpret_cast<io_uring_probe*>(storage);
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, count) < 0)
+            return false;
+        return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    unsigned capacity() const noexcept {
+        return params.sq_entries;
+    }
+
+    /// @note the caller must limit the reads in flight under the `capacity`
+    void push_read(asset_request_t& req) noexcept {
+        const unsigned tail = *sq_tail;
+        const unsigned index = tail & *sq_mask;
+        io_uring_sqe& sqe = sqes[index];
+        sqe = io_uring_sqe{};
+        sqe.fd = req.fd;
+        sqe.off = req.offset;
+        sqe.addr = reinterpret_cast<uintptr_t>(req.buffer + req.offset);
+        sqe.len = gsl::narrow_cast<uint32_t>(std::min<size_t>(req.length - req.offset, INT32_MAX));
+        sqe.user_data = reinterpret_cast<uintptr_t>(&req);
+        if (registered && req.slot >= 0) {
+            sqe.opcode = IORING_OP_READ_FIXED;
+            sqe.buf_index = gsl::narrow_cast<uint16_t>(req.slot);
+        } else {
+            sqe.opcode = IORING_OP_READ;
+        }
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        ++pending;
+    }
+
+    /// @brief submit the pushed reads, then wait for `min_complete` completions
+    uint32_t enter(unsigned min_complete) noexcept {
+        while (true) {
+            const auto submitted = syscall(__NR_io_uring_enter, fd, pending, min_complete, IORING_ENTER_GETEVENTS,
+                                           nullptr, 0);
+            if (submitted >= 0) {
+                pending -= static_cast<unsigned>(submitted);
+                return 0;
+            }
+            if (errno != EINTR)
+                return errno;
+        }
+    }
+
+    /// @brief take back the pushed reads which are not submitted yet. The kernel never saw them
+    template <typename Fn>
+    void cancel_pending(Fn&& fn) noexcept {
+        unsigned tail = *sq_tail;
+        for (; pending > 0; --pending) {
+            --tail;
+            fn(*reinterpret_cast<asset_request_t*>(sqes[tail & *sq_mask].user_data));
+        }
+        __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+    }
+
+    /// @note the kernel posts the completions without `enter`. So this works after `enter` failed
+    template <typename Fn>
+    void for_each_completion(Fn&& fn) noexcept {
+        unsigned head = *cq_head;
+        const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            fn(*reinterpret_cast<asset_request_t*>(cqe.user_data), cqe.res);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+};
+#endif
+
+struct asset_loader_t::impl_t final {
+    const size_t buffer_size;
+    std::unique_ptr<std::byte[]> storage;
+    std::vector<int32_t> slots{}; // available buffers
+    std::mutex mtx{};
+    std::condition_variable cv{};
+    std::deque<std::unique_ptr<asset_request_t>> pending{}; // not read yet
+    std::deque<std::unique_ptr<asset_request_t>> decodes{}; // read. waiting for the callback
+    size_t count = 0; // submitted, but the callback is not returned
+    bool stop = false;
+#if defined(__linux__)
+    uring_t ring{};
+    std::vector<std::unique_ptr<asset_request_t>> reads{}; // in the io_uring. owned by the io thread
+    std::thread io{};
+#endif
+    std::atomic<bool> use_ring = false; // false after io_uring_enter failed. see `fallback`
+    worker_pool_t workers; // decode. read too if `use_ring` is false
+
+    impl_t(uint16_t worker_count, uint16_t buffer_count, size_t buffer_size) noexcept(false)
+        : buffer_size{buffer_size}, storage{new std::byte[buffer_count * buffer_size]}, workers{worker_count} {
+        for (int32_t i = buffer_count - 1; i >= 0; --i)
+            slots.push_back(i);
+#if defined(__linux__)
+        if (auto ec = ring.setup(buffer_count)) {
+            spdlog::warn("io_uring_setup: {}", std::system_category().message(ec));
+            return;
+        }
+        // Linux 5.1 ~ 5.5 have io_uring without IORING_OP_READ. the workers read the files there
+        if (ring.supports(IORING_OP_READ) == false) {
+            spdlog::warn("io_uring: {}", "IORING_OP_READ is not supported");
+            return;
+        }
+        std::vector<iovec> buffers(buffer_count);
+        for (auto i = 0u; i < buffer_count; ++i)
+            buffers[i] = iovec{storage.get() + i * buffer_size, buffer_size};
+        // RLIMIT_MEMLOCK may be too small for the buffers. then the reads are not fixed
+        if (auto ec = ring.register_buffers(buffers.data(), buffer_count))
+            spdlog::warn("io_uring_register: {}", std::system_category().message(ec));
+        use_ring = true;
+#endif
+    }
+
+    void shutdown() noexcept {
+        {
+            std::lock_guard lck{mtx};
+            stop = true;
+        }
+        cv.notify_all();
+#if defined(__linux__)
+        if (io.joinable())
+            io.join();
+#endif
+        workers.join();
+    }
+
+    /// @brief 1 task for each work. If the task can't be queued, run it in this thread
+    void schedule() noexcept {
+        try {
+            workers.submit([this]() { step(); });
+        } catch (const std::bad_alloc&) {
+            step();
+        }
+    }
+
+    /// @note `mtx` must be locked
+    std::byte* acquire(asset_request_t& req) noexcept {
+        req.slot = slots.back();
+        slots.pop_back();
+        return storage.get() + req.slot * buffer_size;
+    }
+
+    /// @note `mtx` must be locked
+    void release(asset_request_t& req) noexcept {
+        if (req.slot >= 0)
+            slots.push_back(req.slot);
+        req.slot = -1;
+    }
+
+    /// @brief the file is larger than the buffer. return the slot and use the heap memory
+    void use_heap(asset_request_t& req) noexcept(false) {
+        {
+            std::lock_guard lck{mtx};
+            release(req);
+        }
+        req.heap = std::make_unique<std::byte[]>(req.length);
+        req.buffer = req.heap.get();
+    }
+
+    void complete(std::unique_ptr<asset_request_t> req) noexcept {
+        {
+            std::lock_guard lck{mtx};
+            decodes.emplace_back(std::move(req));
+        }
+        schedule();
+    }
+
+    void decode(asset_request_t& req) noexcept {
+        if (req.ec)
+            req.callback(req.user_data, {}, req.ec);
+        else
+            req.callback(req.user_data, {req.buffer, req.length}, 0);
+        req.heap = nullptr;
+        bool more = false; // a pending request can take the released slot
+        {
+            std::lock_guard lck{mtx};
+            release(req);
+            --count;
+            more = use_ring == false && pending.empty() == false;
+        }
+        cv.notify_all();
+        if (more)
+            schedule();
+    }
+
+    /// @brief read with the `FILE*` in the decode worker
+    void read(asset_request_t& req) noexcept {
+        try {
+            auto stream = open(req.fpath);
+            if (auto ec = get_size(stream.get(), req.length))
+                throw std::system_error{static_cast<int>(ec), std::system_category(), "get_size"};
+            if (req.length > buffer_size)
+                use_heap(req);
+            req.length = fread(req.buffer, sizeof(std::byte), req.length, stream.get());
+            if (ferror(stream.get()))
+                throw std::system_error{errno, std::system_category(), "fread"};
+        } catch (const std::system_error& ex) {
+            req.ec = static_cast<uint32_t>(ex.code().value());
+        } catch (const std::bad_alloc&) {
+            req.ec = ENOMEM;
+        }
+    }
+
+    /// @brief the task of the `workers`. Decode a read one, or read and decode a pending one
+    void step() noexcept {
+        std::unique_lock lck{mtx};
+        if (decodes.empty() == false) {
+            auto req = std::move(decodes.front());
+            decodes.pop_front();
+            lck.unlock();
+            return decode(*req);
+        }
+        // the other task took the work. a released slot will schedule again
+        if (use_ring || pending.empty() || slots.empty())
+            return;
+        auto req = std::move(pending.front());
+        pending.pop_front();
+        req->buffer = acquire(*req);
+        lck.unlock();
+        read(*req);
+        decode(*req);
+    }
+
+#if defined(__linux__)
+    /// @brief open the file and push the first read. The failed one goes to the decode workers
+    void prepare(std::unique_ptr<asset_request_t> req) noexcept {
+        req->fd = ::open(req->fpath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (req->fd < 0) {
+            req->ec = errno;
+            return complete(std::move(req));
+        }
+        struct stat info {};
+        if (fstat(req->fd, &info) != 0) {
+            req->ec = errno;
+            return finish(std::move(req));
+        }
+        req->length = gsl::narrow_cast<size_t>(info.st_size);
+        if (req->length > buffer_size) {
+            try {
+                use_heap(*req);
+            } catch (const std::bad_alloc&) {
+                req->ec = ENOMEM;
+                return finish(std::move(req));
+            }
+        }
+        if (req->length == 0)
+            return finish(std::move(req));
+        ring.push_read(*req);
+        reads.emplace_back(std::move(req));
+    }
+
+    void finish(std::unique_ptr<asset_request_t> req) noexcept {
+        close(req->fd);
+        req->fd = -1;
+        complete(std::move(req));
+    }
+
+    /// @return the request is done. If not, the caller must read the rest
+    bool on_read(asset_request_t& req, int32_t res) noexcept {
+        if (res == -EINTR || res == -EAGAIN)
+            return false;
+        if (res < 0) {
+            req.ec = static_cast<uint32_t>(-res);
+            return true;
+        }
+        if (res == 0) { // the file is truncated after fstat
+            req.length = req.offset;
+            return true;
+        }
+        req.offset += static_cast<size_t>(res);
+        return req.offset >= req.length;
+    }
+
+    std::unique_ptr<asset_request_t> take(asset_request_t* ptr) noexcept {
+        auto it = std::find_if(reads.begin(), reads.end(), [ptr](const auto& req) { return req.get() == ptr; });
+        auto req = std::move(*it);
+        reads.erase(it);
+        return req;
+    }
+
+    void reap() noexcept {
+        std::vector<asset_request_t*> done{};
+        ring.for_each_completion([this, &done](asset_request_t& req, int32_t res) {
+            if (on_read(req, res))
+                done.emplace_back(&req);
+            else
+                ring.push_read(req);
+        });
+        for (asset_request_t* ptr : done)
+            finish(take(ptr));
+    }
+
+    /// @brief give the request to the workers. They read it again from the beginning
+    void requeue(std::unique_ptr<asset_request_t> req) noexcept {
+        close(req->fd);
+        req->fd = -1;
+        req->heap = nullptr;
+        req->buffer = nullptr;
+        req->length = req->offset = 0;
+        req->ec = 0;
+        {
+            std::lock_guard lck{mtx};
+            release(*req);
+            pending.emplace_front(std::move(req));
+        }
+        schedule();
+    }
+
+    /**
+     * @brief io_uring_enter failed with a non-transient error. Move all reads to the workers.
+     *        The submitted reads still own their buffers, so wait for their completions first
+     */
+    void fallback(uint32_t ec) noexcept {
+        spdlog::error("io_uring_enter: {}", std::system_category().message(ec));
+        size_t waiting = 0;
+        {
+            std::lock_guard lck{mtx};
+            use_ring = false;
+            waiting = pending.size();
+        }
+        for (auto i = 0u; i < waiting; ++i)
+            schedule();
+        std::vector<asset_request_t*> unsubmitted{};
+        ring.cancel_pending([&unsubmitted](asset_request_t& req) { unsubmitted.emplace_back(&req); });
+        for (asset_request_t* ptr : unsubmitted)
+            requeue(take(ptr));
+        while (reads.empty() == false) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            std::vector<std::pair<asset_request_t*, bool>> results{};
+            ring.for_each_completion([this, &results](asset_request_t& req, int32_t res) {
+                results.emplace_back(&req, on_read(req, res));
+            });
+            for (auto [ptr, done] : results) {
+                if (done)
+                    finish(take(ptr));
+                else
+                    requeue(take(ptr));
+            }
+        }
+    }
+
+    /// @brief submit the pending reads as many as possible, then wait for the completions
+    void loop() noexcept {
+        while (true) {
+            std::unique_lock lck{mtx};
+            auto available = [this]() {
+                return pending.empty() == false && slots.empty() == false && reads.size() < ring.capacity();
+            };
+            if (reads.empty())
+                cv.wait(lck, [this, &available]() { return stop || available(); });
+            if (reads.empty() && available() == false) // stop requested and nothing left
+                return;
+            while (available()) {
+                auto req = std::move(pending.front());
+                pending.pop_front();
+                req->buffer = acquire(*req);
+                lck.unlock();
+                prepare(std::move(req));
+                lck.lock();
+            }
+            lck.unlock();
+            switch (auto ec = ring.enter(reads.empty() ? 0 : 1)) {
+            case 0:
+                break;
+            case EAGAIN: // no resource for the submission
+            case EBUSY:  // the completion queue is full. `reap` makes the room
+                std::this_thread::yield();
+                break;
+            default:
+                return fallback(ec);
+            }
+            reap();
+        }
+    }
+#endif
+};
+
+asset_loader_t::asset_loader_t(uint16_t worker_count, uint16_t buffer_count, size_t buffer_size) noexcept(false) {
+    SPDLOG_DEBUG(__FUNCTION__);
+    if (worker_count == 0 || worker_count > max_capacity || buffer_count == 0)
+        throw std::system_error{EINVAL, std::system_category(), "asset_loader_t"};
+    impl = new impl_t{worker_count, buffer_count, buffer_size};
+#if defined(__linux__)
+    try {
+        if (impl->use_ring)
+            impl->io = std::thread{&impl_t::loop, impl};
+    } catch (const std::system_error&) {
+        impl->shutdown();
+        delete impl;
+        throw;
+    }
+#endif
+}
+
+asset_loader_t::~asset_loader_t() noexcept {
+    SPDLOG_DEBUG(__FUNCTION__);
+    if (impl == nullptr)
+        return;
+    wait();
+    impl->shutdown();
+    delete impl;
+}
+
+bool asset_loader_t::uses_io_uring() const noexcept {
+    return impl->use_ring;
+}
+
+void asset_loader_t::submit(const fs::path& fpath, asset_callback_t callback, void* user_data) noexcept(false) {
+    auto req = std::make_unique<asset_request_t>();
+    req->fpath = fpath;
+    req->callback = callback;
+    req->user_data = user_data;
+    {
+        std::lock_guard lck{impl->mtx};
+        impl->pending.emplace_back(std::move(req));
+        ++impl->count;
+    }
+    impl->cv.notify_all();
+    if (impl->use_ring == false)
+        impl->schedule();
+}
+
+void asset_loader_t::wait() noexcept {
+    std::unique_lock lck{impl->mtx};
+    impl->cv.wait(lck, [this]() { return impl->count == 0; });
+}
@@ -7,6 +7,11 @@ namespace fs = std::filesystem;
 
 using namespace std;
 
+auto read(FILE* stream, size_t& rsz) -> std::unique_ptr<std::byte[]>;
+
+#if defined(_WIN32)
+#include <Windows.h>
+
 auto create(const fs::path& p) -> std::unique_ptr<FILE, int (*)(FILE*)> {
     auto fpath = p.generic_wstring();
     FILE* fp{};
@@ -31,16 +36,215 @@ uint32_t get_size(FILE* stream, size_t& sz) noexcept {
     return 0;
 }
 
-uint32_t fill(FILE* stream, size_t& rsz, std::byte* buf, size_t buflen) noexcept {
+auto read_all(const fs::path& p, size_t& fsize) -> std::unique_ptr<std::byte[], void (*)(void*)> {
+    auto stream = open(p);
+    return {read(stream.get(), fsize).release(), [](void* ptr) { delete[] static_cast<std::byte*>(ptr); }};
+}
+
+mapped_file_t::mapped_file_t(const fs::path& fpath) noexcept(false) {
+    HANDLE file = CreateFileW(fpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw system_error{static_cast<int>(GetLastError()), system_category(), "CreateFileW"};
+    // the view stays after both handles are closed
+    auto on_return = gsl::finally([file]() { CloseHandle(file); });
+    LARGE_INTEGER size{};
+    if (GetFileSizeEx(file, &size) == FALSE)
+        throw system_error{static_cast<int>(GetLastError()), system_category(), "GetFileSizeEx"};
+    length = gsl::narrow_cast<size_t>(size.QuadPart);
+    if (length == 0) // CreateFileMappingW fails with the empty file
+        return;
+    if (HANDLE section = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr)) {
+        mapping = static_cast<const std::byte*>(MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(section);
+        if (mapping)
+            return;
+    }
+    // fallback to the heap buffer
+    fallback = std::make_unique<std::byte[]>(length);
+    DWORD rsz = 0;
+    for (size_t offset = 0; offset < length; offset += rsz) {
+        const auto sz = static_cast<DWORD>(std::min<size_t>(length - offset, MAXDWORD));
+        if (ReadFile(file, fallback.get() + offset, sz, &rsz, nullptr) == FALSE || rsz == 0)
+            throw system_error{static_cast<int>(GetLastError()), system_category(), "ReadFile"};
+    }
+    mapping = fallback.get();
+}
+
+mapped_file_t::~mapped_file_t() noexcept {
+    if (mapping && fallback == nullptr)
+        UnmapViewOfFile(mapping);
+}
+
+#else
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// @brief `read_all` bypasses the page cache for the files larger than this
+constexpr size_t direct_io_threshold = 64 << 20;
+/// @brief O_DIRECT requires the buffer, offset and length to be aligned to the logical block size
+constexpr size_t direct_io_alignment = 4096;
+constexpr size_t direct_io_chunk = 4 << 20;
+
+auto create(const fs::path& p) -> std::unique_ptr<FILE, int (*)(FILE*)> {
+    const int fd = ::open(p.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw system_error{errno, system_category(), "open"};
+    FILE* fp = fdopen(fd, "w+b");
+    if (fp == nullptr) {
+        const auto ec = errno;
+        ::close(fd);
+        throw system_error{ec, system_category(), "fdopen"};
+    }
+    return {fp, &fclose};
+}
+
+auto open(const fs::path& p) -> std::unique_ptr<FILE, int (*)(FILE*)> {
+    const int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error{errno, system_category(), "open"};
+    // the callers read the whole file from the beginning. hint only, so ignore the error
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    FILE* fp = fdopen(fd, "rb");
+    if (fp == nullptr) {
+        const auto ec = errno;
+        ::close(fd);
+        throw system_error{ec, system_category(), "fdopen"};
+    }
+    return {fp, &fclose};
+}
+
+uint32_t get_size(FILE* stream, size_t& sz) noexcept {
+    struct stat info {};
+    if (fstat(fileno(stream), &info) != 0)
+        return errno;
+    sz = gsl::narrow_cast<size_t>(info.st_size);
+    return 0;
+}
+
+/// @brief `pread` until the `buflen` or the end of the file
+uint32_t fill(int fd, size_t& rsz, std::byte* buf, size_t buflen) noexcept {
     rsz = 0;
-    while (!feof(stream)) {
-        void* b = buf + rsz;
-        const auto sz = buflen - rsz;
-        rsz += fread_s(b, sz, sizeof(std::byte), sz, stream);
-        if (auto ec = ferror(stream))
-            return ec; // throw system_error{ec, system_category(), "fread_s"};
-        if (rsz == buflen)
+    while (rsz < buflen) {
+        const auto sz = pread(fd, buf + rsz, buflen - rsz, gsl::narrow_cast<off_t>(rsz));
+        if (sz < 0 && errno == EINTR)
+            continue;
+        if (sz < 0)
+            return errno;
+        if (sz == 0)
             break;
+        rsz += static_cast<size_t>(sz);
     }
     return 0;
 }
+
+/**
+ * @brief `fill` with the `fd` opened with O_DIRECT. The chunks are read directly into the `buf`
+ * @param buf       aligned to `direct_io_alignment`
+ * @param capacity  multiple of `direct_io_alignment`. The last read may cover the whole block past the end of file
+ */
+uint32_t fill_direct(int fd, size_t& rsz, std::byte* buf, size_t capacity) noexcept {
+    rsz = 0;
+    while (rsz < capacity) {
+        // the offset is always a multiple of the chunk size, so only the last read can be short
+        const auto len = std::min(direct_io_chunk, capacity - rsz);
+        const auto sz = pread(fd, buf + rsz, len, gsl::narrow_cast<off_t>(rsz));
+        if (sz < 0 && errno == EINTR)
+            continue;
+        if (sz < 0)
+            return errno;
+        rsz += static_cast<size_t>(sz);
+        if (static_cast<size_t>(sz) < len)
+            break;
+    }
+    return 0;
+}
+
+auto read_all(const fs::path& p, size_t& fsize) -> std::unique_ptr<std::byte[], void (*)(void*)> {
+    const int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error{errno, system_category(), "open"};
+    auto on_return = gsl::finally([fd]() { ::close(fd); });
+    struct stat info {};
+    if (fstat(fd, &info) != 0)
+        throw system_error{errno, system_category(), "fstat"};
+    const auto sz = gsl::narrow_cast<size_t>(info.st_size);
+    // the content is overwritten right after. no need to zero the memory
+    const auto blocks = (std::max<size_t>(sz, 1) + direct_io_alignment - 1) / direct_io_alignment;
+    const auto capacity = blocks * direct_io_alignment;
+    auto blob = std::unique_ptr<std::byte[], void (*)(void*)>{
+        static_cast<std::byte*>(aligned_alloc(direct_io_alignment, capacity)), &free};
+    if (blob == nullptr)
+        throw std::bad_alloc{};
+#if defined(O_DIRECT)
+    // the filesystem may not support O_DIRECT (tmpfs, for example). then use the page cache
+    if (sz >= direct_io_threshold && fcntl(fd, F_SETFL, O_DIRECT) == 0) {
+        if (auto ec = fill_direct(fd, fsize, blob.get(), capacity); ec == 0) {
+            fsize = std::min(fsize, sz); // the file may have grown after the fstat
+            return blob;
+        }
+        fcntl(fd, F_SETFL, 0);
+    }
+#endif
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (auto ec = fill(fd, fsize, blob.get(), sz))
+        throw system_error{static_cast<int>(ec), system_category(), "pread"};
+    return blob;
+}
+
+mapped_file_t::mapped_file_t(const fs::path& fpath) noexcept(false) {
+    const int fd = ::open(fpath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error{errno, system_category(), "open"};
+    // the mapping stays after close
+    auto on_return = gsl::finally([fd]() { ::close(fd); });
+    struct stat info {};
+    if (fstat(fd, &info) != 0)
+        throw system_error{errno, system_category(), "fstat"};
+    length = gsl::narrow_cast<size_t>(info.st_size);
+    if (length == 0)
+        return;
+    if (void* ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0); ptr != MAP_FAILED) {
+        // most of the consumers read sequentially
+        posix_madvise(ptr, length, POSIX_MADV_SEQUENTIAL);
+        mapping = static_cast<const std::byte*>(ptr);
+        return;
+    }
+    // fallback to the heap buffer
+    fallback = std::make_unique<std::byte[]>(length);
+    size_t rsz = 0;
+    if (auto ec = fill(fd, rsz, fallback.get(), length))
+        throw system_error{static_cast<int>(ec), system_category(), "pread"};
+    length = rsz;
+    mapping = fallback.get();
+}
+
+mapped_file_t::~mapped_file_t() noexcept {
+    if (mapping && fallback == nullptr)
+        munmap(const_cast<std::byte*>(mapping), length);
+}
+
+#endif
+
+auto read(FILE* stream, size_t& rsz) -> std::unique_ptr<std::byte[]> {
+    size_t sz = 0;
+    if (auto ec = get_size(stream, sz))
+        throw system_error{static_cast<int>(ec), system_category(), "get_size"};
+    auto blob = std::make_unique<std::byte[]>(sz);
+    rsz = fread(blob.get(), sizeof(std::byte), sz, stream);
+    if (ferror(stream))
+        throw system_error{errno, system_category(), "fread"};
+    return blob;
+}
+
+bool mapped_file_t::is_mapped() const noexcept {
+    return mapping != nullptr && fallback == nullptr;
+}
+
+gsl::span<const std::byte> mapped_file_t::get() const noexcept {
+    return {mapping, length};
+}
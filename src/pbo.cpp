@@ -1,19 +1,59 @@
 #include <graphics.h>
 #include <spdlog/spdlog.h>
 
-pbo_reader_t::pbo_reader_t(GLuint length) noexcept : pbos{}, length{length}, offset{}, ec{GL_NO_ERROR} {
-    spdlog::trace(__FUNCTION__);
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// clang-format off
+#if !defined(GL_EXT_buffer_storage)
+#define GL_MAP_PERSISTENT_BIT_EXT         0x0040
+#define GL_MAP_COHERENT_BIT_EXT           0x0080
+typedef void (GL_APIENTRYP PFNGLBUFFERSTORAGEEXTPROC) (GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+#endif
+// clang-format on
+
+struct pbo_reader_t::async_context_t final {
+    enum state_t : uint8_t {
+        free = 0, // available for `read_async`
+        packed,   // waiting for the fence
+        mapped,   // a worker is using the mapping
+        consumed, // the worker returned. must be unmapped in the rendering thread
+    };
+    std::atomic<uint8_t> states[max_capacity]{};
+    std::promise<GLenum> promises[max_capacity]{};
+    reader_callback_t callbacks[max_capacity]{};
+    void* user_data[max_capacity]{};
+    uint16_t next = 0; // round-robin for the free slot
+    worker_pool_t workers; // consume the pixels out of the rendering thread
+
+  public:
+    explicit async_context_t(uint32_t count) noexcept(false) : workers{count} {
+    }
+};
+
+pbo_reader_t::pbo_reader_t(GLuint length, uint16_t count) noexcept
+    : pbos{}, fences{}, capacity{count}, length{length}, offset{}, ec{GL_NO_ERROR} {
+    SPDLOG_TRACE(__FUNCTION__);
+    if (capacity == 0 || capacity > max_capacity) {
+        capacity = 0; // nothing to delete
+        ec = GL_INVALID_VALUE;
+        return;
+    }
     glGenBuffers(capacity, pbos);
     if (ec = glGetError())
         return;
     for (auto i = 0u; i < capacity; ++i) {
-        spdlog::debug("- pbo:");
-        spdlog::debug("  id: {}", pbos[i]);
-        spdlog::debug("  length: {}", length);
-        spdlog::debug("  usage: GL_STREAM_READ");
+        SPDLOG_DEBUG("- pbo:");
+        SPDLOG_DEBUG("  id: {}", pbos[i]);
+        SPDLOG_DEBUG("  length: {}", length);
+        SPDLOG_DEBUG("  usage: GL_STREAM_READ");
         glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
         glBufferData(GL_PIXEL_PACK_BUFFER, length, nullptr, GL_STREAM_READ);
     }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
     ec = glGetError();
 }
 
@@ -21,10 +61,24 @@ GLenum pbo_reader_t::is_valid() const noexcept {
     return ec;
 }
 
+uint16_t pbo_reader_t::size() const noexcept {
+    return capacity;
+}
+
 pbo_reader_t::~pbo_reader_t() noexcept {
-    spdlog::trace(__FUNCTION__);
-    for (auto i = 0u; i < capacity; ++i)
-        spdlog::debug("- pbo: {}", pbos[i]);
+    SPDLOG_TRACE(__FUNCTION__);
+    if (async) {
+        drain();
+        delete async;
+    }
+    if (capacity == 0)
+        return;
+    for (auto i = 0u; i < capacity; ++i) {
+        SPDLOG_DEBUG("- pbo: {}", pbos[i]);
+        if (fences[i])
+            glDeleteSync(fences[i]);
+    }
+    SPDLOG_DEBUG("- map: {} ready, {} busy", hit, stall);
     // delete and report if error generated
     glDeleteBuffers(capacity, pbos);
     if (auto ec = glGetError())
@@ -32,49 +86,234 @@ pbo_reader_t::~pbo_reader_t() noexcept {
 }
 
 GLenum pbo_reader_t::pack(uint16_t idx, GLuint fbo, const GLint frame[4], GLenum format, GLenum type) noexcept {
-    spdlog::trace(__FUNCTION__);
+    SPDLOG_TRACE(__FUNCTION__);
     if (idx >= capacity)
         return GL_INVALID_VALUE;
     //if (length < (frame[2] - frame[0]) * (frame[3] - frame[1]) * 4)
     //    return GL_OUT_OF_MEMORY;
-    spdlog::debug("- pack:");
-    spdlog::debug("  pbo: {}", pbos[idx]);
-    spdlog::debug("  format: {:#x}", format);
-    spdlog::debug("  type: {:#x}", type);
-    spdlog::debug("  frame: '{} {} {} {}'", frame[0], frame[1], frame[2], frame[3]);
+    SPDLOG_DEBUG("- pack:");
+    SPDLOG_DEBUG("  pbo: {}", pbos[idx]);
+    SPDLOG_DEBUG("  format: {:#x}", format);
+    SPDLOG_DEBUG("  type: {:#x}", type);
+    SPDLOG_DEBUG("  frame: '{} {} {} {}'", frame[0], frame[1], frame[2], frame[3]);
     glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[idx]);
     glReadPixels(frame[0], frame[1], frame[2], frame[3], format, type, reinterpret_cast<void*>(offset));
     if (auto ec = glGetError())
         return ec; // probably GL_OUT_OF_MEMORY?
     glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    // the previous fence is meaningless since the buffer will be overwritten
+    if (fences[idx])
+        glDeleteSync(fences[idx]);
+    fences[idx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
     return glGetError();
 }
 
+GLenum pbo_reader_t::try_wait(uint16_t idx) noexcept {
+    if (fences[idx] == nullptr)
+        return GL_NO_ERROR;
+    // poll with zero timeout. flush so the fence can be signaled eventually
+    switch (glClientWaitSync(fences[idx], GL_SYNC_FLUSH_COMMANDS_BIT, 0)) {
+    case GL_ALREADY_SIGNALED:
+    case GL_CONDITION_SATISFIED:
+        glDeleteSync(fences[idx]);
+        fences[idx] = nullptr;
+        return GL_NO_ERROR;
+    case GL_TIMEOUT_EXPIRED:
+        ++stall;
+        return GL_TIMEOUT_EXPIRED;
+    case GL_WAIT_FAILED:
+    default:
+        return glGetError();
+    }
+}
+
 GLenum pbo_reader_t::map_and_invoke(uint16_t idx, reader_callback_t callback, void* user_data) noexcept {
-    spdlog::trace(__FUNCTION__);
+    SPDLOG_TRACE(__FUNCTION__);
     if (idx >= capacity)
         return GL_INVALID_VALUE;
+    const bool packed = fences[idx] != nullptr; // not a hit if there was nothing to wait
+    if (auto ec = try_wait(idx))
+        return ec;
     glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[idx]);
     if (const void* ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, offset, length, GL_MAP_READ_BIT)) {
-        spdlog::debug("- mapping:");
-        spdlog::debug("  pbo: {}", pbos[idx]);
-        spdlog::debug("  offset: {}", offset);
+        SPDLOG_DEBUG("- mapping:");
+        SPDLOG_DEBUG("  pbo: {}", pbos[idx]);
+        SPDLOG_DEBUG("  offset: {}", offset);
+        if (packed)
+            ++hit;
         callback(user_data, ptr, length);
         glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
     }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
     return glGetError();
 }
 
+uint32_t get_pixel_size(GLenum format, GLenum type) noexcept {
+    uint32_t channel = 0;
+    switch (format) {
+    case GL_RED:
+    case GL_RED_INTEGER:
+    case GL_ALPHA:
+    case GL_LUMINANCE:
+        channel = 1;
+        break;
+    case GL_RG:
+    case GL_RG_INTEGER:
+    case GL_LUMINANCE_ALPHA:
+        channel = 2;
+        break;
+    case GL_RGB:
+    case GL_RGB_INTEGER:
+        channel = 3;
+        break;
+    case GL_RGBA:
+    case GL_RGBA_INTEGER:
+        channel = 4;
+        break;
+    default:
+        return 0;
+    }
+    switch (type) {
+    case GL_UNSIGNED_BYTE:
+    case GL_BYTE:
+        return channel;
+    case GL_UNSIGNED_SHORT:
+    case GL_SHORT:
+    case GL_HALF_FLOAT:
+        return channel * 2;
+    case GL_UNSIGNED_INT:
+    case GL_INT:
+    case GL_FLOAT:
+        return channel * 4;
+    case GL_UNSIGNED_SHORT_5_6_5:
+    case GL_UNSIGNED_SHORT_4_4_4_4:
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+        return 2; // packed
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+    case GL_UNSIGNED_INT_10F_11F_11F_REV:
+    case GL_UNSIGNED_INT_5_9_9_9_REV:
+        return 4; // packed
+    default:
+        return 0;
+    }
+}
+
+GLenum pbo_reader_t::pack_tiles(uint16_t idx, GLuint fbo, GLint width, gsl::span<const GLint> tiles, //
+                                GLenum format, GLenum type) noexcept {
+    SPDLOG_TRACE(__FUNCTION__);
+    if (idx >= capacity || width <= 0 || tiles.size() % 4)
+        return GL_INVALID_VALUE;
+    const auto pixel_size = get_pixel_size(format, type);
+    if (pixel_size == 0)
+        return GL_INVALID_VALUE;
+    const auto stride = static_cast<uint32_t>(width) * pixel_size;
+    const auto count = static_cast<size_t>(tiles.size());
+    for (size_t i = 0; i < count; i += 4) {
+        const GLint* tile = tiles.data() + i;
+        if (tile[0] < 0 || tile[1] < 0 || tile[2] < 0 || tile[3] < 0 || int64_t{tile[0]} + tile[2] > width)
+            return GL_INVALID_VALUE;
+        const auto end = static_cast<uint64_t>(int64_t{tile[1]} + tile[3]) * stride;
+        if (end > length)
+            return GL_OUT_OF_MEMORY;
+    }
+    SPDLOG_DEBUG("- pack:");
+    SPDLOG_DEBUG("  pbo: {}", pbos[idx]);
+    SPDLOG_DEBUG("  tiles: {}", tiles.size() / 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[idx]);
+    // rows are `width` pixels apart in the pbo. the tiles are placed where they are in the framebuffer
+    GLint alignment = 4;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ROW_LENGTH, width);
+    GLenum ec = GL_NO_ERROR;
+    for (size_t i = 0; i < count; i += 4) {
+        const GLint* tile = tiles.data() + i;
+        glPixelStorei(GL_PACK_SKIP_PIXELS, tile[0]);
+        glPixelStorei(GL_PACK_SKIP_ROWS, tile[1]);
+        glReadPixels(tile[0], tile[1], tile[2], tile[3], format, type, reinterpret_cast<void*>(offset));
+        if (ec = glGetError())
+            break;
+    }
+    // restore the defaults and the caller's alignment
+    glPixelStorei(GL_PACK_SKIP_ROWS, 0);
+    glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (ec)
+        return ec;
+    strides[idx] = stride;
+    pixel_sizes[idx] = static_cast<uint16_t>(pixel_size);
+    if (fences[idx])
+        glDeleteSync(fences[idx]);
+    fences[idx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return glGetError();
+}
+
+GLenum pbo_reader_t::map_tiles_and_invoke(uint16_t idx, gsl::span<const GLint> tiles, //
+                                          tile_callback_t callback, void* user_data) noexcept {
+    SPDLOG_TRACE(__FUNCTION__);
+    if (idx >= capacity || tiles.size() % 4 || strides[idx] == 0)
+        return GL_INVALID_VALUE;
+    const uint64_t stride = strides[idx];
+    const uint64_t pixel_size = pixel_sizes[idx];
+    const auto width = stride / pixel_size;
+    const auto count = static_cast<size_t>(tiles.size());
+    // same validation with `pack_tiles`. the ranges must stay in the packed area
+    for (size_t i = 0; i < count; i += 4) {
+        const GLint* tile = tiles.data() + i;
+        if (tile[0] < 0 || tile[1] < 0 || tile[2] < 0 || tile[3] < 0)
+            return GL_INVALID_VALUE;
+        if (uint64_t{static_cast<uint32_t>(tile[0])} + static_cast<uint32_t>(tile[2]) > width)
+            return GL_INVALID_VALUE;
+        if ((uint64_t{static_cast<uint32_t>(tile[1])} + static_cast<uint32_t>(tile[3])) * stride > length)
+            return GL_INVALID_VALUE;
+    }
+    const bool packed = fences[idx] != nullptr;
+    if (auto ec = try_wait(idx))
+        return ec;
+    GLenum ec = GL_NO_ERROR;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[idx]);
+    for (size_t i = 0; i < count; i += 4) {
+        const GLint* tile = tiles.data() + i;
+        if (tile[2] == 0 || tile[3] == 0)
+            continue;
+        // from the first pixel of the first row to the last pixel of the last row
+        const auto x = static_cast<uint64_t>(tile[0]), y = static_cast<uint64_t>(tile[1]);
+        const auto begin = y * stride + x * pixel_size;
+        const auto range = (static_cast<uint64_t>(tile[3]) - 1) * stride + static_cast<uint64_t>(tile[2]) * pixel_size;
+        const void* ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, offset + static_cast<GLintptr>(begin),
+                                           static_cast<GLsizeiptr>(range), GL_MAP_READ_BIT);
+        if (ptr == nullptr) {
+            ec = glGetError();
+            break;
+        }
+        callback(user_data, tile, ptr, static_cast<size_t>(stride));
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (ec)
+        return ec;
+    if (packed)
+        ++hit;
+    return glGetError();
+}
+
+void pbo_reader_t::get_statistics(uint32_t& ready, uint32_t& busy) const noexcept {
+    ready = hit;
+    busy = stall;
+}
+
 pbo_writer_t::pbo_writer_t(GLuint length) noexcept : pbos{}, length{length}, ec{GL_NO_ERROR} {
-    spdlog::trace(__FUNCTION__);
+    SPDLOG_TRACE(__FUNCTION__);
     glGenBuffers(capacity, pbos);
     if (ec = glGetError())
         return;
     for (auto i = 0u; i < capacity; ++i) {
-        spdlog::debug("- pbo:");
-        spdlog::debug("  id: {}", pbos[i]);
-        spdlog::debug("  length: {}", length);
-        spdlog::debug("  usage: GL_STREAM_DRAW");
+        SPDLOG_DEBUG("- pbo:");
+        SPDLOG_DEBUG("  id: {}", pbos[i]);
+        SPDLOG_DEBUG("  length: {}", length);
+        SPDLOG_DEBUG("  usage: GL_STREAM_DRAW");
         glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
         glBufferData(GL_PIXEL_UNPACK_BUFFER, length, nullptr, GL_STREAM_DRAW);
     }
@@ -86,23 +325,24 @@ GLenum pbo_writer_t::is_valid() const noexcept {
 }
 
 pbo_writer_t::~pbo_writer_t() noexcept {
-    spdlog::trace(__FUNCTION__);
+    SPDLOG_TRACE(__FUNCTION__);
     for (auto i = 0u; i < capacity; ++i)
-        spdlog::debug("- pbo: {}", pbos[i]);
+        SPDLOG_DEBUG("- pbo: {}", pbos[i]);
     // delete and report if error generated
     glDeleteBuffers(capacity, pbos);
     if (auto ec = glGetError())
         spdlog::error("{} {}", __FUNCTION__, get_opengl_category().message(ec));
 }
 
-/// @todo GL_MAP_UNSYNCHRONIZED_BIT?
+/// @see pbo_stream_writer_t for GL_MAP_UNSYNCHRONIZED_BIT
 GLenum pbo_writer_t::map_and_invoke(uint16_t idx, writer_callback_t callback, void* user_data) noexcept {
-    spdlog::trace(__FUNCTION__);
+    SPDLOG_TRACE(__FUNCTION__);
     if (idx >= capacity)
         return GL_INVALID_VALUE;
-    // 1 is for write (upload)
+    // 1 is for write (upload). without GL_MAP_READ_BIT, the driver doesn't have to wait for the previous contents
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[idx]);
-    if (void* mapping = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, length, GL_MAP_READ_BIT | GL_MAP_WRITE_BIT))
+    if (void* mapping = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, length, //
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT))
         callback(user_data, mapping, length);
     if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == false)
         spdlog::warn("unmap buffer failed: {}", pbos[idx]);
@@ -112,7 +352,7 @@ GLenum pbo_writer_t::map_and_invoke(uint16_t idx, writer_callback_t callback, vo
 
 GLenum pbo_writer_t::unpack(uint16_t idx, GLuint tex2d, const GLint frame[4], //
                             GLenum format, GLenum type) noexcept {
-    spdlog::trace(__FUNCTION__);
+    SPDLOG_TRACE(__FUNCTION__);
     if (idx >= capacity)
         return GL_INVALID_VALUE;
     GLenum ec = GL_NO_ERROR;
@@ -126,3 +366,221 @@ GLenum pbo_writer_t::unpack(uint16_t idx, GLuint tex2d, const GLint frame[4], //
     glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
     return ec ? ec : glGetError();
 }
+auto pbo_reader_t::read_async(GLuint fbo, const GLint frame[4], reader_callback_t callback, void* user_data, //
+                              GLenum format, GLenum type) noexcept(false) -> std::future<GLenum> {
+    SPDLOG_TRACE(__FUNCTION__);
+    std::promise<GLenum> failure{};
+    if (ec != GL_NO_ERROR) {
+        failure.set_value(ec);
+        return failure.get_future();
+    }
+    if (async == nullptr) {
+        const auto concurrency = std::max(std::thread::hardware_concurrency(), 1u);
+        async = new async_context_t{std::min<uint32_t>(capacity, concurrency)};
+    }
+    // search from the next of the latest request to keep the order
+    for (auto i = 0u; i < capacity; ++i) {
+        const auto idx = static_cast<uint16_t>((async->next + i) % capacity);
+        if (async->states[idx].load(std::memory_order_acquire) != async_context_t::free)
+            continue;
+        if (auto ec = pack(idx, fbo, frame, format, type)) {
+            failure.set_value(ec);
+            return failure.get_future();
+        }
+        async->next = static_cast<uint16_t>((idx + 1) % capacity);
+        async->callbacks[idx] = callback;
+        async->user_data[idx] = user_data;
+        async->promises[idx] = std::promise<GLenum>{};
+        async->states[idx].store(async_context_t::packed, std::memory_order_release);
+        return async->promises[idx].get_future();
+    }
+    failure.set_value(GL_OUT_OF_MEMORY); // all slots are in flight
+    return failure.get_future();
+}
+
+uint16_t pbo_reader_t::poll() noexcept {
+    if (async == nullptr)
+        return 0;
+    uint16_t count = 0;
+    for (auto idx = 0u; idx < capacity; ++idx) {
+        auto& state = async->states[idx];
+        if (state.load(std::memory_order_acquire) == async_context_t::consumed) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[idx]);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            state.store(async_context_t::free, std::memory_order_release);
+        }
+        if (state.load(std::memory_order_acquire) == async_context_t::packed) {
+            if (auto ec = try_wait(static_cast<uint16_t>(idx)); ec == GL_TIMEOUT_EXPIRED) {
+                ++count;
+                continue;
+            } else if (ec) {
+                async->promises[idx].set_value(ec);
+                state.store(async_context_t::free, std::memory_order_release);
+                continue;
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[idx]);
+            const void* ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, offset, length, GL_MAP_READ_BIT);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            if (ptr == nullptr) {
+                async->promises[idx].set_value(glGetError());
+                state.store(async_context_t::free, std::memory_order_release);
+                continue;
+            }
+            ++hit;
+            state.store(async_context_t::mapped, std::memory_order_release);
+            auto task = [context = async, idx, ptr, length = length]() {
+                auto& promise = context->promises[idx];
+                try {
+                    context->callbacks[idx](context->user_data[idx], ptr, length);
+                    promise.set_value(GL_NO_ERROR);
+                } catch (...) {
+                    promise.set_exception(std::current_exception());
+                }
+                // the promise must be settled before the slot can be recycled
+                context->states[idx].store(async_context_t::consumed, std::memory_order_release);
+            };
+            try {
+                async->workers.submit(task);
+            } catch (const std::exception& ex) {
+                spdlog::warn("{} {}", __FUNCTION__, ex.what());
+                task(); // consume in this thread
+            }
+        }
+        if (state.load(std::memory_order_acquire) != async_context_t::free)
+            ++count;
+    }
+    return count;
+}
+
+void pbo_reader_t::drain() noexcept {
+    SPDLOG_TRACE(__FUNCTION__);
+    while (poll())
+        std::this_thread::yield();
+}
+
+pbo_stream_writer_t::pbo_stream_writer_t(GLuint length, uint16_t count) noexcept
+    : capacity{count}, length{length}, stride{}, ec{GL_NO_ERROR} {
+    SPDLOG_TRACE(__FUNCTION__);
+    if (capacity == 0 || capacity > max_capacity) {
+        ec = GL_INVALID_VALUE;
+        return;
+    }
+    // keep each segment aligned for any `type` of `glTexSubImage2D`
+    constexpr uint32_t alignment = 256;
+    stride = (length + alignment - 1) / alignment * alignment;
+    const GLsizeiptr total = static_cast<GLsizeiptr>(stride) * capacity;
+    glGenBuffers(1, &pbo);
+    if (ec = glGetError())
+        return;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    auto storage = has_extension(gl_extension_t::EXT_buffer_storage)
+                       ? reinterpret_cast<PFNGLBUFFERSTORAGEEXTPROC>(eglGetProcAddress("glBufferStorageEXT"))
+                       : nullptr;
+    constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT;
+    if (storage) {
+        storage(GL_PIXEL_UNPACK_BUFFER, total, nullptr, flags);
+        // the storage is immutable after this. `upload` maps each segment if the persistent mapping fails
+        if (const GLenum err = glGetError(); err == GL_NO_ERROR) {
+            persistent = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, flags);
+            if (const GLenum map_err = glGetError(); persistent == nullptr)
+                spdlog::warn("{} persistent mapping failed: {}", __FUNCTION__, map_err);
+        } else {
+            spdlog::warn("{} buffer storage failed: {}", __FUNCTION__, err);
+            storage = nullptr;
+        }
+    }
+    if (storage == nullptr)
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    SPDLOG_DEBUG("- pbo:");
+    SPDLOG_DEBUG("  id: {}", pbo);
+    SPDLOG_DEBUG("  length: {}", total);
+    SPDLOG_DEBUG("  segments: {}", capacity);
+    SPDLOG_DEBUG("  persistent: {}", persistent != nullptr);
+    ec = glGetError();
+}
+
+pbo_stream_writer_t::~pbo_stream_writer_t() noexcept {
+    SPDLOG_TRACE(__FUNCTION__);
+    if (pbo == 0)
+        return;
+    for (auto fence : fences)
+        if (fence)
+            glDeleteSync(fence);
+    SPDLOG_DEBUG("- upload: {} ready, {} busy", hit, stall);
+    if (persistent) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &pbo);
+    if (auto ec = glGetError())
+        spdlog::error("{} {}", __FUNCTION__, get_opengl_category().message(ec));
+}
+
+GLenum pbo_stream_writer_t::is_valid() const noexcept {
+    return ec;
+}
+
+bool pbo_stream_writer_t::is_persistent() const noexcept {
+    return persistent != nullptr;
+}
+
+GLenum pbo_stream_writer_t::upload(GLuint tex2d, const GLint frame[4], writer_callback_t callback, void* user_data,
+                                   GLenum format, GLenum type) noexcept {
+    SPDLOG_TRACE(__FUNCTION__);
+    if (ec != GL_NO_ERROR)
+        return ec;
+    const auto idx = head;
+    if (fences[idx]) {
+        switch (glClientWaitSync(fences[idx], GL_SYNC_FLUSH_COMMANDS_BIT, 0)) {
+        case GL_ALREADY_SIGNALED:
+        case GL_CONDITION_SATISFIED:
+            glDeleteSync(fences[idx]);
+            fences[idx] = nullptr;
+            break;
+        case GL_TIMEOUT_EXPIRED:
+            ++stall;
+            return GL_TIMEOUT_EXPIRED;
+        case GL_WAIT_FAILED:
+        default:
+            return glGetError();
+        }
+    }
+    const GLintptr offset = static_cast<GLintptr>(stride) * idx;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    if (persistent) {
+        // coherent mapping. the fence above guarantees the GPU is not reading this segment
+        callback(user_data, reinterpret_cast<std::byte*>(persistent) + offset, length);
+    } else {
+        // the fence above makes GL_MAP_UNSYNCHRONIZED_BIT safe
+        constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+        void* mapping = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, length, flags);
+        if (mapping == nullptr) {
+            // the segment is not used. the next `upload` will try it again
+            const auto error = glGetError();
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return error ? error : GL_INVALID_OPERATION;
+        }
+        callback(user_data, mapping, length);
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == false)
+            spdlog::warn("unmap buffer failed: {}", pbo);
+    }
+    ++hit;
+    GLenum ec = GL_NO_ERROR;
+    glBindTexture(GL_TEXTURE_2D, tex2d);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, frame[0], frame[1], frame[2], frame[3], format, type,
+                    reinterpret_cast<void*>(offset));
+    if (ec = glGetError())
+        spdlog::warn("tex sub image failed: {}", pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    fences[idx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    head = static_cast<uint16_t>((head + 1) % capacity);
+    return ec ? ec : glGetError();
+}
+
+void pbo_stream_writer_t::get_statistics(uint32_t& ready, uint32_t& busy) const noexcept {
+    ready = hit;
+    busy = stall;
+}
@@ -0,0 +1,318 @@
+/**
+ * @brief  SIMD kernels for the mapped PBO spans. The kernel set is selected with the CPU features
+ */
+#include <graphics.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+// clang-format off
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#  define PIXEL_USE_X86
+#  include <immintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64) || defined(_M_ARM)
+#  define PIXEL_USE_NEON
+#  include <arm_neon.h>
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#  define PIXEL_TARGET(name) __attribute__((target(name)))
+#else
+#  define PIXEL_TARGET(name)
+#endif
+// clang-format on
+
+using kernel_t = void (*)(const uint8_t* src, uint8_t* dst, size_t count) noexcept;
+
+struct pixel_kernels_t final {
+    std::string_view name;
+    kernel_t swizzle;
+    kernel_t rgb;
+    kernel_t premultiply;
+};
+
+/// @note same rounding with the SIMD kernels. (t + 128 + ((t + 128) >> 8)) >> 8 == round(t / 255)
+constexpr uint8_t multiply_alpha(uint32_t c, uint32_t a) noexcept {
+    const auto t = c * a + 128;
+    return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+}
+
+void swizzle_scalar(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    for (size_t i = 0; i < count; ++i, src += 4, dst += 4) {
+        const uint8_t r = src[0], g = src[1], b = src[2], a = src[3];
+        dst[0] = b, dst[1] = g, dst[2] = r, dst[3] = a;
+    }
+}
+void rgb_scalar(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    for (size_t i = 0; i < count; ++i, src += 4, dst += 3) {
+        const uint8_t r = src[0], g = src[1], b = src[2];
+        dst[0] = r, dst[1] = g, dst[2] = b;
+    }
+}
+void premultiply_scalar(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    for (size_t i = 0; i < count; ++i, src += 4, dst += 4) {
+        const uint8_t a = src[3];
+        dst[0] = multiply_alpha(src[0], a);
+        dst[1] = multiply_alpha(src[1], a);
+        dst[2] = multiply_alpha(src[2], a);
+        dst[3] = a;
+    }
+}
+
+#if defined(PIXEL_USE_X86)
+
+PIXEL_TARGET("sse2")
+void swizzle_sse2(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    const __m128i mask_ga = _mm_set1_epi32(static_cast<int>(0xFF00FF00));
+    const __m128i mask_rb = _mm_set1_epi32(0x00FF00FF);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        const __m128i rb = _mm_and_si128(v, mask_rb);
+        const __m128i br = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_and_si128(v, mask_ga), br));
+    }
+    swizzle_scalar(src + i * 4, dst + i * 4, count - i);
+}
+
+/// @param c 2 pixels in 16 bit lanes
+PIXEL_TARGET("sse2")
+__m128i multiply_alpha_sse2(__m128i c, __m128i alpha_lane) noexcept {
+    // broadcast alpha to 4 lanes, then force 255 for the alpha lane itself
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, 0xFF), 0xFF);
+    a = _mm_or_si128(a, alpha_lane);
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+PIXEL_TARGET("sse2")
+void premultiply_sse2(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_lane = _mm_setr_epi16(0, 0, 0, 0xFF, 0, 0, 0, 0xFF);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        const __m128i lo = multiply_alpha_sse2(_mm_unpacklo_epi8(v, zero), alpha_lane);
+        const __m128i hi = multiply_alpha_sse2(_mm_unpackhi_epi8(v, zero), alpha_lane);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+    premultiply_scalar(src + i * 4, dst + i * 4, count - i);
+}
+
+PIXEL_TARGET("avx2")
+void swizzle_avx2(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, //
+                                             2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_shuffle_epi8(v, shuffle));
+    }
+    swizzle_scalar(src + i * 4, dst + i * 4, count - i);
+}
+
+/// @note the stores never pass the next load. So `src == dst` is safe
+PIXEL_TARGET("ssse3")
+void rgb_ssse3(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+        const __m128i packed = _mm_shuffle_epi8(v, shuffle);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i * 3), packed);
+        const int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+        std::memcpy(dst + i * 3 + 8, &tail, sizeof(tail));
+    }
+    rgb_scalar(src + i * 4, dst + i * 3, count - i);
+}
+
+/// @param c 4 pixels in 16 bit lanes
+PIXEL_TARGET("avx2")
+__m256i multiply_alpha_avx2(__m256i c, __m256i alpha_lane) noexcept {
+    __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c, 0xFF), 0xFF);
+    a = _mm256_or_si256(a, alpha_lane);
+    const __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(c, a), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+PIXEL_TARGET("avx2")
+void premultiply_avx2(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_lane = _mm256_setr_epi16(0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF, 0, 0, 0, 0xFF);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+        // unpack/pack work in 128 bit lanes. the order is preserved
+        const __m256i lo = multiply_alpha_avx2(_mm256_unpacklo_epi8(v, zero), alpha_lane);
+        const __m256i hi = multiply_alpha_avx2(_mm256_unpackhi_epi8(v, zero), alpha_lane);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_packus_epi16(lo, hi));
+    }
+    premultiply_sse2(src + i * 4, dst + i * 4, count - i);
+}
+
+bool has_avx2() noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4]{};
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    constexpr int osxsave = 1 << 27, avx = 1 << 28;
+    if ((info[2] & osxsave) == 0 || (info[2] & avx) == 0)
+        return false;
+    // the OS must save the YMM registers
+    if ((_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool has_ssse3() noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4]{};
+    __cpuid(info, 1);
+    return info[2] & (1 << 9);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+#elif defined(PIXEL_USE_NEON)
+
+void swizzle_neon(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t v = vld4q_u8(src + i * 4);
+        const uint8x16_t r = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = r;
+        vst4q_u8(dst + i * 4, v);
+    }
+    swizzle_scalar(src + i * 4, dst + i * 4, count - i);
+}
+
+void rgb_neon(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16x4_t v = vld4q_u8(src + i * 4);
+        const uint8x16x3_t o{{v.val[0], v.val[1], v.val[2]}};
+        vst3q_u8(dst + i * 3, o);
+    }
+    rgb_scalar(src + i * 4, dst + i * 3, count - i);
+}
+
+/// @note vrsraq + vrshrn is (t + ((t + 128) >> 8) + 128) >> 8. Same with `multiply_alpha`
+uint8x8_t multiply_alpha(uint8x8_t c, uint8x8_t a) noexcept {
+    const uint16x8_t t = vmull_u8(c, a);
+    return vrshrn_n_u16(vrsraq_n_u16(t, t, 8), 8);
+}
+
+void premultiply_neon(const uint8_t* src, uint8_t* dst, size_t count) noexcept {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t v = vld4_u8(src + i * 4);
+        v.val[0] = multiply_alpha(v.val[0], v.val[3]);
+        v.val[1] = multiply_alpha(v.val[1], v.val[3]);
+        v.val[2] = multiply_alpha(v.val[2], v.val[3]);
+        vst4_u8(dst + i * 4, v);
+    }
+    premultiply_scalar(src + i * 4, dst + i * 4, count - i);
+}
+
+#endif
+
+/// @brief kernel sets of this build. The first one supported by the CPU is the default
+const pixel_kernels_t kernel_sets[]{
+#if defined(PIXEL_USE_X86)
+    // AVX2 implies SSSE3. `rgb` uses the 128 bit shuffle for both
+    {"avx2", &swizzle_avx2, &rgb_ssse3, &premultiply_avx2},
+    {"ssse3", &swizzle_sse2, &rgb_ssse3, &premultiply_sse2},
+    {"sse2", &swizzle_sse2, &rgb_scalar, &premultiply_sse2},
+#elif defined(PIXEL_USE_NEON)
+    {"neon", &swizzle_neon, &rgb_neon, &premultiply_neon},
+#endif
+    {"scalar", &swizzle_scalar, &rgb_scalar, &premultiply_scalar},
+};
+
+bool is_supported(const pixel_kernels_t& kernels) noexcept {
+#if defined(PIXEL_USE_X86)
+    if (kernels.name == "avx2")
+        return has_avx2();
+    if (kernels.name == "ssse3")
+        return has_ssse3();
+#endif
+    return true;
+}
+
+std::atomic<const pixel_kernels_t*>& get_current_kernels() noexcept {
+    static std::atomic<const pixel_kernels_t*> current = [] {
+        const auto selected = std::find_if(std::begin(kernel_sets), std::end(kernel_sets), is_supported);
+        SPDLOG_DEBUG("pixel kernels: {}", selected->name);
+        return selected;
+    }();
+    return current;
+}
+
+const pixel_kernels_t& get_pixel_kernels() noexcept {
+    return *get_current_kernels().load(std::memory_order_acquire);
+}
+
+bool use_pixel_kernels(std::string_view name) noexcept {
+    for (const auto& kernels : kernel_sets) {
+        if (kernels.name != name)
+            continue;
+        if (is_supported(kernels) == false)
+            return false;
+        get_current_kernels().store(&kernels, std::memory_order_release);
+        return true;
+    }
+    return false;
+}
+
+std::string_view get_pixel_kernel_name() noexcept {
+    return get_pixel_kernels().name;
+}
+
+void swizzle_rgba_bgra(const void* src, void* dst, size_t count) noexcept {
+    get_pixel_kernels().swizzle(static_cast<const uint8_t*>(src), static_cast<uint8_t*>(dst), count);
+}
+
+void convert_rgba_rgb(const void* src, void* dst, size_t count) noexcept {
+    get_pixel_kernels().rgb(static_cast<const uint8_t*>(src), static_cast<uint8_t*>(dst), count);
+}
+
+void premultiply_rgba(const void* src, void* dst, size_t count) noexcept {
+    get_pixel_kernels().premultiply(static_cast<const uint8_t*>(src), static_cast<uint8_t*>(dst), count);
+}
+
+/// @note rows are copied with `memcpy`. It is already vectorized by the C runtime
+void flip_rows(const void* src, void* dst, size_t stride, uint32_t rows) noexcept {
+    auto first = static_cast<const uint8_t*>(src);
+    auto output = static_cast<uint8_t*>(dst);
+    if (src != dst) {
+        for (uint32_t y = 0; y < rows; ++y)
+            std::memcpy(output + (rows - 1 - y) * stride, first + y * stride, stride);
+        return;
+    }
+    // in-place. swap the rows with a small buffer
+    uint8_t buf[512];
+    for (uint32_t y = 0; y < rows / 2; ++y) {
+        uint8_t* top = output + y * stride;
+        uint8_t* bottom = output + (rows - 1 - y) * stride;
+        for (size_t offset = 0; offset < stride; offset += sizeof(buf)) {
+            const auto length = std::min(sizeof(buf), stride - offset);
+            std::memcpy(buf, top + offset, length);
+            std::memcpy(top + offset, bottom + offset, length);
+            std::memcpy(bottom + offset, buf, length);
+        }
+    }
+}
@@ -2,10 +2,14 @@
  * @author Park DongHa (luncliff@gmail.com)
  */
 #include <graphics.h>
+#include <spdlog/spdlog.h>
 
-GLuint create_compile_attach(GLuint program, GLenum shader_type, std::string_view code) noexcept(false);
-bool get_shader_info(std::string& message, GLuint shader, GLenum status_name = GL_COMPILE_STATUS) noexcept;
-bool get_program_info(std::string& message, GLuint program, GLenum status_name = GL_LINK_STATUS) noexcept;
+#include "hash.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace fs = std::filesystem;
 
 bool get_shader_info(std::string& message, GLuint shader, GLenum status_name) noexcept {
     GLint info = GL_FALSE;
@@ -43,3 +47,406 @@ GLuint create_compile_attach(GLuint program, GLenum shader_type, std::string_vie
     glAttachShader(program, shader);
     return shader;
 }
+
+/// @brief header of the cache file. The binary follows it
+struct program_binary_header_t final {
+    uint32_t magic;
+    GLenum format;
+    uint64_t key;
+    uint32_t length;
+};
+constexpr uint32_t program_binary_magic = 0x43504c47; // "GLPC"
+/// @note the drivers' binaries are a few MB at most. The larger length is a broken file
+constexpr uint32_t program_binary_max_length = 64 << 20;
+
+program_cache_t::program_cache_t(const fs::path& directory) noexcept : directory{directory} {
+    if (auto renderer = glGetString(GL_RENDERER))
+        driver = reinterpret_cast<const char*>(renderer);
+    if (auto version = glGetString(GL_VERSION))
+        driver.append(" ").append(reinterpret_cast<const char*>(version));
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    std::error_code ec{};
+    fs::create_directories(directory, ec);
+    if (ec)
+        spdlog::warn("{} {}: {}", __FUNCTION__, directory.generic_u8string(), ec.message());
+    SPDLOG_DEBUG("- program cache:");
+    SPDLOG_DEBUG("  driver: {}", driver);
+    SPDLOG_DEBUG("  formats: {}", num_formats);
+}
+
+uint64_t program_cache_t::get_key(std::string_view vert, std::string_view frag) const noexcept {
+    // the separators prevent the collision from the moved boundaries
+    auto hash = fnv1a(driver);
+    hash = fnv1a(std::string_view{"\0", 1}, hash);
+    hash = fnv1a(vert, hash);
+    hash = fnv1a(std::string_view{"\0", 1}, hash);
+    return fnv1a(frag, hash);
+}
+
+bool load_program_binary(GLuint program, const fs::path& fpath, uint64_t key) noexcept {
+    std::ifstream fin{fpath, std::ios::binary};
+    if (fin.is_open() == false)
+        return false;
+    program_binary_header_t header{};
+    if (fin.read(reinterpret_cast<char*>(&header), sizeof(header)).good() == false)
+        return false;
+    if (header.magic != program_binary_magic || header.key != key)
+        return false;
+    // the length must match the rest of the file. don't trust it before the allocation
+    std::error_code ec{};
+    const auto fsize = fs::file_size(fpath, ec);
+    if (ec || header.length == 0 || header.length > program_binary_max_length ||
+        fsize != sizeof(header) + header.length) {
+        spdlog::warn("{} {}: invalid length {}", __FUNCTION__, fpath.generic_u8string(), header.length);
+        return false;
+    }
+    std::vector<char> blob{};
+    try {
+        blob.resize(header.length);
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+    if (fin.read(blob.data(), blob.size()).good() == false)
+        return false;
+    glProgramBinary(program, header.format, blob.data(), static_cast<GLsizei>(blob.size()));
+    // GL_INVALID_ENUM if the format is not supported anymore
+    if (auto error = glGetError(); error != GL_NO_ERROR) {
+        spdlog::warn("{} {}: {:#x}", __FUNCTION__, fpath.generic_u8string(), error);
+        return false;
+    }
+    // the driver can reject the binary after the update
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    return status == GL_TRUE;
+}
+
+void store_program_binary(GLuint program, const fs::path& fpath, uint64_t key) noexcept {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+    program_binary_header_t header{program_binary_magic, GL_NONE, key, 0};
+    std::vector<char> blob(length);
+    glGetProgramBinary(program, length, &length, &header.format, blob.data());
+    if (auto ec = glGetError(); ec != GL_NO_ERROR) {
+        spdlog::warn("{} glGetProgramBinary: {:#x}", __FUNCTION__, ec);
+        return;
+    }
+    header.length = static_cast<uint32_t>(length);
+    // write to a temporary file, then rename. the other processes never see a partial file
+    auto temp = fpath;
+    temp += ".tmp";
+    {
+        std::ofstream fout{temp, std::ios::binary | std::ios::trunc};
+        fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        fout.write(blob.data(), length);
+        if (fout.good() == false)
+            return spdlog::warn("{} {}: write failed", __FUNCTION__, temp.generic_u8string());
+    }
+    std::error_code ec{};
+    fs::rename(temp, fpath, ec);
+    if (ec)
+        spdlog::warn("{} {}: {}", __FUNCTION__, fpath.generic_u8string(), ec.message());
+}
+
+/// @note the shaders are not necessary after the link
+bool compile_and_link(GLuint program, std::string_view vert, std::string_view frag, std::string& message) noexcept {
+    GLuint shaders[2]{};
+    auto on_return = gsl::finally([program, &shaders]() {
+        for (auto shader : shaders) {
+            if (shader == 0)
+                continue;
+            glDetachShader(program, shader);
+            glDeleteShader(shader);
+        }
+    });
+    try {
+        shaders[0] = create_compile_attach(program, GL_VERTEX_SHADER, vert);
+        shaders[1] = create_compile_attach(program, GL_FRAGMENT_SHADER, frag);
+    } catch (const std::runtime_error& ex) {
+        message = ex.what();
+        return false;
+    }
+    glLinkProgram(program);
+    return get_program_info(message, program);
+}
+
+GLenum program_cache_t::create(GLuint& program, std::string_view vert, std::string_view frag,
+                               std::string& message) noexcept {
+    const auto key = get_key(vert, frag);
+    const auto fpath = directory / fmt::format("{:016x}.bin", key);
+    program = glCreateProgram();
+    if (num_formats > 0 && load_program_binary(program, fpath, key)) {
+        ++hit;
+        return GL_NO_ERROR;
+    }
+    // compile the sources with a new program object. the old one may hold the rejected binary
+    ++miss;
+    glDeleteProgram(program);
+    program = glCreateProgram();
+    if (num_formats > 0)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    if (compile_and_link(program, vert, frag, message) == false) {
+        glDeleteProgram(program);
+        program = 0;
+        return GL_INVALID_OPERATION;
+    }
+    if (num_formats > 0)
+        store_program_binary(program, fpath, key);
+    return GL_NO_ERROR;
+}
+
+void program_cache_t::get_statistics(uint32_t& hit, uint32_t& miss) const noexcept {
+    hit = this->hit;
+    miss = this->miss;
+}
+
+// clang-format off
+#if !defined(GL_KHR_parallel_shader_compile)
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR          0x91B1
+typedef void (GL_APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) (GLuint count);
+#endif
+// clang-format on
+
+program_batch_t::program_batch_t(gsl::span<const program_source_t> sources) noexcept {
+    parallel = has_extension(gl_extension_t::KHR_parallel_shader_compile);
+    if (parallel) {
+        // 0xFFFFFFFF: let the implementation decide the number of threads
+        auto set_threads = reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSKHRPROC>(
+            eglGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+        if (set_threads)
+            set_threads(0xFFFFFFFF);
+    }
+    items.resize(sources.size());
+    // submit all compiles before the link. no status query
+    auto compile = [](GLenum shader_type, std::string_view code) {
+        const auto shader = glCreateShader(shader_type);
+        const GLchar* begin = code.data();
+        const GLint len = static_cast<GLint>(code.length());
+        glShaderSource(shader, 1, &begin, &len);
+        glCompileShader(shader);
+        return shader;
+    };
+    for (auto i = 0u; i < items.size(); ++i) {
+        items[i].shaders[0] = compile(GL_VERTEX_SHADER, sources[i].vert);
+        items[i].shaders[1] = compile(GL_FRAGMENT_SHADER, sources[i].frag);
+    }
+    for (auto& item : items) {
+        item.program = glCreateProgram();
+        glAttachShader(item.program, item.shaders[0]);
+        glAttachShader(item.program, item.shaders[1]);
+        glLinkProgram(item.program);
+    }
+    SPDLOG_DEBUG("- program batch:");
+    SPDLOG_DEBUG("  programs: {}", items.size());
+    SPDLOG_DEBUG("  parallel: {}", parallel);
+}
+
+void release(GLuint program, GLuint (&shaders)[2]) noexcept {
+    for (auto& shader : shaders) {
+        if (shader == 0)
+            continue;
+        if (program)
+            glDetachShader(program, shader);
+        glDeleteShader(shader);
+        shader = 0;
+    }
+}
+
+program_batch_t::~program_batch_t() noexcept {
+    for (auto& item : items) {
+        release(item.program, item.shaders);
+        if (item.program)
+            glDeleteProgram(item.program);
+    }
+}
+
+size_t program_batch_t::size() const noexcept {
+    return items.size();
+}
+
+bool program_batch_t::is_parallel() const noexcept {
+    return parallel;
+}
+
+size_t program_batch_t::poll() noexcept {
+    size_t count = 0;
+    for (auto& item : items) {
+        if (item.completed == false) {
+            GLint status = GL_TRUE;
+            if (parallel)
+                glGetProgramiv(item.program, GL_COMPLETION_STATUS_KHR, &status);
+            item.completed = status == GL_TRUE;
+        }
+        count += item.completed;
+    }
+    return count;
+}
+
+GLenum program_batch_t::get(size_t idx, GLuint& program, std::string& message) noexcept {
+    program = 0;
+    if (idx >= items.size() || items[idx].program == 0)
+        return GL_INVALID_VALUE;
+    auto& item = items[idx];
+    GLenum ec = GL_NO_ERROR;
+    // find the reason from the shaders first
+    for (auto shader : item.shaders)
+        if (get_shader_info(message, shader, GL_COMPILE_STATUS) == false) {
+            ec = GL_INVALID_OPERATION;
+            break;
+        }
+    if (ec == GL_NO_ERROR && get_program_info(message, item.program) == false)
+        ec = GL_INVALID_OPERATION;
+    release(item.program, item.shaders);
+    if (ec == GL_NO_ERROR)
+        program = item.program;
+    else
+        glDeleteProgram(item.program);
+    item.program = 0;
+    return ec;
+}
+
+/// @brief sort with the hash. The entries of the colliding hash are reported and removed.
+///        The lookup with any of their names must fail instead of returning the other one
+void sort_entries(std::vector<gl_program_t::entry_t>& entries) noexcept {
+    using entry_t = gl_program_t::entry_t;
+    std::sort(entries.begin(), entries.end(), [](const entry_t& lhs, const entry_t& rhs) { //
+        return lhs.hash < rhs.hash;
+    });
+    auto same = [](const entry_t& lhs, const entry_t& rhs) {
+        return lhs.location == rhs.location && lhs.type == rhs.type && lhs.size == rhs.size;
+    };
+    auto last = entries.begin();
+    for (auto first = entries.begin(); first != entries.end();) {
+        auto next = std::find_if(first, entries.end(), [hash = first->hash](const entry_t& entry) { //
+            return entry.hash != hash;
+        });
+        // the same entry can be registered twice. keep one of them
+        if (std::all_of(first, next, [&same, first](const entry_t& entry) { return same(entry, *first); })) {
+            *last++ = *first;
+        } else {
+            for (auto it = first; it != next; ++it)
+                spdlog::warn("{} hash collision: {:#x} location {}", __FUNCTION__, it->hash, it->location);
+        }
+        first = next;
+    }
+    entries.erase(last, entries.end());
+}
+
+/// @brief register "name[0]" with "name" also
+void emplace_entry(std::vector<gl_program_t::entry_t>& entries, std::string_view name, GLint location, GLenum type,
+                   GLint size) noexcept(false) {
+    entries.emplace_back(gl_program_t::entry_t{hash_name(name), location, type, size});
+    constexpr std::string_view suffix = "[0]";
+    if (name.size() > suffix.size() && name.substr(name.size() - suffix.size()) == suffix)
+        entries.emplace_back(
+            gl_program_t::entry_t{hash_name(name.substr(0, name.size() - suffix.size())), location, type, size});
+}
+
+gl_program_t::gl_program_t(GLuint program) noexcept : program{program} {
+    if (is_valid() != GL_NO_ERROR)
+        return;
+    try {
+        GLint count = 0, max_length = 0;
+        std::string name{};
+        // uniforms in the blocks don't have the location. they are reflected with the blocks
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+        for (auto i = 0; i < count; ++i) {
+            name.resize(max_length);
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = GL_NONE;
+            glGetActiveUniform(program, i, max_length, &length, &size, &type, name.data());
+            name.resize(length);
+            if (const auto location = glGetUniformLocation(program, name.c_str()); location >= 0)
+                emplace_entry(uniforms, name, location, type, size);
+        }
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+        for (auto i = 0; i < count; ++i) {
+            name.resize(max_length);
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(program, i, max_length, &length, name.data());
+            name.resize(length);
+            GLint size = 0;
+            glGetActiveUniformBlockiv(program, i, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+            emplace_entry(blocks, name, i, GL_NONE, size);
+        }
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+        for (auto i = 0; i < count; ++i) {
+            name.resize(max_length);
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = GL_NONE;
+            glGetActiveAttrib(program, i, max_length, &length, &size, &type, name.data());
+            name.resize(length);
+            emplace_entry(attributes, name, glGetAttribLocation(program, name.c_str()), type, size);
+        }
+    } catch (const std::bad_alloc&) {
+        spdlog::error("{} out of memory", __FUNCTION__);
+    }
+    sort_entries(uniforms);
+    sort_entries(blocks);
+    sort_entries(attributes);
+    SPDLOG_DEBUG("- program: {}", program);
+    SPDLOG_DEBUG("  uniforms: {}", uniforms.size());
+    SPDLOG_DEBUG("  blocks: {}", blocks.size());
+    SPDLOG_DEBUG("  attributes: {}", attributes.size());
+}
+
+gl_program_t::~gl_program_t() noexcept {
+    if (program)
+        glDeleteProgram(program);
+}
+
+GLenum gl_program_t::is_valid() const noexcept {
+    if (program == 0 || glIsProgram(program) == GL_FALSE)
+        return GL_INVALID_VALUE;
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    return status == GL_TRUE ? GL_NO_ERROR : GL_INVALID_OPERATION;
+}
+
+GLuint gl_program_t::handle() const noexcept {
+    return program;
+}
+
+const gl_program_t::entry_t* find_entry(gsl::span<const gl_program_t::entry_t> entries, uint32_t hash) noexcept {
+    auto it = std::lower_bound(entries.begin(), entries.end(), hash,
+                               [](const gl_program_t::entry_t& entry, uint32_t hash) { return entry.hash < hash; });
+    if (it == entries.end() || it->hash != hash)
+        return nullptr;
+    return &*it;
+}
+
+const gl_program_t::entry_t* gl_program_t::find_uniform(uint32_t hash) const noexcept {
+    return find_entry(uniforms, hash);
+}
+
+GLint gl_program_t::get_uniform(uint32_t hash) const noexcept {
+    const auto entry = find_entry(uniforms, hash);
+    return entry ? entry->location : -1;
+}
+
+GLuint gl_program_t::get_uniform_block(uint32_t hash) const noexcept {
+    const auto entry = find_entry(blocks, hash);
+    return entry ? static_cast<GLuint>(entry->location) : GL_INVALID_INDEX;
+}
+
+GLint gl_program_t::get_attribute(uint32_t hash) const noexcept {
+    const auto entry = find_entry(attributes, hash);
+    return entry ? entry->location : -1;
+}
+
+gsl::span<const gl_program_t::entry_t> gl_program_t::get_uniforms() const noexcept {
+    return uniforms;
+}
+gsl::span<const gl_program_t::entry_t> gl_program_t::get_uniform_blocks() const noexcept {
+    return blocks;
+}
+gsl::span<const gl_program_t::entry_t> gl_program_t::get_attributes() const noexcept {
+    return attributes;
+}
@@ -1,2 +1,271 @@
 #include <graphics.h>
 #include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <type_traits>
+
+gpu_future_t::gpu_future_t(GLsync fence) noexcept : type{fence ? type_t::gl : type_t::none}, gl_fence{fence} {
+}
+
+gpu_future_t::gpu_future_t(EGLDisplay _display, EGLSync fence) noexcept
+    : type{fence != EGL_NO_SYNC ? type_t::egl : type_t::none}, display{_display}, egl_fence{fence} {
+}
+
+gpu_future_t::gpu_future_t(uint64_t _device, uint64_t _timeline, uint64_t _value) noexcept
+    : type{_timeline != 0 ? type_t::vulkan : type_t::none}, device{_device}, timeline{_timeline}, value{_value} {
+}
+
+#if defined(USE_VULKAN)
+/// @note VkSemaphore is a pointer in 64 bit, uint64_t in 32 bit
+template <typename T>
+uint64_t to_opaque(T handle) noexcept {
+    if constexpr (std::is_pointer_v<T>)
+        return reinterpret_cast<uintptr_t>(handle);
+    else
+        return handle;
+}
+
+template <typename T>
+T from_opaque(uint64_t handle) noexcept {
+    if constexpr (std::is_pointer_v<T>)
+        return reinterpret_cast<T>(static_cast<uintptr_t>(handle));
+    else
+        return handle;
+}
+
+gpu_future_t make_gpu_future(VkDevice device, VkSemaphore timeline, uint64_t value) noexcept {
+    return gpu_future_t{to_opaque(device), to_opaque(timeline), value};
+}
+#endif
+
+gpu_future_t::~gpu_future_t() noexcept {
+    switch (type) {
+    case type_t::gl:
+        glDeleteSync(gl_fence);
+        break;
+    case type_t::egl:
+        if (eglDestroySync(display, egl_fence) == EGL_FALSE)
+            spdlog::warn("{}: {:#x}", "eglDestroySync", eglGetError());
+        break;
+    default:
+        break;
+    }
+}
+
+gpu_future_t::gpu_future_t(gpu_future_t&& rhs) noexcept
+    : type{rhs.type}, gl_fence{rhs.gl_fence}, display{rhs.display}, egl_fence{rhs.egl_fence}, device{rhs.device},
+      timeline{rhs.timeline}, value{rhs.value} {
+    rhs.type = type_t::none;
+}
+
+gpu_future_t& gpu_future_t::operator=(gpu_future_t&& rhs) noexcept {
+    if (this == &rhs)
+        return *this;
+    gpu_future_t previous{std::move(*this)}; // release the current fence
+    type = rhs.type;
+    gl_fence = rhs.gl_fence;
+    display = rhs.display;
+    egl_fence = rhs.egl_fence;
+    device = rhs.device;
+    timeline = rhs.timeline;
+    value = rhs.value;
+    rhs.type = type_t::none;
+    return *this;
+}
+
+auto gpu_future_t::get_type() const noexcept -> type_t {
+    return type;
+}
+
+bool gpu_future_t::valid() const noexcept {
+    return type != type_t::none;
+}
+
+bool gpu_future_t::is_ready() noexcept {
+    return wait(std::chrono::nanoseconds::zero()) == 0;
+}
+
+uint32_t gpu_future_t::wait(std::chrono::nanoseconds timeout) noexcept {
+    const auto nano = static_cast<uint64_t>(std::max(timeout.count(), std::chrono::nanoseconds::rep{0}));
+    switch (type) {
+    case type_t::gl:
+        switch (glClientWaitSync(gl_fence, GL_SYNC_FLUSH_COMMANDS_BIT, nano)) {
+        case GL_ALREADY_SIGNALED:
+        case GL_CONDITION_SATISFIED:
+            return 0;
+        case GL_TIMEOUT_EXPIRED:
+            return ETIMEDOUT;
+        default:
+            spdlog::error("{}: {:#x}", "glClientWaitSync", glGetError());
+            return EIO;
+        }
+    case type_t::egl:
+        switch (eglClientWaitSync(display, egl_fence, EGL_SYNC_FLUSH_COMMANDS_BIT, nano)) {
+        case EGL_CONDITION_SATISFIED:
+            return 0;
+        case EGL_TIMEOUT_EXPIRED:
+            return ETIMEDOUT;
+        default:
+            spdlog::error("{}: {:#x}", "eglClientWaitSync", eglGetError());
+            return EIO;
+        }
+#if defined(USE_VULKAN)
+    case type_t::vulkan: {
+        const auto semaphore = from_opaque<VkSemaphore>(timeline);
+        VkSemaphoreWaitInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        info.semaphoreCount = 1;
+        info.pSemaphores = &semaphore;
+        info.pValues = &value;
+        switch (auto ec = vkWaitSemaphores(from_opaque<VkDevice>(device), &info, nano)) {
+        case VK_SUCCESS:
+            return 0;
+        case VK_TIMEOUT:
+            return ETIMEDOUT;
+        default:
+            spdlog::error("{}: {}", "vkWaitSemaphores", static_cast<int32_t>(ec));
+            return EIO;
+        }
+    }
+#endif
+    default:
+        return EINVAL;
+    }
+}
+
+uint32_t gpu_future_t::wait_gpu() noexcept {
+    switch (type) {
+    case type_t::gl:
+        glWaitSync(gl_fence, 0, GL_TIMEOUT_IGNORED);
+        if (auto ec = glGetError(); ec != GL_NO_ERROR) {
+            spdlog::error("{}: {:#x}", "glWaitSync", ec);
+            return EIO;
+        }
+        return 0;
+    case type_t::egl:
+        if (eglWaitSync(display, egl_fence, 0) == EGL_FALSE) {
+            spdlog::error("{}: {:#x}", "eglWaitSync", eglGetError());
+            return EIO;
+        }
+        return 0;
+    case type_t::vulkan:
+        return ENOTSUP;
+    default:
+        return EINVAL;
+    }
+}
+
+#if defined(USE_VULKAN)
+gpu_timeline_t::gpu_timeline_t(VkDevice _device, uint64_t initial_value) noexcept
+    : device{_device}, last{initial_value} {
+    VkSemaphoreTypeCreateInfo type_info{};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = initial_value;
+    VkSemaphoreCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    info.pNext = &type_info;
+    if (ec = vkCreateSemaphore(device, &info, nullptr, &handle); ec != VK_SUCCESS)
+        spdlog::error("{}: {}", "vkCreateSemaphore", static_cast<int32_t>(ec));
+}
+
+gpu_timeline_t::~gpu_timeline_t() noexcept {
+    vkDestroySemaphore(device, handle, nullptr);
+}
+
+VkResult gpu_timeline_t::is_valid() const noexcept {
+    return ec;
+}
+
+uint64_t gpu_timeline_t::advance() noexcept {
+    return last.fetch_add(1) + 1;
+}
+
+uint64_t gpu_timeline_t::get_last() const noexcept {
+    return last.load();
+}
+
+VkResult gpu_timeline_t::query(uint64_t& value) const noexcept {
+    return vkGetSemaphoreCounterValue(device, handle, &value);
+}
+
+VkResult gpu_timeline_t::signal(uint64_t value) noexcept {
+    VkSemaphoreSignalInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+    info.semaphore = handle;
+    info.value = value;
+    return vkSignalSemaphore(device, &info);
+}
+
+VkResult gpu_timeline_t::wait(uint64_t value, std::chrono::nanoseconds timeout) const noexcept {
+    const timeline_point_t point{handle, value};
+    return wait_timeline_points(device, gsl::make_span(&point, 1), timeout);
+}
+
+gpu_future_t gpu_timeline_t::get_future(uint64_t value) const noexcept {
+    return make_gpu_future(device, handle, value);
+}
+
+/// @note up to 8 points for each wait/signal. The submit doesn't need the allocation
+constexpr size_t max_timeline_points = 8;
+
+VkResult timeline_submit(VkQueue queue, gsl::span<const VkCommandBuffer> commands,
+                         gsl::span<const timeline_point_t> waits, gsl::span<const timeline_point_t> signals,
+                         VkFence fence) noexcept {
+    if (static_cast<size_t>(waits.size()) > max_timeline_points ||
+        static_cast<size_t>(signals.size()) > max_timeline_points)
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    VkSemaphore wait_semaphores[max_timeline_points]{};
+    uint64_t wait_values[max_timeline_points]{};
+    VkPipelineStageFlags wait_stages[max_timeline_points]{};
+    for (auto i = 0u; i < static_cast<size_t>(waits.size()); ++i) {
+        wait_semaphores[i] = waits[i].semaphore;
+        wait_values[i] = waits[i].value;
+        wait_stages[i] = waits[i].stage;
+    }
+    VkSemaphore signal_semaphores[max_timeline_points]{};
+    uint64_t signal_values[max_timeline_points]{};
+    for (auto i = 0u; i < static_cast<size_t>(signals.size()); ++i) {
+        signal_semaphores[i] = signals[i].semaphore;
+        signal_values[i] = signals[i].value;
+    }
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = static_cast<uint32_t>(waits.size());
+    timeline_info.pWaitSemaphoreValues = wait_values;
+    timeline_info.signalSemaphoreValueCount = static_cast<uint32_t>(signals.size());
+    timeline_info.pSignalSemaphoreValues = signal_values;
+    VkSubmitInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    info.pNext = &timeline_info;
+    info.commandBufferCount = static_cast<uint32_t>(commands.size());
+    info.pCommandBuffers = commands.data();
+    info.waitSemaphoreCount = static_cast<uint32_t>(waits.size());
+    info.pWaitSemaphores = wait_semaphores;
+    info.pWaitDstStageMask = wait_stages;
+    info.signalSemaphoreCount = static_cast<uint32_t>(signals.size());
+    info.pSignalSemaphores = signal_semaphores;
+    return vkQueueSubmit(queue, 1, &info, fence);
+}
+
+VkResult wait_timeline_points(VkDevice device, gsl::span<const timeline_point_t> points,
+                              std::chrono::nanoseconds timeout, bool any) noexcept {
+    if (static_cast<size_t>(points.size()) > max_timeline_points)
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    VkSemaphore semaphores[max_timeline_points]{};
+    uint64_t values[max_timeline_points]{};
+    for (auto i = 0u; i < static_cast<size_t>(points.size()); ++i) {
+        semaphores[i] = points[i].semaphore;
+        values[i] = points[i].value;
+    }
+    VkSemaphoreWaitInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    info.flags = any ? VK_SEMAPHORE_WAIT_ANY_BIT : 0;
+    info.semaphoreCount = static_cast<uint32_t>(points.size());
+    info.pSemaphores = semaphores;
+    info.pValues = values;
+    const auto nano = static_cast<uint64_t>(std::max(timeout.count(), std::chrono::nanoseconds::rep{0}));
+    return vkWaitSemaphores(device, &info, nano);
+}
+#endif
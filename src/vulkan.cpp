@@ -1,5 +1,9 @@
+#include <graphics.h>
+
 #include "vulkan_1.h"
 
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
 using namespace std;
@@ -63,6 +67,29 @@ uint32_t get_graphics_queue_available(VkQueueFamilyProperties* properties, uint3
     return static_cast<uint32_t>(-1);
 }
 
+uint32_t get_transfer_queue_available(VkQueueFamilyProperties* properties, uint32_t count) noexcept {
+    for (auto i = 0u; i < count; ++i) {
+        const auto flags = properties[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0)
+            return i;
+    }
+    return static_cast<uint32_t>(-1);
+}
+
+bool is_timeline_semaphore_supported(VkPhysicalDevice physical_device) noexcept {
+    VkPhysicalDeviceProperties props{};
+    vkGetPhysicalDeviceProperties(physical_device, &props);
+    if (props.apiVersion < VK_API_VERSION_1_2)
+        return false;
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline{};
+    timeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &timeline;
+    vkGetPhysicalDeviceFeatures2(physical_device, &features);
+    return timeline.timelineSemaphore;
+}
+
 const float global_queue_priority = 0;
 
 VkResult create_device(VkPhysicalDevice physical_device, //
@@ -87,6 +114,11 @@ VkResult create_device(VkPhysicalDevice physical_device, //
     info.pEnabledFeatures = &features;
     info.queueCreateInfoCount = 1;
     info.pQueueCreateInfos = &queue_info;
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline{};
+    timeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timeline.timelineSemaphore = VK_TRUE;
+    if (is_timeline_semaphore_supported(physical_device))
+        info.pNext = &timeline;
     return vkCreateDevice(physical_device, &info, nullptr, &device);
 }
 
@@ -148,9 +180,9 @@ void vulkan_renderpass_t::setup_color_attachment(VkAttachmentDescription& colors
     color_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 }
 
-vulkan_pipeline_t::vulkan_pipeline_t(VkDevice device, VkRenderPass renderpass, VkExtent2D& extent,
+vulkan_pipeline_t::vulkan_pipeline_t(VkDevice _device, VkRenderPass renderpass, VkExtent2D& extent,
                                      vulkan_pipeline_input_t& input) noexcept(false)
-    : device{device} {
+    : device{_device} {
     input.setup_shader_stage(shader_stages);
     input.setup_vertex_input_state(vertex_input_state);
     setup_input_assembly(input_assembly);
@@ -377,17 +409,152 @@ VkResult create_device(VkPhysicalDevice physical_device,                     //
     info.ppEnabledExtensionNames = extension_names;
     info.enabledExtensionCount = 1;
     info.pEnabledFeatures = &features;
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline{};
+    timeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timeline.timelineSemaphore = VK_TRUE;
+    if (is_timeline_semaphore_supported(physical_device))
+        info.pNext = &timeline;
     return vkCreateDevice(physical_device, &info, nullptr, &device);
 }
 
+VkResult is_surface_supported(VkPhysicalDevice physical_device, uint32_t family, //
+                              gsl::span<const VkSurfaceKHR> surfaces, VkBool32& support) noexcept {
+    support = true;
+    for (auto surface : surfaces) {
+        if (auto ec = vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, family, surface, &support))
+            return ec;
+        if (support == false) // all surface should be supported
+            break;
+    }
+    return VK_SUCCESS;
+}
+
+VkResult create_device(VkPhysicalDevice physical_device,                     //
+                       const VkSurfaceKHR* surfaces, uint32_t surface_count, //
+                       VkDevice& device, vulkan_queue_set_t& queues) noexcept {
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, nullptr);
+    std::unique_ptr<VkQueueFamilyProperties[]> properties{};
+    std::unique_ptr<uint32_t[]> used{}; // number of the queues to create in each family
+    try {
+        properties = std::make_unique<VkQueueFamilyProperties[]>(count);
+        used = std::make_unique<uint32_t[]>(count);
+    } catch (const std::bad_alloc&) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, properties.get());
+    queues = vulkan_queue_set_t{};
+    // graphics/present. prefer the family which can do both
+    for (auto i = 0u; i < count; ++i) {
+        VkBool32 support = false;
+        if (auto ec = is_surface_supported(physical_device, i, gsl::make_span(surfaces, surface_count), support))
+            return ec;
+        if (support == false)
+            continue;
+        if (queues.present.family == UINT32_MAX)
+            queues.present.family = i;
+        if (properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            queues.graphics.family = queues.present.family = i;
+            break;
+        }
+    }
+    // no family can do both. the first presenting family is already selected
+    if (queues.graphics.family == UINT32_MAX)
+        queues.graphics.family = get_graphics_queue_available(properties.get(), count);
+    if (queues.graphics.family == UINT32_MAX || queues.present.family == UINT32_MAX)
+        return VK_ERROR_FEATURE_NOT_PRESENT;
+    // compute without graphics, then transfer-only
+    for (auto i = 0u; i < count; ++i) {
+        const auto flags = properties[i].queueFlags;
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && (flags & VK_QUEUE_GRAPHICS_BIT) == 0) {
+            queues.compute.family = i;
+            break;
+        }
+    }
+    if (queues.compute.family == UINT32_MAX)
+        queues.compute.family = queues.graphics.family;
+    queues.transfer.family = get_transfer_queue_available(properties.get(), count);
+    if (queues.transfer.family == UINT32_MAX)
+        queues.transfer.family = queues.graphics.family;
+
+    // take the next queue in the family. share the last one if there is no more
+    float priorities[4][4]{}; // up to 4 roles in 1 family
+    auto assign = [&properties, &used, &priorities, &queues](vulkan_queue_t& queue, float priority) {
+        const auto family = queue.family;
+        queue.index = std::min(used[family], properties[family].queueCount - 1);
+        used[family] = queue.index + 1;
+        // `priorities` are indexed by the order of the family in the create info
+        const vulkan_queue_t* roles[4]{&queues.graphics, &queues.present, &queues.compute, &queues.transfer};
+        auto slot = 0u;
+        while (roles[slot]->family != family)
+            ++slot;
+        auto& p = priorities[slot][queue.index];
+        p = std::max(p, priority);
+    };
+    assign(queues.graphics, 1.0f);
+    if (queues.present.family == queues.graphics.family)
+        queues.present.index = queues.graphics.index; // presentation is in the end of the graphics work
+    else
+        assign(queues.present, 1.0f);
+    assign(queues.compute, 0.5f);
+    assign(queues.transfer, 0.25f);
+
+    VkDeviceQueueCreateInfo qinfos[4]{};
+    uint32_t qcount = 0;
+    const vulkan_queue_t* roles[4]{&queues.graphics, &queues.present, &queues.compute, &queues.transfer};
+    for (auto slot = 0u; slot < 4; ++slot) {
+        const auto family = roles[slot]->family;
+        if (std::any_of(roles, roles + slot, [family](const vulkan_queue_t* q) { return q->family == family; }))
+            continue;
+        auto& qinfo = qinfos[qcount++];
+        qinfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        qinfo.queueFamilyIndex = family;
+        qinfo.queueCount = used[family];
+        qinfo.pQueuePriorities = priorities[slot];
+    }
+    VkPhysicalDeviceFeatures features{};
+    vkGetPhysicalDeviceFeatures(physical_device, &features);
+    VkDeviceCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    info.queueCreateInfoCount = qcount;
+    info.pQueueCreateInfos = qinfos;
+    const char* extension_names[1]{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    if (surface_count) {
+        info.ppEnabledExtensionNames = extension_names;
+        info.enabledExtensionCount = 1;
+    }
+    info.pEnabledFeatures = &features;
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline{};
+    timeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timeline.timelineSemaphore = VK_TRUE;
+    if (is_timeline_semaphore_supported(physical_device))
+        info.pNext = &timeline;
+    if (auto ec = vkCreateDevice(physical_device, &info, nullptr, &device))
+        return ec;
+    for (auto queue : {&queues.graphics, &queues.present, &queues.compute, &queues.transfer})
+        vkGetDeviceQueue(device, queue->family, queue->index, &queue->handle);
+    return VK_SUCCESS;
+}
+
 vulkan_shader_module_t::vulkan_shader_module_t(VkDevice _device, const fs::path fpath) noexcept(false)
     : device{_device} {
     if (fs::exists(fpath) == false)
         throw system_error{ENOENT, system_category()};
     VkShaderModuleCreateInfo info{};
     info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    const auto blob = read_all(fpath, info.codeSize);
-    info.pCode = reinterpret_cast<const uint32_t*>(blob.get());
+    const mapped_file_t blob{fpath};
+    info.codeSize = blob.get().size();
+    info.pCode = reinterpret_cast<const uint32_t*>(blob.get().data());
+    if (auto ec = vkCreateShaderModule(device, &info, nullptr, &handle))
+        throw vulkan_exception_t{ec, "vkCreateShaderModule"};
+}
+
+vulkan_shader_module_t::vulkan_shader_module_t(VkDevice _device, gsl::span<const std::byte> code) noexcept(false)
+    : device{_device} {
+    VkShaderModuleCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    info.codeSize = code.size();
+    info.pCode = reinterpret_cast<const uint32_t*>(code.data());
     if (auto ec = vkCreateShaderModule(device, &info, nullptr, &handle))
         throw vulkan_exception_t{ec, "vkCreateShaderModule"};
 }
@@ -515,9 +682,10 @@ vulkan_semaphore_t::~vulkan_semaphore_t() noexcept {
     vkDestroySemaphore(device, handle, nullptr);
 }
 
-vulkan_fence_t::vulkan_fence_t(VkDevice _device) noexcept(false) : device{_device} {
+vulkan_fence_t::vulkan_fence_t(VkDevice _device, VkFenceCreateFlags flags) noexcept(false) : device{_device} {
     VkFenceCreateInfo info{};
     info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    info.flags = flags;
     if (auto ec = vkCreateFence(device, &info, nullptr, &handle))
         throw vulkan_exception_t{ec, "vkCreateFence"};
 }
@@ -551,24 +719,30 @@ VkResult create_index_buffer(VkDevice device, VkBuffer& buffer, VkBufferCreateIn
     return vkCreateBuffer(device, &info, nullptr, &buffer);
 }
 
-VkResult allocate_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory& memory,
-                         const VkBufferCreateInfo& buffer_info, VkFlags desired,
+VkResult allocate_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory& memory, //
+                         const VkBufferCreateInfo&, VkFlags desired,
                          const VkPhysicalDeviceMemoryProperties& props) noexcept {
     VkMemoryRequirements requirements{};
     vkGetBufferMemoryRequirements(device, buffer, &requirements);
     VkMemoryAllocateInfo info{};
     info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     info.allocationSize = requirements.size;
-    for (auto i = 0u; i < props.memoryTypeCount; ++i) {
-        // match type?
-        const auto typebit = (1 << i);
-        if (requirements.memoryTypeBits & typebit) {
-            // match prop?
-            const auto mtype = props.memoryTypes[i];
-            if ((mtype.propertyFlags & desired) == desired)
-                info.memoryTypeIndex = i;
-        }
-    }
+    info.memoryTypeIndex = get_memory_type(props, requirements.memoryTypeBits, desired);
+    if (info.memoryTypeIndex == UINT32_MAX)
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    return vkAllocateMemory(device, &info, nullptr, &memory);
+}
+
+VkResult allocate_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory& memory, VkFlags desired,
+                         const vulkan_memory_selector_t& selector) noexcept {
+    VkMemoryRequirements requirements{};
+    vkGetBufferMemoryRequirements(device, buffer, &requirements);
+    VkMemoryAllocateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    info.allocationSize = requirements.size;
+    info.memoryTypeIndex = selector.select(requirements.memoryTypeBits, desired);
+    if (info.memoryTypeIndex == UINT32_MAX)
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
     return vkAllocateMemory(device, &info, nullptr, &memory);
 }
 
@@ -604,7 +778,7 @@ VkResult render_submit(VkQueue queue,                       //
     VkSubmitInfo info{};
     info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     info.pCommandBuffers = commands.data();
-    info.commandBufferCount = commands.size();
+    info.commandBufferCount = static_cast<uint32_t>(commands.size());
     const VkPipelineStageFlags stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
     info.pWaitDstStageMask = stages;
     if (wait != VK_NULL_HANDLE) { // if null handle, no wait
@@ -633,9 +807,116 @@ VkResult present_submit(VkQueue queue,                                  //
     return vkQueuePresentKHR(queue, &info);
 }
 
+vulkan_frame_scheduler_t::frame_t::frame_t(VkDevice device, uint32_t queue_family) noexcept(false)
+    : pool{device, queue_family, 1}, image_available{device}, render_finished{device},
+      fence{device, VK_FENCE_CREATE_SIGNALED_BIT} {
+}
+
+vulkan_frame_scheduler_t::vulkan_frame_scheduler_t(VkDevice _device, uint32_t queue_family, uint32_t _count,
+                                                   uint32_t _num_images) noexcept(false)
+    : device{_device}, count{_count}, image_fences{make_unique<VkFence[]>(_num_images)}, num_images{_num_images} {
+    if (count == 0)
+        throw std::invalid_argument{"count must be positive"};
+    frames.reserve(count);
+    for (auto i = 0u; i < count; ++i)
+        frames.emplace_back(make_unique<frame_t>(device, queue_family));
+}
+
+vulkan_frame_scheduler_t::~vulkan_frame_scheduler_t() noexcept {
+    wait(); // the device may be lost. nothing to do for the error
+}
+
+VkResult vulkan_frame_scheduler_t::wait(uint64_t timeout) noexcept {
+    for (const auto& frame : frames)
+        if (auto ec = vkWaitForFences(device, 1, &frame->fence.handle, VK_TRUE, timeout))
+            return ec;
+    return VK_SUCCESS;
+}
+
+uint32_t vulkan_frame_scheduler_t::get_frame_index() const noexcept {
+    return static_cast<uint32_t>(current % count);
+}
+
+VkResult vulkan_frame_scheduler_t::renew_semaphore(frame_t& frame) noexcept {
+    VkSemaphoreCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkSemaphore semaphore{};
+    if (auto ec = vkCreateSemaphore(device, &info, nullptr, &semaphore))
+        return ec;
+    vkDestroySemaphore(device, frame.image_available.handle, nullptr);
+    frame.image_available.handle = semaphore;
+    return VK_SUCCESS;
+}
+
+VkResult vulkan_frame_scheduler_t::renew_fence(frame_t& frame) noexcept {
+    VkFenceCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VkFence fence{};
+    if (auto ec = vkCreateFence(device, &info, nullptr, &fence))
+        return ec;
+    for (auto i = 0u; i < num_images; ++i)
+        if (image_fences[i] == frame.fence.handle)
+            image_fences[i] = fence;
+    vkDestroyFence(device, frame.fence.handle, nullptr);
+    frame.fence.handle = fence;
+    return VK_SUCCESS;
+}
+
+VkResult vulkan_frame_scheduler_t::begin(VkSwapchainKHR swapchain, uint32_t& index,
+                                         VkCommandBuffer& commands) noexcept {
+    auto& frame = *frames[get_frame_index()];
+    // the frame submitted `count` frames before must be finished to reuse its resources
+    if (auto ec = vkWaitForFences(device, 1, &frame.fence.handle, VK_TRUE, UINT64_MAX))
+        return ec;
+    const auto result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, frame.image_available.handle,
+                                              VK_NULL_HANDLE, &index);
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+        return result;
+    // from here, `end` won't be called for the errors. the next acquire needs an unsignaled semaphore
+    auto ec = VK_SUCCESS;
+    if (index >= num_images) {
+        ec = VK_ERROR_OUT_OF_DATE_KHR; // the swapchain is recreated with more images
+    } else if (auto fence = image_fences[index]; fence != VK_NULL_HANDLE && fence != frame.fence.handle) {
+        // the image may be still in use by the other frame if the swapchain returns them out of order
+        ec = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+    }
+    if (ec == VK_SUCCESS)
+        ec = vkResetCommandPool(device, frame.pool.handle, 0);
+    if (ec != VK_SUCCESS) {
+        renew_semaphore(frame); // out of memory. nothing to do for the error
+        return ec;
+    }
+    image_fences[index] = frame.fence.handle;
+    image_index = index;
+    commands = frame.pool.buffers[0];
+    return result;
+}
+
+VkResult vulkan_frame_scheduler_t::end(VkQueue graphics, VkQueue present, VkSwapchainKHR swapchain) noexcept {
+    auto& frame = *frames[get_frame_index()];
+    // reset here, not in `begin`. If the acquire fails, the next wait must not block forever
+    if (auto ec = vkResetFences(device, 1, &frame.fence.handle)) {
+        renew_semaphore(frame);
+        return ec;
+    }
+    if (auto ec = render_submit(graphics, gsl::make_span(frame.pool.buffers.get(), 1), //
+                                frame.fence.handle, frame.image_available.handle, frame.render_finished.handle)) {
+        // an empty batch can consume the semaphore and signal the fence. If it also fails, replace them
+        if (render_submit(graphics, {}, frame.fence.handle, frame.image_available.handle, VK_NULL_HANDLE) !=
+            VK_SUCCESS) {
+            renew_fence(frame);
+            renew_semaphore(frame);
+        }
+        return ec;
+    }
+    ++current;
+    return present_submit(present, image_index, swapchain, frame.render_finished.handle);
+}
+
 vulkan_command_recorder_t::vulkan_command_recorder_t(VkCommandBuffer command_buffer, //
                                                      VkRenderPass renderpass, VkFramebuffer framebuffer,
-                                                     VkExtent2D extent) noexcept(false)
+                                                     VkExtent2D extent, VkSubpassContents contents) noexcept(false)
     : commands{command_buffer}, clear{} {
     VkCommandBufferBeginInfo begin{};
     begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -653,7 +934,7 @@ vulkan_command_recorder_t::vulkan_command_recorder_t(VkCommandBuffer command_buf
     clear.color.float32[2] = 0;
     clear.color.float32[3] = 1;
     render.pClearValues = &clear;
-    vkCmdBeginRenderPass(commands, &render, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(commands, &render, contents);
 }
 
 vulkan_command_recorder_t::~vulkan_command_recorder_t() noexcept(false) {
@@ -1,5 +1,6 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -96,7 +97,7 @@ struct input1_t : vulkan_pipeline_input_t {
         stage[1].module = frag.handle;
     }
 
-    void setup_vertex_input_state(VkPipelineVertexInputStateCreateInfo& info) noexcept override {
+    void setup_vertex_input_state(VkPipelineVertexInputStateCreateInfo& state) noexcept override {
         desc.binding = 0;
         desc.stride = sizeof(input_unit_t);
         desc.inputRate = VK_VERTEX_INPUT_RATE_VERTEX; // per vertex input
@@ -111,31 +112,31 @@ struct input1_t : vulkan_pipeline_input_t {
         attrs[1].format = VK_FORMAT_R32G32B32_SFLOAT; // vec3
         attrs[1].offset = sizeof(input_unit_t::position);
         // ...
-        info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        info.vertexBindingDescriptionCount = 1;
-        info.pVertexBindingDescriptions = &desc;
-        info.vertexAttributeDescriptionCount = 2;
-        info.pVertexAttributeDescriptions = attrs;
+        state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        state.vertexBindingDescriptionCount = 1;
+        state.pVertexBindingDescriptions = &desc;
+        state.vertexAttributeDescriptionCount = 2;
+        state.pVertexAttributeDescriptions = attrs;
     }
 
-    VkResult make_pipeline_layout(VkDevice device, VkPipelineLayout& layout) noexcept override {
-        return ::create_pipeline_layout(device, layout);
+    VkResult make_pipeline_layout(VkDevice _device, VkPipelineLayout& layout) noexcept override {
+        return ::create_pipeline_layout(_device, layout);
     }
 
-    VkResult create_buffer(VkBuffer& buffer, VkBufferCreateInfo& info) const noexcept {
-        return create_vertex_buffer(device, buffer, info, sizeof(input_unit_t) * vertices.size());
+    VkResult create_buffer(VkBuffer& buffer, VkBufferCreateInfo& create_info) const noexcept {
+        return create_vertex_buffer(device, buffer, create_info, sizeof(input_unit_t) * vertices.size());
     }
-    VkResult create_memory(VkBuffer buffer, VkDeviceMemory& memory, const VkBufferCreateInfo& buffer_info,
+    VkResult create_memory(VkBuffer buffer, VkDeviceMemory& _memory, const VkBufferCreateInfo& _buffer_info,
                            VkFlags desired, const VkPhysicalDeviceMemoryProperties& props) const noexcept {
-        return allocate_memory(device, buffer, memory, buffer_info, desired, props);
+        return allocate_memory(device, buffer, _memory, _buffer_info, desired, props);
     }
-    VkResult write_memory(VkBuffer buffer, VkDeviceMemory memory) const noexcept {
+    VkResult write_memory(VkBuffer buffer, VkDeviceMemory _memory) const noexcept {
         constexpr auto offset = 0;
-        if (auto ec = vkBindBufferMemory(device, buffer, memory, offset))
+        if (auto ec = vkBindBufferMemory(device, buffer, _memory, offset))
             return ec;
         VkMemoryRequirements requirements{};
         vkGetBufferMemoryRequirements(device, buffer, &requirements);
-        return update_memory(device, memory, requirements, vertices.data(), offset);
+        return update_memory(device, _memory, requirements, vertices.data(), offset);
     }
 
     void record(VkCommandBuffer command_buffer, VkPipeline pipeline, VkPipelineLayout) noexcept override {
@@ -200,7 +201,7 @@ struct input2_t : vulkan_pipeline_input_t {
         // vertices
         {
             const uint32_t vidx = 0;
-            const uint32_t vbufsize = sizeof(input_unit_t) * vertices.size();
+            const auto vbufsize = static_cast<uint32_t>(sizeof(input_unit_t) * vertices.size());
             if (auto ec = create_vertex_buffer(device, buffers[vidx], //
                                                buffer_info, vbufsize))
                 throw vulkan_exception_t{ec, "vkCreateBuffer"};
@@ -215,7 +216,7 @@ struct input2_t : vulkan_pipeline_input_t {
         // indices
         {
             const uint32_t iidx = 1;
-            const uint32_t ibufsize = sizeof(uint16_t) * indices.size();
+            const auto ibufsize = static_cast<uint32_t>(sizeof(uint16_t) * indices.size());
             if (auto ec = create_index_buffer(device, buffers[iidx], //
                                               buffer_info, ibufsize))
                 throw vulkan_exception_t{ec, "vkCreateBuffer"};
@@ -264,8 +265,8 @@ struct input2_t : vulkan_pipeline_input_t {
         info.pVertexAttributeDescriptions = attrs;
     }
 
-    VkResult make_pipeline_layout(VkDevice device, VkPipelineLayout& layout) noexcept override {
-        return ::create_pipeline_layout(device, layout);
+    VkResult make_pipeline_layout(VkDevice _device, VkPipelineLayout& layout) noexcept override {
+        return ::create_pipeline_layout(_device, layout);
     }
 
     void record(VkCommandBuffer command_buffer, VkPipeline pipeline, VkPipelineLayout) noexcept override {
@@ -314,8 +315,14 @@ struct input3_t : vulkan_pipeline_input_t {
     VkVertexInputBindingDescription desc{};
     VkVertexInputAttributeDescription attrs[2]{};
 
-    VkBuffer buffers[3]{}; // uniform, vertices, indices
-    VkDeviceMemory memories[3]{};
+    static constexpr uint32_t frame_count = 3; // frames in flight
+
+    VkBuffer buffers[2]{}; // vertices, indices
+    std::unique_ptr<vulkan_allocator_t> allocator{};
+    vulkan_allocation_t allocations[2]{}; // sub-allocated from 1 block
+    std::unique_ptr<vulkan_uniform_ring_t> uniforms{};
+    uint32_t frame = 0;
+    uint32_t dynamic_offsets[1]{}; // offset - uniform slot of the current frame
     VkDeviceSize offsets[1]{}; // offset - vertex buffer 0
     vulkan_shader_module_t vert, frag;
 
@@ -326,7 +333,7 @@ struct input3_t : vulkan_pipeline_input_t {
           frag{device, shader_dir / "bypass_frag.spv"} {
         {
             VkDescriptorSetLayoutBinding binding{};
-            binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             binding.descriptorCount = 1;
             binding.binding = 0;
             binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
@@ -339,7 +346,7 @@ struct input3_t : vulkan_pipeline_input_t {
         }
         {
             VkDescriptorPoolSize requirement{};
-            requirement.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            requirement.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             requirement.descriptorCount = 1;
             VkDescriptorPoolCreateInfo info{};
             info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -367,43 +374,57 @@ struct input3_t : vulkan_pipeline_input_t {
     ~input3_t() noexcept {
         vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
         vkDestroyDescriptorSetLayout(device, descriptor_layout, nullptr);
-        for (auto i : {2, 1, 0}) {
-            if (memories[i])
-                vkFreeMemory(device, memories[i], nullptr);
+        uniforms = nullptr;
+        for (auto i : {1, 0}) {
+            if (allocator)
+                allocator->free(allocations[i]);
             if (buffers[i])
                 vkDestroyBuffer(device, buffers[i], nullptr);
         }
     }
 
-    void allocate(const VkPhysicalDeviceMemoryProperties& props) noexcept(false) {
-        const auto desired = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-        VkBufferCreateInfo buffer_info{};
-        VkMemoryRequirements requirements{};
+    /// @param uploader if not nullptr, the vertices/indices are copied to the device local memory
+    void write(uint32_t index, VkBufferUsageFlags usage, gsl::span<const std::byte> data, VkAccessFlags access,
+               vulkan_uploader_t* uploader) noexcept(false) {
+        VkBufferCreateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        info.size = static_cast<VkDeviceSize>(data.size());
+        info.usage = uploader ? usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT : usage;
+        info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (auto ec = vkCreateBuffer(device, &info, nullptr, buffers + index))
+            throw vulkan_exception_t{ec, "vkCreateBuffer"};
+        const auto desired = uploader ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+                                      : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (auto ec = allocator->allocate(buffers[index], desired, allocations[index]))
+            throw vulkan_exception_t{ec, "vkAllocateMemory"};
+        if (uploader == nullptr) {
+            std::memcpy(allocations[index].mapping, data.data(), info.size);
+            return;
+        }
+        if (auto ec = uploader->copy(buffers[index], 0, data, access))
+            throw vulkan_exception_t{ec, "vkCmdCopyBuffer"};
+    }
+
+    void allocate(const VkPhysicalDeviceMemoryProperties& props, vulkan_uploader_t* uploader) noexcept(false) {
+        // the buffers are small. 1 block is enough for all of them
+        allocator = make_unique<vulkan_allocator_t>(device, props, 64 << 10);
         // uniform
         {
             uniform_t ubo{};
             ubo.model = ubo.view = ubo.projection = glm::mat4{1};
             ubo.projection[1][1] *= -1; // GL -> Vulkan
-            if (auto ec = create_uniform_buffer(device, buffers[0], buffer_info, sizeof(uniform_t)))
-                throw vulkan_exception_t{ec, "vkCreateBuffer"};
-            if (auto ec = allocate_memory(device, buffers[0], memories[0], buffer_info, desired, props))
-                throw vulkan_exception_t{ec, "vkAllocateMemory"};
-            if (auto ec = vkBindBufferMemory(device, buffers[0], memories[0], 0))
-                throw vulkan_exception_t{ec, "vkBindBufferMemory"};
-            vkGetBufferMemoryRequirements(device, buffers[0], &requirements);
-            if (auto ec = update_memory(device, memories[0], requirements, &ubo, 0))
-                throw vulkan_exception_t{ec, "vkMapMemory"};
+            uniforms = make_unique<vulkan_uniform_ring_t>(device, *allocator, sizeof(uniform_t), frame_count);
+            for (auto i = 0u; i < frame_count; ++i)
+                dynamic_offsets[0] = uniforms->update(i, &ubo);
             // descriptor set must be updated (before being used with Command Buffer)
-            VkDescriptorBufferInfo change{};
-            change.buffer = buffers[0];
-            change.offset = 0;
-            change.range = sizeof(uniform_t);
+            // the slots share 1 descriptor. `dynamic_offsets` selects the slot
+            const VkDescriptorBufferInfo change = uniforms->get_descriptor();
             VkWriteDescriptorSet write{};
             write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write.dstSet = descriptors[0];
             write.dstBinding = 0;
             write.dstArrayElement = 0; // descriptors can be array
-            write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
             write.descriptorCount = 1;
             write.pBufferInfo = &change;
             vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
@@ -414,31 +435,23 @@ struct input3_t : vulkan_pipeline_input_t {
                                                 {{0.8f, -0.9f}, {0, 1, 0}},
                                                 {{0.8f, 0.9f}, {0, 0, 1}},
                                                 {{-0.8f, 0.9f}, {1, 1, 1}}};
-            if (auto ec = create_vertex_buffer(device, buffers[1], //
-                                               buffer_info, sizeof(input_unit_t) * vertices.size()))
-                throw vulkan_exception_t{ec, "vkCreateBuffer"};
-            if (auto ec = allocate_memory(device, buffers[1], memories[1], buffer_info, desired, props))
-                throw vulkan_exception_t{ec, "vkAllocateMemory"};
-            if (auto ec = vkBindBufferMemory(device, buffers[1], memories[1], 0))
-                throw vulkan_exception_t{ec, "vkBindBufferMemory"};
-            vkGetBufferMemoryRequirements(device, buffers[1], &requirements);
-            if (auto ec = update_memory(device, memories[1], requirements, vertices.data(), 0))
-                throw vulkan_exception_t{ec, "vkMapMemory"};
+            write(0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, gsl::as_bytes(gsl::make_span(vertices)),
+                  VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, uploader);
         }
         // indices
         {
             const vector<uint16_t> indices{0, 1, 2, 2, 3, 0};
-            if (auto ec = create_index_buffer(device, buffers[2], //
-                                              buffer_info, sizeof(uint16_t) * indices.size()))
-                throw vulkan_exception_t{ec, "vkCreateBuffer"};
-            if (auto ec = allocate_memory(device, buffers[2], memories[2], buffer_info, desired, props))
-                throw vulkan_exception_t{ec, "vkAllocateMemory"};
-            if (auto ec = vkBindBufferMemory(device, buffers[2], memories[2], 0))
-                throw vulkan_exception_t{ec, "vkBindBufferMemory"};
-            vkGetBufferMemoryRequirements(device, buffers[2], &requirements);
-            if (auto ec = update_memory(device, memories[2], requirements, indices.data(), 0))
-                throw vulkan_exception_t{ec, "vkMapMemory"};
+            write(1, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, gsl::as_bytes(gsl::make_span(indices)),
+                  VK_ACCESS_INDEX_READ_BIT, uploader);
         }
+        if (uploader == nullptr)
+            return;
+        // loading time. wait here, so the caller doesn't have to wait the `timeline`
+        uint64_t value = 0;
+        if (auto ec = uploader->submit(value, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT))
+            throw vulkan_exception_t{ec, "vkQueueSubmit"};
+        if (auto ec = uploader->wait(value))
+            throw vulkan_exception_t{ec, "vkWaitSemaphores"};
     }
 
     void setup_shader_stage(VkPipelineShaderStageCreateInfo (&stage)[2]) noexcept(false) override {
@@ -476,14 +489,14 @@ struct input3_t : vulkan_pipeline_input_t {
         info.pVertexAttributeDescriptions = attrs;
     }
 
-    VkResult make_pipeline_layout(VkDevice device, VkPipelineLayout& layout) noexcept override {
+    VkResult make_pipeline_layout(VkDevice _device, VkPipelineLayout& layout) noexcept override {
         VkPipelineLayoutCreateInfo info{};
         info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         info.setLayoutCount = 1;
         info.pSetLayouts = &descriptor_layout;
         info.pushConstantRangeCount = 0;
         info.pPushConstantRanges = nullptr;
-        return vkCreatePipelineLayout(device, &info, nullptr, &layout);
+        return vkCreatePipelineLayout(_device, &info, nullptr, &layout);
     }
 
     VkResult update() noexcept override {
@@ -495,24 +508,8 @@ struct input3_t : vulkan_pipeline_input_t {
         ubo.projection = glm::perspective(glm::radians(45.0f), 1.0f / 1, 0.1f, 10.0f);
         // ubo.projection[1][1] *= -1; // GL -> Vulkan
 
-        VkMemoryRequirements requirements{};
-        vkGetBufferMemoryRequirements(device, buffers[0], &requirements);
-        if (auto ec = update_memory(device, memories[0], requirements, &ubo, 0))
-            return ec;
-
-        VkDescriptorBufferInfo change{};
-        change.buffer = buffers[0];
-        change.offset = 0;
-        change.range = sizeof(uniform_t);
-        VkWriteDescriptorSet write{};
-        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        write.dstSet = descriptors[0];
-        write.dstBinding = 0;
-        write.dstArrayElement = 0; // descriptors can be array
-        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        write.descriptorCount = 1;
-        write.pBufferInfo = &change;
-        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+        // persistently mapped and coherent. no vkMapMemory/vkUnmapMemory, no descriptor update
+        dynamic_offsets[0] = uniforms->update(frame++, &ubo);
         return VK_SUCCESS;
     }
 
@@ -522,15 +519,15 @@ struct input3_t : vulkan_pipeline_input_t {
         auto binding = 0u;
         vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                                 pipeline_layout, //
-                                binding, 1, descriptors, 0, nullptr);
+                                binding, 1, descriptors, 1, dynamic_offsets);
         // ...
         auto location = 0u;
         constexpr auto binding_count = 1;
         vkCmdBindVertexBuffers(command_buffer, //
-                               location, binding_count, buffers + 1, offsets);
+                               location, binding_count, buffers + 0, offsets);
         constexpr auto index_offset = 0;
         vkCmdBindIndexBuffer(command_buffer, //
-                             buffers[2], index_offset, VK_INDEX_TYPE_UINT16);
+                             buffers[1], index_offset, VK_INDEX_TYPE_UINT16);
         constexpr auto num_instance = 1;
         constexpr auto first_index = 0;
         constexpr auto vertex_offset = 0;
@@ -543,12 +540,19 @@ struct input3_t : vulkan_pipeline_input_t {
 auto make_pipeline_input_3(VkDevice device, const VkPhysicalDeviceMemoryProperties& props,
                            const fs::path& shader_dir) noexcept(false) -> unique_ptr<vulkan_pipeline_input_t> {
     auto impl = make_unique<input3_t>(device, shader_dir);
-    impl->allocate(props);
+    impl->allocate(props, nullptr);
+    return impl;
+}
+
+auto make_pipeline_input_3(VkDevice device, const VkPhysicalDeviceMemoryProperties& props,
+                           const fs::path& shader_dir, vulkan_uploader_t& uploader) noexcept(false)
+    -> unique_ptr<vulkan_pipeline_input_t> {
+    auto impl = make_unique<input3_t>(device, shader_dir);
+    impl->allocate(props, &uploader);
     return impl;
 }
 
-auto make_pipeline_input_4(VkDevice device, const VkPhysicalDeviceMemoryProperties& props,
-                           const fs::path& shader_dir) noexcept(false) -> std::unique_ptr<vulkan_pipeline_input2_t> {
+auto make_pipeline_input_4(VkDevice, const VkPhysicalDeviceMemoryProperties&, const fs::path&) noexcept(false)
+    -> std::unique_ptr<vulkan_pipeline_input2_t> {
     throw std::runtime_error{"not implemented"};
-    return nullptr;
 }
@@ -3,18 +3,24 @@
  * @see     https://gpuopen.com/learn/understanding-vulkan-objects/
  */
 #pragma once
+#include <atomic>
+#include <condition_variable>
 #include <filesystem>
 #include <gsl/gsl>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 #include <vulkan/vulkan.h>
 
+#include "worker_pool.h"
+
 namespace fs = std::filesystem;
 
 auto open(const fs::path& p) -> std::unique_ptr<FILE, int (*)(FILE*)>;
 auto create(const fs::path& p) -> std::unique_ptr<FILE, int (*)(FILE*)>;
 auto read(FILE* stream, size_t& rsz) -> std::unique_ptr<std::byte[]>;
-auto read_all(const fs::path& p, size_t& fsize) -> std::unique_ptr<std::byte[]>;
+auto read_all(const fs::path& p, size_t& fsize) -> std::unique_ptr<std::byte[], void (*)(void*)>;
 
 class stop_watch_t final {
     clock_t begin = clock(); // <time.h>
@@ -33,7 +39,7 @@ class stop_watch_t final {
     }
 };
 
-static void sleep_for_fps(stop_watch_t& timer, uint32_t hz) noexcept {
+inline void sleep_for_fps(stop_watch_t& timer, uint32_t hz) noexcept {
     const std::chrono::milliseconds time_per_frame{1000 / hz};
     const std::chrono::milliseconds elapsed{static_cast<uint32_t>(timer.reset() * 1000)};
     if (elapsed < time_per_frame) {
@@ -71,12 +77,22 @@ VkResult get_physical_device(VkInstance instance, VkPhysicalDevice& physical_dev
 
 uint32_t get_graphics_queue_available(VkQueueFamilyProperties* properties, uint32_t count) noexcept;
 
+/**
+ * @brief find the transfer-only queue family(usually the DMA engine)
+ * @return uint32_t `UINT32_MAX` if there is no such family. Any graphics/compute family can transfer in the case
+ */
+uint32_t get_transfer_queue_available(VkQueueFamilyProperties* properties, uint32_t count) noexcept;
+
+/// @see https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkPhysicalDeviceTimelineSemaphoreFeatures.html
+bool is_timeline_semaphore_supported(VkPhysicalDevice physical_device) noexcept;
+
 uint32_t get_surface_support(VkPhysicalDevice device, VkSurfaceKHR surface, uint32_t count,
                              uint32_t exclude_index) noexcept;
 
 /**
  * @brief create 1 device with 1 queue(GFX) information
  * 
+ * @note  `timelineSemaphore` is enabled if supported
  * @return VkResult `VK_SUCCESS` if everything was successful
  */
 VkResult create_device(VkPhysicalDevice physical_device, //
@@ -90,6 +106,7 @@ VkResult check_present_mode(VkPhysicalDevice device, VkSurfaceKHR surface, const
 /**
  * @brief create 1 device with 2 queue(GFX, Present) information
  * 
+ * @note  `timelineSemaphore` is enabled if supported
  * @param queues queue information. 0 is for graphics, 1 is for presentation
  * @return VkResult `VK_SUCCESS` if everything was successful
  */
@@ -107,9 +124,37 @@ VkResult check_support(VkPhysicalDevice device, VkSurfaceKHR surface, //
                        VkFormat surface_format, VkColorSpaceKHR surface_color_space,
                        VkPresentModeKHR present_mode) noexcept;
 
+struct vulkan_queue_t final {
+    VkQueue handle = VK_NULL_HANDLE;
+    uint32_t family = UINT32_MAX;
+    uint32_t index = 0; // index in the family
+};
+
+/**
+ * @brief The queues of `create_device` by their roles.
+ *        `transfer` is from the transfer-only family(DMA engine) and `compute` is from the compute family without
+ *        graphics(async compute) when the device has them. Otherwise they are another queue of the graphics family.
+ *        When the family has no more queue, the roles share 1 `VkQueue`.
+ *
+ * @note  The submissions to the shared `VkQueue` must be synchronized by the caller
+ */
+struct vulkan_queue_set_t final {
+    vulkan_queue_t graphics{};
+    vulkan_queue_t present{};  // same with the `graphics` if the family supports the surfaces
+    vulkan_queue_t transfer{}; // the `vulkan_uploader_t` can use this
+    vulkan_queue_t compute{};
+};
+
 /**
- * @todo Create a new `VkDevice` with GFX, Present, Transfer queue
+ * @brief create 1 device with the graphics, present, transfer, compute queues.
+ *        The priority is graphics/present > compute > transfer.
+ *
+ * @note  `timelineSemaphore` is enabled if supported. `VK_KHR_swapchain` is enabled if `surface_count` is not 0
+ * @return VkResult `VK_ERROR_FEATURE_NOT_PRESENT` if no family can do the graphics or the presentation
  */
+VkResult create_device(VkPhysicalDevice physical_device,                     //
+                       const VkSurfaceKHR* surfaces, uint32_t surface_count, //
+                       VkDevice& device, vulkan_queue_set_t& queues) noexcept;
 
 VkResult create_uniform_buffer(VkDevice device, VkBuffer& buffer, VkBufferCreateInfo& info,
                                VkDeviceSize buflen) noexcept;
@@ -117,13 +162,74 @@ VkResult create_vertex_buffer(VkDevice device, VkBuffer& buffer, VkBufferCreateI
                               VkDeviceSize buflen) noexcept;
 VkResult create_index_buffer(VkDevice device, VkBuffer& buffer, VkBufferCreateInfo& info, VkDeviceSize buflen) noexcept;
 
+/**
+ * @brief Score the memory types for the `required` + `preferred` flags and return the best one.
+ *        The flags that are not asked are penalized. For example, the `DEVICE_LOCAL|HOST_VISIBLE`(ReBAR) type is
+ *        kept for the ones who prefer it, and the write-only uploads avoid `HOST_CACHED`.
+ *
+ * @return uint32_t `UINT32_MAX` if no type matches with the `type_bits` and the `required`
+ * @see   vulkan_memory_selector_t for the cached version
+ */
+uint32_t get_memory_type(const VkPhysicalDeviceMemoryProperties& props, uint32_t type_bits,
+                         VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) noexcept;
+
+/**
+ * @brief Ranking of the memory types per (required, preferred) flags, built once per `VkPhysicalDevice`.
+ *        When `VK_EXT_memory_budget` is supported, the heaps near their budget are ranked lower.
+ *        `update_budget` refreshes the budget and drops the rankings.
+ *
+ * @note  Thread-safe
+ * @see   https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkPhysicalDeviceMemoryBudgetPropertiesEXT.html
+ */
+class vulkan_memory_selector_t final {
+  public:
+    struct ranking_t final {
+        uint32_t count = 0;
+        uint32_t types[VK_MAX_MEMORY_TYPES]{}; // the best is first
+    };
+
+  private:
+    VkPhysicalDeviceMemoryProperties props{};
+    VkDeviceSize budgets[VK_MAX_MEMORY_HEAPS]{}; // available bytes of the heap. `heapBudget - heapUsage`
+    bool has_budget = false;
+    mutable std::mutex mtx{};
+    mutable uint64_t keys[16]{}; // required << 32 | preferred. 0 for the empty slot
+    mutable ranking_t rankings[16]{};
+    mutable uint32_t next = 0; // the slot to replace when all slots are used
+
+  private:
+    void make_ranking(VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                      ranking_t& ranking) const noexcept;
+
+  public:
+    explicit vulkan_memory_selector_t(VkPhysicalDevice physical_device) noexcept(false);
+    explicit vulkan_memory_selector_t(const VkPhysicalDeviceMemoryProperties& props) noexcept(false);
+    vulkan_memory_selector_t(const vulkan_memory_selector_t&) = delete;
+    vulkan_memory_selector_t(vulkan_memory_selector_t&&) = delete;
+    vulkan_memory_selector_t& operator=(const vulkan_memory_selector_t&) = delete;
+    vulkan_memory_selector_t& operator=(vulkan_memory_selector_t&&) = delete;
+
+    /// @return uint32_t `UINT32_MAX` if no type matches
+    uint32_t select(uint32_t type_bits, VkMemoryPropertyFlags required,
+                    VkMemoryPropertyFlags preferred = 0) const noexcept;
+    /// @brief the candidates in the order of preference. Use the next one when the heap is full
+    ranking_t get_ranking(VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred = 0) const noexcept;
+    void update_budget(VkPhysicalDevice physical_device) noexcept;
+
+    /// @note returns a copy. `update_budget` may replace the properties in the other thread
+    VkPhysicalDeviceMemoryProperties get_properties() const noexcept;
+};
+
 VkResult allocate_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory& memory,
                          const VkBufferCreateInfo& buffer_info, VkFlags desired,
                          const VkPhysicalDeviceMemoryProperties& props) noexcept;
+VkResult allocate_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory& memory, VkFlags desired,
+                         const vulkan_memory_selector_t& selector) noexcept;
 
-/// @todo https://vulkan-tutorial.com/en/Vertex_buffers/Staging_buffer
+/// @see vulkan_uploader_t for the staging buffer
 /// @see vkBindBufferMemory
 /// @see vkMapMemory
+/// @note maps and unmaps for each call. `vulkan_uniform_ring_t` for the per-frame updates
 VkResult update_memory(VkDevice device, VkDeviceMemory memory,
                        const VkMemoryRequirements& requirements, //
                        const void* data, uint32_t offset = 0) noexcept;
@@ -132,6 +238,221 @@ VkResult update_memory(VkDevice device, VkDeviceMemory memory,
 [[deprecated]] VkResult write_memory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory,
                                      const void* data) noexcept;
 
+/**
+ * @brief Sub-allocation from the `vulkan_allocator_t`. Bind the resource with the `memory` and the `offset`
+ */
+struct vulkan_allocation_t final {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;   // requested size
+    void* mapping = nullptr; // persistently mapped pointer at the `offset`. nullptr if not host visible
+    uint32_t memory_type = UINT32_MAX;
+    uint32_t block = UINT32_MAX; // index in the pool. `dedicated` for the memory owned alone
+    uint16_t pool = 0;
+    uint16_t order = 0; // log2 of the buddy size
+
+    static constexpr uint32_t dedicated = UINT32_MAX - 1;
+};
+
+struct vulkan_memory_stats_t final {
+    VkDeviceSize reserved = 0;     // sum of the `vkAllocateMemory`
+    VkDeviceSize allocated = 0;    // reserved for the allocations. includes the round up of the buddy
+    VkDeviceSize used = 0;         // sum of the requested size
+    VkDeviceSize largest_free = 0; // the largest free range in the blocks
+    uint32_t block_count = 0;
+    uint32_t dedicated_count = 0;
+    uint32_t allocation_count = 0;
+    /// @brief 1 - largest_free / (free in the blocks). 0 if the free space is contiguous
+    float fragmentation = 0;
+};
+
+/**
+ * @brief Per-memory-type pools of `VkDeviceMemory` blocks with the buddy sub-allocator.
+ *        The linear(buffer) and optimal(image) resources use different pools,
+ *        so `bufferImageGranularity` is never a concern.
+ *        The large requests and `prefersDedicatedAllocation` resources get their own `VkDeviceMemory`.
+ *        Host visible blocks are mapped once and stay mapped.
+ *        The memory types are tried in the order of the `vulkan_memory_selector_t`.
+ *
+ * @note  Thread-safe
+ * @see   https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/VkMemoryDedicatedRequirements.html
+ */
+class vulkan_allocator_t final {
+  public:
+    static constexpr VkDeviceSize min_size = 256;
+
+  private:
+    struct block_t;
+    struct pool_t;
+    const VkDevice device;
+    const VkPhysicalDevice physical_device;
+    vulkan_memory_selector_t selector;
+    VkDeviceSize block_size;
+    std::unique_ptr<pool_t[]> pools;
+    mutable std::mutex mtx{};
+    VkDeviceSize dedicated_size = 0;
+    uint32_t dedicated_count = 0;
+
+  private:
+    VkResult allocate_block(pool_t& pool, uint32_t memory_type, uint32_t& index) noexcept;
+    VkResult allocate_dedicated(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags desired,
+                                VkBuffer buffer, VkImage image, vulkan_allocation_t& allocation) noexcept;
+
+  public:
+    /**
+     * @param physical_device the memory types and the heap budgets(`VK_EXT_memory_budget`) are from it
+     * @param block_size      rounded up to the power of 2. The requests larger than the half of it are dedicated
+     */
+    vulkan_allocator_t(VkDevice device, VkPhysicalDevice physical_device,
+                       VkDeviceSize block_size = 64 << 20) noexcept(false);
+    /// @note without the `VkPhysicalDevice`, the heap budgets are unknown and `update_budget` does nothing
+    vulkan_allocator_t(VkDevice device, const VkPhysicalDeviceMemoryProperties& props,
+                       VkDeviceSize block_size = 64 << 20) noexcept(false);
+    ~vulkan_allocator_t() noexcept;
+    vulkan_allocator_t(const vulkan_allocator_t&) = delete;
+    vulkan_allocator_t(vulkan_allocator_t&&) = delete;
+    vulkan_allocator_t& operator=(const vulkan_allocator_t&) = delete;
+    vulkan_allocator_t& operator=(vulkan_allocator_t&&) = delete;
+
+    /**
+     * @param linear    true for the buffers and `VK_IMAGE_TILING_LINEAR` images
+     * @return VkResult `VK_ERROR_OUT_OF_DEVICE_MEMORY` if no memory type matches with the `desired`
+     */
+    VkResult allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags desired, bool linear,
+                      vulkan_allocation_t& allocation) noexcept;
+    /// @brief allocate and `vkBindBufferMemory`
+    VkResult allocate(VkBuffer buffer, VkMemoryPropertyFlags desired, vulkan_allocation_t& allocation) noexcept;
+    /// @brief allocate and `vkBindImageMemory`. Assume `VK_IMAGE_TILING_OPTIMAL`
+    VkResult allocate(VkImage image, VkMemoryPropertyFlags desired, vulkan_allocation_t& allocation) noexcept;
+    /// @note the `allocation` is reset
+    void free(vulkan_allocation_t& allocation) noexcept;
+
+    vulkan_memory_stats_t get_stats() const noexcept;
+    /// @brief refresh the heap budgets of the memory type selection. Once in a while(each frame, etc.) is enough
+    void update_budget() noexcept;
+};
+
+/**
+ * @brief Persistently mapped uniform buffer with 1 slot per frame in flight.
+ *        Write the descriptor(`VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC`) once,
+ *        then each frame is 1 `memcpy` and the dynamic offset for `vkCmdBindDescriptorSets`.
+ *
+ * @note  The slot must not be written while the GPU reads it. `count` must not be less than the frames in flight
+ */
+class vulkan_uniform_ring_t final {
+  public:
+    /// @brief the largest `minUniformBufferOffsetAlignment` in the spec
+    static constexpr VkDeviceSize max_alignment = 256;
+
+  private:
+    vulkan_allocator_t& allocator;
+    vulkan_allocation_t allocation{};
+
+  public:
+    const VkDevice device;
+    VkBuffer handle{};
+    const VkDeviceSize size;   // range of 1 slot
+    const VkDeviceSize stride; // distance between the slots
+    const uint32_t count;
+
+  public:
+    /**
+     * @param alignment `VkPhysicalDeviceLimits::minUniformBufferOffsetAlignment`
+     */
+    vulkan_uniform_ring_t(VkDevice device, vulkan_allocator_t& allocator, VkDeviceSize size, uint32_t count,
+                          VkDeviceSize alignment = max_alignment) noexcept(false);
+    ~vulkan_uniform_ring_t() noexcept;
+    vulkan_uniform_ring_t(const vulkan_uniform_ring_t&) = delete;
+    vulkan_uniform_ring_t(vulkan_uniform_ring_t&&) = delete;
+    vulkan_uniform_ring_t& operator=(const vulkan_uniform_ring_t&) = delete;
+    vulkan_uniform_ring_t& operator=(vulkan_uniform_ring_t&&) = delete;
+
+    /**
+     * @brief copy the `size` bytes of the `data` to the slot of the `frame`
+     * @return uint32_t the dynamic offset of the slot
+     */
+    uint32_t update(uint32_t frame, const void* data) noexcept;
+    VkDescriptorBufferInfo get_descriptor() const noexcept;
+};
+
+/**
+ * @brief Copy to the device local buffers through the persistently mapped staging ring.
+ *        The copies are batched in 1 command buffer until `submit`. Each batch signals the `timeline` semaphore.
+ *        If the transfer family is different from the destination family,
+ *        the buffers are released on the transfer queue and acquired on the destination queue.
+ *        The acquire submission waits the transfer on the GPU, so the host doesn't stall.
+ *
+ * @note  The device must enable `timelineSemaphore`. Not thread-safe.
+ *        The `queue`(destination) must not be used by other threads during `submit`
+ * @see   https://www.khronos.org/registry/vulkan/specs/1.2-extensions/html/vkspec.html#synchronization-queue-transfers
+ */
+class vulkan_uploader_t final {
+  private:
+    struct batch_t final {
+        VkCommandBuffer transfer = VK_NULL_HANDLE;
+        VkCommandBuffer acquire = VK_NULL_HANDLE; // recorded only when the families are different
+        uint64_t value = 0;                       // the batch is done when `timeline` reaches this
+        VkDeviceSize size = 0;                    // used bytes of the staging ring. includes the wrap-around
+    };
+
+    vulkan_allocator_t& allocator;
+    vulkan_allocation_t allocation{};
+    VkBuffer staging{};
+    VkCommandPool pools[2]{}; // transfer, acquire
+    std::vector<VkCommandBuffer> idle[2]{};
+    std::vector<batch_t> batches{}; // in-flight. the oldest is first
+    batch_t current{};
+    std::vector<VkBufferMemoryBarrier> acquires{};
+    VkDeviceSize head = 0; // next write position in the staging ring
+    VkDeviceSize used = 0;
+
+  public:
+    const VkDevice device;
+    const VkDeviceSize capacity;
+    const VkQueue transfer_queue;
+    const uint32_t transfer_family;
+    const VkQueue queue;
+    const uint32_t family;
+    VkSemaphore timeline{};
+    uint64_t submitted = 0; // the last value to be signaled
+
+  private:
+    VkResult reclaim(bool wait) noexcept;
+    VkResult reserve(VkDeviceSize size, VkDeviceSize& offset) noexcept;
+    VkResult begin(uint32_t index, VkCommandBuffer& commands) noexcept;
+
+  public:
+    /**
+     * @param transfer_family `get_transfer_queue_available` or same with the `family`
+     * @param queue           the queue which will use the buffers
+     * @param capacity        size of the staging ring
+     */
+    vulkan_uploader_t(VkDevice device, vulkan_allocator_t& allocator, VkQueue transfer_queue,
+                      uint32_t transfer_family, VkQueue queue, uint32_t family,
+                      VkDeviceSize capacity = 8 << 20) noexcept(false);
+    ~vulkan_uploader_t() noexcept;
+    vulkan_uploader_t(const vulkan_uploader_t&) = delete;
+    vulkan_uploader_t(vulkan_uploader_t&&) = delete;
+    vulkan_uploader_t& operator=(const vulkan_uploader_t&) = delete;
+    vulkan_uploader_t& operator=(vulkan_uploader_t&&) = delete;
+
+    /**
+     * @brief stage the `data` and record the copy to the `buffer`.
+     *        The large data is split into the chunks. The batch may be submitted to make room in the staging ring
+     *
+     * @param buffer  created with `VK_BUFFER_USAGE_TRANSFER_DST_BIT` and `VK_SHARING_MODE_EXCLUSIVE`
+     * @param access  how the destination queue will access the `buffer`. `VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT` ...
+     */
+    VkResult copy(VkBuffer buffer, VkDeviceSize offset, gsl::span<const std::byte> data,
+                  VkAccessFlags access) noexcept;
+    /**
+     * @param value   the `timeline` value to wait before using the buffers
+     * @param stage   the first stage of the destination queue which uses the buffers
+     */
+    VkResult submit(uint64_t& value, VkPipelineStageFlags stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT) noexcept;
+    VkResult wait(uint64_t value, uint64_t timeout = UINT64_MAX) noexcept;
+};
+
 /**
  * @brief   VkRenderPass + RAII
  * @note    currently only 1 subpass
@@ -177,6 +498,11 @@ auto make_pipeline_input_2(VkDevice device,
 auto make_pipeline_input_3(VkDevice device,
                            const VkPhysicalDeviceMemoryProperties& props, //
                            const fs::path& shader_dir) noexcept(false) -> std::unique_ptr<vulkan_pipeline_input_t>;
+/// @brief the vertices and the indices are in the device local memory
+auto make_pipeline_input_3(VkDevice device,
+                           const VkPhysicalDeviceMemoryProperties& props, //
+                           const fs::path& shader_dir,                    //
+                           vulkan_uploader_t& uploader) noexcept(false) -> std::unique_ptr<vulkan_pipeline_input_t>;
 
 class vulkan_pipeline_input2_t : public vulkan_pipeline_input_t {
   public:
@@ -234,6 +560,8 @@ class vulkan_shader_module_t final {
 
   public:
     vulkan_shader_module_t(VkDevice _device, const fs::path fpath) noexcept(false);
+    /// @param code  SPIR-V. For example, an entry of the `asset_archive_t`
+    vulkan_shader_module_t(VkDevice _device, gsl::span<const std::byte> code) noexcept(false);
     ~vulkan_shader_module_t() noexcept;
 };
 
@@ -298,7 +626,8 @@ class vulkan_fence_t final {
     VkFence handle{};
 
   public:
-    vulkan_fence_t(VkDevice _device) noexcept(false);
+    /// @param flags  `VK_FENCE_CREATE_SIGNALED_BIT` if the first wait must not block
+    vulkan_fence_t(VkDevice _device, VkFenceCreateFlags flags = 0) noexcept(false);
     ~vulkan_fence_t() noexcept;
 };
 
@@ -310,13 +639,171 @@ VkResult present_submit(VkQueue queue,                                  //
                         uint32_t image_index, VkSwapchainKHR swapchain, //
                         VkSemaphore wait) noexcept;
 
+/**
+ * @brief Frames in flight. The CPU records the frame N+1 while the GPU executes the frame N
+ * @details Each frame owns a command pool, a fence and the image-available/render-finished semaphores.
+ *          `begin` waits for the fence of the frame (submitted `count` frames before), acquires the swapchain image,
+ *          and resets the command pool. `end` submits the command buffer and requests the presentation.
+ * @note    The per-frame resources (uniform data, etc.) must be updated after `begin`.
+ *          Create a new one if the swapchain is recreated
+ * @code
+ * vulkan_frame_scheduler_t scheduler{device, graphics_family, 2, presentation.num_images};
+ * VkCommandBuffer commands{};
+ * uint32_t image_index{};
+ * if (auto ec = scheduler.begin(swapchain, image_index, commands)) // VK_SUBOPTIMAL_KHR, VK_ERROR_OUT_OF_DATE_KHR
+ *     return ec;
+ * {
+ *     vulkan_command_recorder_t recorder{commands, renderpass, framebuffers[image_index], extent};
+ *     // ...
+ * }
+ * if (auto ec = scheduler.end(graphics_queue, present_queue, swapchain))
+ *     return ec;
+ * @endcode
+ */
+class vulkan_frame_scheduler_t final {
+    struct frame_t final {
+        vulkan_command_pool_t pool;
+        vulkan_semaphore_t image_available;
+        vulkan_semaphore_t render_finished;
+        vulkan_fence_t fence; // signaled when the GPU finished the frame
+
+        frame_t(VkDevice device, uint32_t queue_family) noexcept(false);
+    };
+
+  public:
+    const VkDevice device{};
+    const uint32_t count{}; // frames in flight
+
+  private:
+    std::vector<std::unique_ptr<frame_t>> frames{};
+    std::unique_ptr<VkFence[]> image_fences{}; // the fence of the frame which is using the swapchain image
+    uint32_t num_images = 0;
+    uint64_t current = 0;
+    uint32_t image_index = UINT32_MAX;
+
+    /// @brief replace the `image_available` which is signaled by the acquire, but no submit will wait for it
+    VkResult renew_semaphore(frame_t& frame) noexcept;
+    /// @brief replace the fence which is reset, but no submit will signal it. The new one is signaled
+    VkResult renew_fence(frame_t& frame) noexcept;
+
+  public:
+    /**
+     * @param queue_family  the command pools are created for the family. Must be same with the graphics queue
+     * @param _count        frames in flight. 2 or 3 is recommended
+     * @param _num_images   `vulkan_presentation_t::num_images`
+     */
+    vulkan_frame_scheduler_t(VkDevice _device, uint32_t queue_family, uint32_t _count,
+                             uint32_t _num_images) noexcept(false);
+    /// @note waits all frames in flight
+    ~vulkan_frame_scheduler_t() noexcept;
+    vulkan_frame_scheduler_t(const vulkan_frame_scheduler_t&) = delete;
+    vulkan_frame_scheduler_t(vulkan_frame_scheduler_t&&) = delete;
+    vulkan_frame_scheduler_t& operator=(const vulkan_frame_scheduler_t&) = delete;
+    vulkan_frame_scheduler_t& operator=(vulkan_frame_scheduler_t&&) = delete;
+
+    /**
+     * @param image_index  the acquired swapchain image
+     * @param commands     the primary command buffer of the frame. It's not begun yet
+     * @return `VK_SUBOPTIMAL_KHR` can be returned with the acquired image. The caller must continue with `end`.
+     *         For the other errors after the acquire, the frame is restored and the caller must not call `end`
+     */
+    VkResult begin(VkSwapchainKHR swapchain, uint32_t& image_index, VkCommandBuffer& commands) noexcept;
+    /**
+     * @brief submit the command buffer of the frame and request the presentation
+     * @return result of the `vkQueuePresentKHR` if the submit was successful.
+     *         If the submit failed, the frame is restored so `wait` and the next `begin` don't block forever
+     */
+    VkResult end(VkQueue graphics, VkQueue present, VkSwapchainKHR swapchain) noexcept;
+    /// @brief wait for the all frames in flight. Before the swapchain recreation, etc.
+    VkResult wait(uint64_t timeout = UINT64_MAX) noexcept;
+
+    /// @return index of the current frame in [0, count). Useful for the per-frame resources
+    uint32_t get_frame_index() const noexcept;
+};
+
 class vulkan_command_recorder_t final {
   public:
     VkCommandBuffer commands;
     VkClearValue clear;
 
   public:
+    /// @param contents  `VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS` for `vulkan_parallel_recorder_t`
     vulkan_command_recorder_t(VkCommandBuffer command_buffer, //
-                              VkRenderPass renderpass, VkFramebuffer framebuffer, VkExtent2D extent) noexcept(false);
+                              VkRenderPass renderpass, VkFramebuffer framebuffer, VkExtent2D extent,
+                              VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE) noexcept(false);
     ~vulkan_command_recorder_t() noexcept(false);
 };
+
+/**
+ * @brief Record the draws `[begin, end)` of the draw list to the secondary command buffer.
+ *        The buffer is already begun with the `VkCommandBufferInheritanceInfo`. Invoked in the multiple threads
+ */
+using vulkan_draw_callback_t = void (*)(void* user_data, VkCommandBuffer commands, uint32_t begin, uint32_t end);
+
+/**
+ * @brief Record the draw list with the multiple threads. The primary buffer executes the secondary buffers.
+ * @details Each worker owns 1 VkCommandPool for each frame in flight, so the pools are never shared.
+ *          The draw list is split into the chunks and each worker takes a contiguous range of them.
+ *          A worker which finished its range steals the chunks from the back of the others.
+ *          The calling thread of `record` works as the worker 0. The others are the tasks of the `worker_pool_t`
+ * @note  `record` is not thread-safe
+ * @see   https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/vkCmdExecuteCommands.html
+ */
+class vulkan_parallel_recorder_t final {
+    struct worker_t;
+    struct job_t final {
+        uint32_t frame;
+        VkCommandBufferInheritanceInfo inheritance;
+        uint32_t draw_count;
+        uint32_t chunk;
+        vulkan_draw_callback_t callback;
+        void* user_data;
+    };
+
+  public:
+    const VkDevice device{};
+    const uint32_t frame_count{};
+
+  private:
+    std::vector<std::unique_ptr<worker_t>> workers{};
+    worker_pool_t pool; // runs the `work` of the workers except 0
+    std::mutex mtx{};
+    std::condition_variable done{}; // all tasks finished the job
+    uint32_t active = 0;            // number of the tasks in the job
+    job_t job{};
+    std::vector<VkCommandBuffer> secondaries{}; // results of the job in the chunk order
+    std::atomic<VkResult> result{VK_SUCCESS};
+
+  public:
+    /**
+     * @param queue_family  the family of the queue which will execute the primary command buffer
+     * @param thread_count  number of the recording threads including the caller. `std::thread::hardware_concurrency`
+     * @param _frame_count  frames in flight. The pools of a frame are reset in the next `record` of the frame
+     */
+    vulkan_parallel_recorder_t(VkDevice _device, uint32_t queue_family, uint32_t thread_count,
+                               uint32_t _frame_count = 2) noexcept(false);
+    ~vulkan_parallel_recorder_t() noexcept;
+    vulkan_parallel_recorder_t(const vulkan_parallel_recorder_t&) = delete;
+    vulkan_parallel_recorder_t(vulkan_parallel_recorder_t&&) = delete;
+    vulkan_parallel_recorder_t& operator=(const vulkan_parallel_recorder_t&) = delete;
+    vulkan_parallel_recorder_t& operator=(vulkan_parallel_recorder_t&&) = delete;
+
+    /**
+     * @brief Record the draws to the secondary command buffers, then `vkCmdExecuteCommands` in the `primary`
+     * @param primary   must be in the render pass which begun with `VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS`
+     * @param frame     index of the frame in flight. The GPU must be done with the previous submit of the frame
+     * @param inheritance  `renderPass`, `subpass` and `framebuffer` of the `primary`
+     * @param chunk     number of the draws for each secondary command buffer
+     * @return VkResult the first error from the threads. VK_ERROR_UNKNOWN for the invalid `frame` or `chunk`
+     */
+    VkResult record(VkCommandBuffer primary, uint32_t frame, const VkCommandBufferInheritanceInfo& inheritance,
+                    uint32_t draw_count, uint32_t chunk, vulkan_draw_callback_t callback, void* user_data) noexcept;
+
+    uint32_t size() const noexcept;
+
+  private:
+    void work(uint32_t index) noexcept;
+    void leave() noexcept;
+    VkResult record_chunk(worker_t& worker, uint32_t index) noexcept;
+    void close() noexcept;
+};
@@ -0,0 +1,484 @@
+#include "vulkan_1.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <set>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief `VkDeviceMemory` with the buddy free lists. `free_lists[k]` holds the offsets of the free 2^k ranges
+ */
+struct vulkan_allocator_t::block_t final {
+    VkDeviceMemory memory{};
+    std::byte* mapping = nullptr;
+    vector<set<VkDeviceSize>> free_lists{};
+    VkDeviceSize allocated = 0;
+    VkDeviceSize used = 0;
+    uint32_t count = 0;
+
+    /// @return UINT64_MAX if there is no room
+    VkDeviceSize acquire(uint16_t order) noexcept {
+        auto k = order;
+        while (k < free_lists.size() && free_lists[k].empty())
+            ++k;
+        if (k == free_lists.size())
+            return UINT64_MAX;
+        const auto offset = *free_lists[k].begin();
+        free_lists[k].erase(free_lists[k].begin());
+        // split until the requested order. the upper halves become free
+        while (k > order) {
+            --k;
+            free_lists[k].emplace(offset + (VkDeviceSize{1} << k));
+        }
+        return offset;
+    }
+
+    void release(VkDeviceSize offset, uint16_t order) noexcept {
+        auto k = order;
+        // merge with the buddy while it's free
+        for (; k + 1u < free_lists.size(); ++k) {
+            const auto buddy = offset ^ (VkDeviceSize{1} << k);
+            auto it = free_lists[k].find(buddy);
+            if (it == free_lists[k].end())
+                break;
+            free_lists[k].erase(it);
+            offset = std::min(offset, buddy);
+        }
+        free_lists[k].emplace(offset);
+    }
+
+    VkDeviceSize get_largest_free() const noexcept {
+        for (auto k = free_lists.size(); k > 0; --k)
+            if (free_lists[k - 1].empty() == false)
+                return VkDeviceSize{1} << (k - 1);
+        return 0;
+    }
+};
+
+struct vulkan_allocator_t::pool_t final {
+    vector<unique_ptr<block_t>> blocks{}; // nullptr for the released block
+};
+
+int32_t get_memory_type_score(VkMemoryPropertyFlags flags, VkMemoryPropertyFlags required,
+                              VkMemoryPropertyFlags preferred) noexcept {
+    if ((flags & required) != required)
+        return -1;
+    int32_t score = 64;
+    for (auto bits = flags & preferred; bits; bits &= bits - 1)
+        score += 8;
+    const auto unwanted = flags & ~(required | preferred);
+    // leave the small ReBAR heap for the ones who want it
+    if (unwanted & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        score -= 4;
+    if (unwanted & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+        score -= 2;
+    // the write-combined memory is better for the uploads. cached memory is for the readback
+    if (unwanted & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)
+        score -= 2;
+    if (unwanted & (VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT |
+                    VK_MEMORY_PROPERTY_DEVICE_COHERENT_BIT_AMD | VK_MEMORY_PROPERTY_DEVICE_UNCACHED_BIT_AMD))
+        score -= 32;
+    return std::max(score, 0);
+}
+
+uint32_t get_memory_type(const VkPhysicalDeviceMemoryProperties& props, uint32_t type_bits,
+                         VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) noexcept {
+    uint32_t best = UINT32_MAX;
+    int32_t best_score = -1;
+    for (auto i = 0u; i < props.memoryTypeCount; ++i) {
+        if ((type_bits & (1u << i)) == 0)
+            continue;
+        const auto score = get_memory_type_score(props.memoryTypes[i].propertyFlags, required, preferred);
+        if (score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+bool has_memory_budget(VkPhysicalDevice physical_device) noexcept(false) {
+    uint32_t count = 0;
+    if (vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, nullptr) != VK_SUCCESS)
+        return false;
+    auto extensions = make_unique<VkExtensionProperties[]>(count);
+    if (vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, extensions.get()) != VK_SUCCESS)
+        return false;
+    for (auto i = 0u; i < count; ++i)
+        if (std::strcmp(extensions[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            return true;
+    return false;
+}
+
+vulkan_memory_selector_t::vulkan_memory_selector_t(VkPhysicalDevice physical_device) noexcept(false)
+    : has_budget{has_memory_budget(physical_device)} {
+    update_budget(physical_device);
+}
+
+vulkan_memory_selector_t::vulkan_memory_selector_t(const VkPhysicalDeviceMemoryProperties& _props) noexcept(false)
+    : props{_props} {
+    for (auto i = 0u; i < props.memoryHeapCount; ++i)
+        budgets[i] = props.memoryHeaps[i].size;
+}
+
+void vulkan_memory_selector_t::update_budget(VkPhysicalDevice physical_device) noexcept {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 info{};
+    info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    if (has_budget)
+        info.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(physical_device, &info);
+    std::lock_guard lck{mtx};
+    props = info.memoryProperties;
+    for (auto i = 0u; i < props.memoryHeapCount; ++i)
+        budgets[i] = has_budget ? budget.heapBudget[i] - std::min(budget.heapBudget[i], budget.heapUsage[i])
+                                : props.memoryHeaps[i].size;
+    std::fill(std::begin(keys), std::end(keys), 0);
+    next = 0;
+}
+
+VkPhysicalDeviceMemoryProperties vulkan_memory_selector_t::get_properties() const noexcept {
+    std::lock_guard lck{mtx};
+    return props;
+}
+
+void vulkan_memory_selector_t::make_ranking(VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                                            ranking_t& ranking) const noexcept {
+    int32_t scores[VK_MAX_MEMORY_TYPES]{};
+    ranking.count = 0;
+    for (auto i = 0u; i < props.memoryTypeCount; ++i) {
+        const auto& type = props.memoryTypes[i];
+        scores[i] = get_memory_type_score(type.propertyFlags, required, preferred);
+        if (scores[i] < 0)
+            continue;
+        // the heap is almost full. other heaps are better if they are acceptable
+        const auto& heap = props.memoryHeaps[type.heapIndex];
+        if (has_budget && budgets[type.heapIndex] < heap.size / 16)
+            scores[i] /= 2;
+        ranking.types[ranking.count++] = i;
+    }
+    std::stable_sort(ranking.types, ranking.types + ranking.count, [this, &scores](uint32_t lhs, uint32_t rhs) {
+        if (scores[lhs] != scores[rhs])
+            return scores[lhs] > scores[rhs];
+        return budgets[props.memoryTypes[lhs].heapIndex] > budgets[props.memoryTypes[rhs].heapIndex];
+    });
+}
+
+auto vulkan_memory_selector_t::get_ranking(VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred) const
+    noexcept -> ranking_t {
+    // +1 so 0 can mark the empty slot
+    const uint64_t key = (uint64_t{required} << 32 | preferred) + 1;
+    std::lock_guard lck{mtx};
+    for (auto i = 0u; i < std::size(keys); ++i)
+        if (keys[i] == key)
+            return rankings[i];
+    const auto slot = next++ % std::size(keys);
+    make_ranking(required, preferred, rankings[slot]);
+    keys[slot] = key;
+    return rankings[slot];
+}
+
+uint32_t vulkan_memory_selector_t::select(uint32_t type_bits, VkMemoryPropertyFlags required,
+                                          VkMemoryPropertyFlags preferred) const noexcept {
+    const auto ranking = get_ranking(required, preferred);
+    for (auto i = 0u; i < ranking.count; ++i)
+        if (type_bits & (1u << ranking.types[i]))
+            return ranking.types[i];
+    return UINT32_MAX;
+}
+
+uint16_t get_buddy_order(VkDeviceSize size) noexcept {
+    uint16_t order = 0;
+    while ((VkDeviceSize{1} << order) < size)
+        ++order;
+    return order;
+}
+
+vulkan_allocator_t::vulkan_allocator_t(VkDevice _device, VkPhysicalDevice _physical_device,
+                                       VkDeviceSize _block_size) noexcept(false)
+    : device{_device}, physical_device{_physical_device}, selector{_physical_device},
+      block_size{VkDeviceSize{1} << get_buddy_order(std::max(_block_size, min_size))},
+      pools{make_unique<pool_t[]>(2 * VK_MAX_MEMORY_TYPES)} {
+}
+
+vulkan_allocator_t::vulkan_allocator_t(VkDevice _device, const VkPhysicalDeviceMemoryProperties& _props,
+                                       VkDeviceSize _block_size) noexcept(false)
+    : device{_device}, physical_device{VK_NULL_HANDLE}, selector{_props},
+      block_size{VkDeviceSize{1} << get_buddy_order(std::max(_block_size, min_size))},
+      pools{make_unique<pool_t[]>(2 * VK_MAX_MEMORY_TYPES)} {
+}
+
+vulkan_allocator_t::~vulkan_allocator_t() noexcept {
+    for (auto i = 0u; i < 2 * VK_MAX_MEMORY_TYPES; ++i) {
+        for (auto& block : pools[i].blocks) {
+            if (block == nullptr)
+                continue;
+            // vkFreeMemory unmaps implicitly
+            vkFreeMemory(device, block->memory, nullptr);
+        }
+    }
+}
+
+VkResult vulkan_allocator_t::allocate_block(pool_t& pool, uint32_t memory_type, uint32_t& index) noexcept {
+    VkMemoryAllocateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    info.allocationSize = block_size;
+    info.memoryTypeIndex = memory_type;
+    unique_ptr<block_t> block{};
+    try {
+        block = make_unique<block_t>();
+        block->free_lists.resize(get_buddy_order(block_size) + 1);
+        // reserve the slot first. then vkAllocateMemory is the last failure
+        auto it = std::find(pool.blocks.begin(), pool.blocks.end(), unique_ptr<block_t>{});
+        if (it == pool.blocks.end())
+            it = pool.blocks.emplace(pool.blocks.end());
+        index = static_cast<uint32_t>(it - pool.blocks.begin());
+    } catch (const std::bad_alloc&) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    if (auto ec = vkAllocateMemory(device, &info, nullptr, &block->memory))
+        return ec;
+    const auto props = selector.get_properties();
+    if (props.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void* ptr = nullptr;
+        if (auto ec = vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &ptr)) {
+            vkFreeMemory(device, block->memory, nullptr);
+            return ec;
+        }
+        block->mapping = static_cast<std::byte*>(ptr);
+    }
+    block->free_lists.back().emplace(0);
+    pool.blocks[index] = std::move(block);
+    return VK_SUCCESS;
+}
+
+VkResult vulkan_allocator_t::allocate_dedicated(const VkMemoryRequirements& requirements,
+                                                VkMemoryPropertyFlags desired, VkBuffer buffer, VkImage image,
+                                                vulkan_allocation_t& allocation) noexcept {
+    VkMemoryDedicatedAllocateInfo dedicated_info{};
+    dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicated_info.buffer = buffer;
+    dedicated_info.image = image;
+    VkMemoryAllocateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    if (buffer != VK_NULL_HANDLE || image != VK_NULL_HANDLE)
+        info.pNext = &dedicated_info;
+    info.allocationSize = requirements.size;
+    const auto props = selector.get_properties();
+    const auto ranking = selector.get_ranking(desired);
+    VkResult ec = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    for (auto r = 0u; r < ranking.count; ++r) {
+        const auto i = ranking.types[r];
+        if ((requirements.memoryTypeBits & (1u << i)) == 0)
+            continue;
+        info.memoryTypeIndex = i;
+        if (ec = vkAllocateMemory(device, &info, nullptr, &allocation.memory); ec != VK_SUCCESS)
+            continue; // the heap may be full. try the next type
+        allocation.mapping = nullptr;
+        if (props.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            if (ec = vkMapMemory(device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mapping); ec) {
+                vkFreeMemory(device, allocation.memory, nullptr);
+                allocation.memory = VK_NULL_HANDLE;
+                return ec;
+            }
+        }
+        allocation.offset = 0;
+        allocation.size = requirements.size;
+        allocation.memory_type = i;
+        allocation.block = vulkan_allocation_t::dedicated;
+        std::lock_guard lck{mtx};
+        dedicated_size += requirements.size;
+        ++dedicated_count;
+        return VK_SUCCESS;
+    }
+    return ec;
+}
+
+VkResult vulkan_allocator_t::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags desired,
+                                      bool linear, vulkan_allocation_t& allocation) noexcept {
+    const auto order = get_buddy_order(std::max<VkDeviceSize>({requirements.size, requirements.alignment, min_size}));
+    if ((VkDeviceSize{1} << order) > block_size / 2)
+        return allocate_dedicated(requirements, desired, VK_NULL_HANDLE, VK_NULL_HANDLE, allocation);
+
+    const auto ranking = selector.get_ranking(desired);
+    VkResult ec = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    std::lock_guard lck{mtx};
+    for (auto r = 0u; r < ranking.count; ++r) {
+        const auto i = ranking.types[r];
+        if ((requirements.memoryTypeBits & (1u << i)) == 0)
+            continue;
+        const auto pool_index = static_cast<uint16_t>(i * 2 + (linear ? 0 : 1));
+        pool_t& pool = pools[pool_index];
+        auto offset = UINT64_MAX;
+        uint32_t index = 0;
+        for (; index < pool.blocks.size(); ++index) {
+            if (pool.blocks[index] == nullptr)
+                continue;
+            if (offset = pool.blocks[index]->acquire(order); offset != UINT64_MAX)
+                break;
+        }
+        if (offset == UINT64_MAX) {
+            if (ec = allocate_block(pool, i, index); ec != VK_SUCCESS)
+                continue; // the heap may be full. try the next type
+            offset = pool.blocks[index]->acquire(order);
+        }
+        block_t& block = *pool.blocks[index];
+        block.allocated += VkDeviceSize{1} << order;
+        block.used += requirements.size;
+        ++block.count;
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.size = requirements.size;
+        allocation.mapping = block.mapping ? block.mapping + offset : nullptr;
+        allocation.memory_type = i;
+        allocation.block = index;
+        allocation.pool = pool_index;
+        allocation.order = order;
+        return VK_SUCCESS;
+    }
+    return ec;
+}
+
+VkResult vulkan_allocator_t::allocate(VkBuffer buffer, VkMemoryPropertyFlags desired,
+                                      vulkan_allocation_t& allocation) noexcept {
+    VkBufferMemoryRequirementsInfo2 info{};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    info.buffer = buffer;
+    VkMemoryDedicatedRequirements dedicated{};
+    dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 requirements{};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicated;
+    vkGetBufferMemoryRequirements2(device, &info, &requirements);
+    const auto& memory = requirements.memoryRequirements;
+    const auto ec = dedicated.prefersDedicatedAllocation
+                        ? allocate_dedicated(memory, desired, buffer, VK_NULL_HANDLE, allocation)
+                        : allocate(memory, desired, true, allocation);
+    if (ec != VK_SUCCESS)
+        return ec;
+    return vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+}
+
+VkResult vulkan_allocator_t::allocate(VkImage image, VkMemoryPropertyFlags desired,
+                                      vulkan_allocation_t& allocation) noexcept {
+    VkImageMemoryRequirementsInfo2 info{};
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    info.image = image;
+    VkMemoryDedicatedRequirements dedicated{};
+    dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+    VkMemoryRequirements2 requirements{};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicated;
+    vkGetImageMemoryRequirements2(device, &info, &requirements);
+    // render targets and the large textures are better in their own memory
+    const auto& memory = requirements.memoryRequirements;
+    const auto ec = dedicated.prefersDedicatedAllocation || memory.size > block_size / 2
+                        ? allocate_dedicated(memory, desired, VK_NULL_HANDLE, image, allocation)
+                        : allocate(memory, desired, false, allocation);
+    if (ec != VK_SUCCESS)
+        return ec;
+    return vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+}
+
+void vulkan_allocator_t::free(vulkan_allocation_t& allocation) noexcept {
+    if (allocation.memory == VK_NULL_HANDLE)
+        return;
+    if (allocation.block == vulkan_allocation_t::dedicated) {
+        vkFreeMemory(device, allocation.memory, nullptr);
+        std::lock_guard lck{mtx};
+        dedicated_size -= allocation.size;
+        --dedicated_count;
+    } else {
+        std::lock_guard lck{mtx};
+        pool_t& pool = pools[allocation.pool];
+        auto& block = pool.blocks[allocation.block];
+        block->release(allocation.offset, allocation.order);
+        block->allocated -= VkDeviceSize{1} << allocation.order;
+        block->used -= allocation.size;
+        // keep 1 block per pool to avoid the vkAllocateMemory/vkFreeMemory churn
+        const auto in_use = std::count_if(pool.blocks.begin(), pool.blocks.end(),
+                                          [](const auto& b) { return b != nullptr; });
+        if (--block->count == 0 && in_use > 1) {
+            vkFreeMemory(device, block->memory, nullptr);
+            block = nullptr;
+        }
+    }
+    allocation = vulkan_allocation_t{};
+}
+
+vulkan_memory_stats_t vulkan_allocator_t::get_stats() const noexcept {
+    vulkan_memory_stats_t stats{};
+    VkDeviceSize free_size = 0;
+    std::lock_guard lck{mtx};
+    for (auto i = 0u; i < 2 * VK_MAX_MEMORY_TYPES; ++i) {
+        for (const auto& block : pools[i].blocks) {
+            if (block == nullptr)
+                continue;
+            stats.reserved += block_size;
+            stats.allocated += block->allocated;
+            stats.used += block->used;
+            stats.allocation_count += block->count;
+            stats.largest_free = std::max(stats.largest_free, block->get_largest_free());
+            free_size += block_size - block->allocated;
+            ++stats.block_count;
+        }
+    }
+    stats.reserved += dedicated_size;
+    stats.allocated += dedicated_size;
+    stats.used += dedicated_size;
+    stats.dedicated_count = dedicated_count;
+    stats.allocation_count += dedicated_count;
+    if (free_size > 0)
+        stats.fragmentation = 1 - static_cast<float>(stats.largest_free) / static_cast<float>(free_size);
+    return stats;
+}
+
+void vulkan_allocator_t::update_budget() noexcept {
+    if (physical_device != VK_NULL_HANDLE)
+        selector.update_budget(physical_device);
+}
+
+vulkan_uniform_ring_t::vulkan_uniform_ring_t(VkDevice _device, vulkan_allocator_t& _allocator, VkDeviceSize _size,
+                                             uint32_t _count, VkDeviceSize alignment) noexcept(false)
+    : allocator{_allocator}, device{_device}, size{_size},
+      stride{(_size + alignment - 1) & ~(alignment - 1)}, count{_count} {
+    if (count == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0)
+        throw vulkan_exception_t{VK_ERROR_INITIALIZATION_FAILED, "vulkan_uniform_ring_t"};
+    VkBufferCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = stride * count;
+    info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (auto ec = vkCreateBuffer(device, &info, nullptr, &handle))
+        throw vulkan_exception_t{ec, "vkCreateBuffer"};
+    // coherent, so no vkFlushMappedMemoryRanges after the memcpy
+    const auto desired = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (auto ec = allocator.allocate(handle, desired, allocation)) {
+        allocator.free(allocation);
+        vkDestroyBuffer(device, handle, nullptr);
+        throw vulkan_exception_t{ec, "vkAllocateMemory"};
+    }
+}
+
+vulkan_uniform_ring_t::~vulkan_uniform_ring_t() noexcept {
+    vkDestroyBuffer(device, handle, nullptr);
+    allocator.free(allocation);
+}
+
+uint32_t vulkan_uniform_ring_t::update(uint32_t frame, const void* data) noexcept {
+    const auto offset = stride * (frame % count);
+    std::memcpy(static_cast<std::byte*>(allocation.mapping) + offset, data, size);
+    return static_cast<uint32_t>(offset);
+}
+
+VkDescriptorBufferInfo vulkan_uniform_ring_t::get_descriptor() const noexcept {
+    VkDescriptorBufferInfo info{};
+    info.buffer = handle;
+    info.offset = 0;
+    info.range = size;
+    return info;
+}
@@ -0,0 +1,192 @@
+#include "vulkan_1.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/// @brief `range` holds `[begin, end)` of the chunks. The lower 32 bit is `begin`, the upper 32 bit is `end`
+struct vulkan_parallel_recorder_t::worker_t final {
+    std::unique_ptr<VkCommandPool[]> pools{};                  // 1 for each frame
+    std::unique_ptr<std::vector<VkCommandBuffer>[]> buffers{}; // secondary buffers allocated from the pool
+    std::unique_ptr<uint32_t[]> used{};                        // number of the buffers used in the frame
+    std::atomic<uint64_t> range{};
+};
+
+/// @param front  the owner takes from the front, the others steal from the back
+bool pop_chunk(std::atomic<uint64_t>& range, bool front, uint32_t& index) noexcept {
+    auto current = range.load(std::memory_order_acquire);
+    while (true) {
+        auto begin = static_cast<uint32_t>(current);
+        auto end = static_cast<uint32_t>(current >> 32);
+        if (begin >= end)
+            return false;
+        index = front ? begin++ : --end;
+        const auto next = (static_cast<uint64_t>(end) << 32) | begin;
+        if (range.compare_exchange_weak(current, next, std::memory_order_acq_rel, std::memory_order_acquire))
+            return true;
+    }
+}
+
+vulkan_parallel_recorder_t::vulkan_parallel_recorder_t(VkDevice _device, uint32_t queue_family,
+                                                       uint32_t thread_count, uint32_t _frame_count) noexcept(false)
+    : device{_device}, frame_count{_frame_count}, pool{std::max(thread_count, 1u) - 1} {
+    if (thread_count == 0 || frame_count == 0)
+        throw vulkan_exception_t{VK_ERROR_UNKNOWN, "vulkan_parallel_recorder_t"};
+    VkCommandPoolCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; // reset the whole pool for each frame
+    info.queueFamilyIndex = queue_family;
+    try {
+        for (auto i = 0u; i < thread_count; ++i) {
+            auto& worker = workers.emplace_back(make_unique<worker_t>());
+            worker->pools = make_unique<VkCommandPool[]>(frame_count);
+            worker->buffers = make_unique<std::vector<VkCommandBuffer>[]>(frame_count);
+            worker->used = make_unique<uint32_t[]>(frame_count);
+            for (auto f = 0u; f < frame_count; ++f)
+                if (auto ec = vkCreateCommandPool(device, &info, nullptr, &worker->pools[f]))
+                    throw vulkan_exception_t{ec, "vkCreateCommandPool"};
+        }
+    } catch (...) {
+        close();
+        throw;
+    }
+}
+
+vulkan_parallel_recorder_t::~vulkan_parallel_recorder_t() noexcept {
+    close();
+}
+
+void vulkan_parallel_recorder_t::close() noexcept {
+    pool.join();
+    // the buffers are freed with their pool
+    for (auto& worker : workers) {
+        if (worker->pools == nullptr)
+            continue;
+        for (auto f = 0u; f < frame_count; ++f)
+            vkDestroyCommandPool(device, worker->pools[f], nullptr);
+    }
+    workers.clear();
+}
+
+uint32_t vulkan_parallel_recorder_t::size() const noexcept {
+    return static_cast<uint32_t>(workers.size());
+}
+
+void vulkan_parallel_recorder_t::leave() noexcept {
+    {
+        std::lock_guard lck{mtx};
+        if (--active != 0)
+            return;
+    }
+    done.notify_one();
+}
+
+void vulkan_parallel_recorder_t::work(uint32_t index) noexcept {
+    auto& self = *workers[index];
+    uint32_t chunk = 0;
+    while (pop_chunk(self.range, true, chunk))
+        if (record_chunk(self, chunk) != VK_SUCCESS)
+            return;
+    // the ranges only shrink. visiting each victim once is enough
+    const auto count = static_cast<uint32_t>(workers.size());
+    for (auto offset = 1u; offset < count; ++offset) {
+        auto& victim = *workers[(index + offset) % count];
+        while (pop_chunk(victim.range, false, chunk))
+            if (record_chunk(self, chunk) != VK_SUCCESS)
+                return;
+    }
+}
+
+VkResult vulkan_parallel_recorder_t::record_chunk(worker_t& worker, uint32_t index) noexcept {
+    auto& buffers = worker.buffers[job.frame];
+    auto& used = worker.used[job.frame];
+    auto ec = VK_SUCCESS;
+    if (used == buffers.size()) {
+        VkCommandBufferAllocateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        info.commandPool = worker.pools[job.frame];
+        info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        info.commandBufferCount = 1;
+        VkCommandBuffer commands{};
+        if (ec = vkAllocateCommandBuffers(device, &info, &commands); ec == VK_SUCCESS) {
+            try {
+                buffers.emplace_back(commands);
+            } catch (const std::bad_alloc&) {
+                vkFreeCommandBuffers(device, info.commandPool, 1, &commands);
+                ec = VK_ERROR_OUT_OF_HOST_MEMORY;
+            }
+        }
+    }
+    if (ec == VK_SUCCESS) {
+        auto commands = buffers[used++];
+        VkCommandBufferBeginInfo begin{};
+        begin.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        begin.pInheritanceInfo = &job.inheritance;
+        if (ec = vkBeginCommandBuffer(commands, &begin); ec == VK_SUCCESS) {
+            const auto first = index * job.chunk;
+            job.callback(job.user_data, commands, first, std::min(first + job.chunk, job.draw_count));
+            ec = vkEndCommandBuffer(commands);
+        }
+        secondaries[index] = commands;
+    }
+    if (ec != VK_SUCCESS) {
+        auto expected = VK_SUCCESS;
+        result.compare_exchange_strong(expected, ec);
+    }
+    return ec;
+}
+
+VkResult vulkan_parallel_recorder_t::record(VkCommandBuffer primary, uint32_t frame,
+                                            const VkCommandBufferInheritanceInfo& inheritance, uint32_t draw_count,
+                                            uint32_t chunk, vulkan_draw_callback_t callback, void* user_data) noexcept {
+    if (frame >= frame_count || chunk == 0)
+        return VK_ERROR_UNKNOWN;
+    if (draw_count == 0)
+        return VK_SUCCESS;
+    const auto count = (draw_count + chunk - 1) / chunk;
+    try {
+        secondaries.resize(count);
+    } catch (const std::bad_alloc&) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    // no thread is using the pools now
+    for (auto& worker : workers) {
+        if (auto ec = vkResetCommandPool(device, worker->pools[frame], 0))
+            return ec;
+        worker->used[frame] = 0;
+    }
+    job = job_t{frame, inheritance, draw_count, chunk, callback, user_data};
+    job.inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    result = VK_SUCCESS;
+    // contiguous ranges keep the neighbor draws(same pipeline, etc.) in the same thread
+    const auto n = static_cast<uint64_t>(workers.size());
+    for (auto i = 0u; i < n; ++i) {
+        const auto begin = static_cast<uint32_t>(uint64_t{count} * i / n);
+        const auto end = static_cast<uint32_t>(uint64_t{count} * (i + 1) / n);
+        workers[i]->range.store((static_cast<uint64_t>(end) << 32) | begin, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard lck{mtx};
+        active = static_cast<uint32_t>(n - 1);
+    }
+    for (auto i = 1u; i < n; ++i) {
+        try {
+            pool.submit([this, i]() {
+                work(i);
+                leave();
+            });
+        } catch (const std::bad_alloc&) {
+            leave(); // the others will steal the range
+        }
+    }
+    work(0);
+    {
+        std::unique_lock lck{mtx};
+        done.wait(lck, [this]() { return active == 0; });
+    }
+    if (auto ec = result.load())
+        return ec;
+    vkCmdExecuteCommands(primary, count, secondaries.data());
+    return VK_SUCCESS;
+}
@@ -0,0 +1,289 @@
+#include "vulkan_1.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+constexpr VkDeviceSize staging_alignment = 16;
+
+vulkan_uploader_t::vulkan_uploader_t(VkDevice _device, vulkan_allocator_t& _allocator, VkQueue _transfer_queue,
+                                     uint32_t _transfer_family, VkQueue _queue, uint32_t _family,
+                                     VkDeviceSize _capacity) noexcept(false)
+    : allocator{_allocator}, device{_device},
+      capacity{(std::max(_capacity, staging_alignment) + staging_alignment - 1) & ~(staging_alignment - 1)},
+      transfer_queue{_transfer_queue}, transfer_family{_transfer_family}, queue{_queue}, family{_family} {
+    auto on_throw = [this]() {
+        vkDestroyCommandPool(device, pools[1], nullptr);
+        vkDestroyCommandPool(device, pools[0], nullptr);
+        vkDestroySemaphore(device, timeline, nullptr);
+        vkDestroyBuffer(device, staging, nullptr);
+        allocator.free(allocation);
+    };
+    {
+        VkBufferCreateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        info.size = capacity;
+        info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (auto ec = vkCreateBuffer(device, &info, nullptr, &staging))
+            throw vulkan_exception_t{ec, "vkCreateBuffer"};
+        const auto desired = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        if (auto ec = allocator.allocate(staging, desired, allocation)) {
+            on_throw();
+            throw vulkan_exception_t{ec, "vkAllocateMemory"};
+        }
+    }
+    {
+        VkSemaphoreTypeCreateInfo type_info{};
+        type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        type_info.initialValue = 0;
+        VkSemaphoreCreateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        info.pNext = &type_info;
+        if (auto ec = vkCreateSemaphore(device, &info, nullptr, &timeline)) {
+            on_throw();
+            throw vulkan_exception_t{ec, "vkCreateSemaphore"};
+        }
+    }
+    const uint32_t families[2]{transfer_family, family};
+    for (auto i : {0, 1}) {
+        if (i == 1 && transfer_family == family)
+            break;
+        VkCommandPoolCreateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        // short-lived and reused after `reclaim`
+        info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        info.queueFamilyIndex = families[i];
+        if (auto ec = vkCreateCommandPool(device, &info, nullptr, pools + i)) {
+            on_throw();
+            throw vulkan_exception_t{ec, "vkCreateCommandPool"};
+        }
+    }
+}
+
+vulkan_uploader_t::~vulkan_uploader_t() noexcept {
+    if (current.transfer != VK_NULL_HANDLE || acquires.empty() == false) {
+        uint64_t value = 0;
+        submit(value);
+    }
+    wait(submitted);
+    // the command buffers are freed with the pools
+    vkDestroyCommandPool(device, pools[1], nullptr);
+    vkDestroyCommandPool(device, pools[0], nullptr);
+    vkDestroySemaphore(device, timeline, nullptr);
+    vkDestroyBuffer(device, staging, nullptr);
+    allocator.free(allocation);
+}
+
+VkResult vulkan_uploader_t::begin(uint32_t index, VkCommandBuffer& commands) noexcept {
+    if (idle[index].empty()) {
+        VkCommandBufferAllocateInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        info.commandPool = pools[index];
+        info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        info.commandBufferCount = 1;
+        if (auto ec = vkAllocateCommandBuffers(device, &info, &commands))
+            return ec;
+    } else {
+        commands = idle[index].back();
+        idle[index].pop_back();
+    }
+    // the pool has VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT. begin resets the buffer implicitly
+    VkCommandBufferBeginInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    return vkBeginCommandBuffer(commands, &info);
+}
+
+VkResult vulkan_uploader_t::reclaim(bool wait) noexcept {
+    uint64_t value = 0;
+    if (auto ec = vkGetSemaphoreCounterValue(device, timeline, &value))
+        return ec;
+    if (wait && batches.empty() == false && batches.front().value > value) {
+        if (auto ec = this->wait(batches.front().value))
+            return ec;
+        value = batches.front().value;
+    }
+    auto it = batches.begin();
+    try {
+        for (; it != batches.end() && it->value <= value; ++it) {
+            used -= it->size;
+            if (it->transfer != VK_NULL_HANDLE)
+                idle[0].emplace_back(it->transfer);
+            if (it->acquire != VK_NULL_HANDLE)
+                idle[1].emplace_back(it->acquire);
+        }
+    } catch (const std::bad_alloc&) {
+        // the command buffer is lost until the pool is destroyed. that's fine
+    }
+    batches.erase(batches.begin(), it);
+    return VK_SUCCESS;
+}
+
+VkResult vulkan_uploader_t::reserve(VkDeviceSize size, VkDeviceSize& offset) noexcept {
+    size = (size + staging_alignment - 1) & ~(staging_alignment - 1);
+    if (size > capacity)
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    for (;;) {
+        // the free range starts from the `head`. skip the tail of the ring if the size doesn't fit
+        const auto waste = head + size > capacity ? capacity - head : 0;
+        if (used + waste + size <= capacity) {
+            offset = waste ? 0 : head;
+            head = (offset + size) % capacity;
+            used += waste + size;
+            current.size += waste + size;
+            return VK_SUCCESS;
+        }
+        if (batches.empty()) {
+            if (current.transfer == VK_NULL_HANDLE)
+                return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+            // the current batch holds the whole ring. submit it to make the room
+            uint64_t value = 0;
+            if (auto ec = submit(value))
+                return ec;
+        }
+        if (auto ec = reclaim(true))
+            return ec;
+    }
+}
+
+VkResult vulkan_uploader_t::copy(VkBuffer buffer, VkDeviceSize offset, gsl::span<const std::byte> data,
+                                 VkAccessFlags access) noexcept {
+    const auto length = static_cast<VkDeviceSize>(data.size());
+    if (length == 0)
+        return VK_SUCCESS;
+    if (auto ec = reclaim(false))
+        return ec;
+    auto mapping = static_cast<std::byte*>(allocation.mapping);
+    for (VkDeviceSize done = 0; done < length;) {
+        // half of the ring, so the `reserve` can always find the room after the wrap-around
+        const auto size = std::min(length - done, capacity / 2);
+        VkDeviceSize staged = 0;
+        if (auto ec = reserve(size, staged))
+            return ec;
+        std::memcpy(mapping + staged, data.data() + done, size);
+        if (current.transfer == VK_NULL_HANDLE)
+            if (auto ec = begin(0, current.transfer))
+                return ec;
+        VkBufferCopy region{};
+        region.srcOffset = staged;
+        region.dstOffset = offset + done;
+        region.size = size;
+        vkCmdCopyBuffer(current.transfer, staging, buffer, 1, &region);
+        done += size;
+    }
+    // same family: the timeline semaphore makes the writes visible to the waiting queue
+    if (transfer_family == family)
+        return VK_SUCCESS;
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = transfer_family;
+    barrier.dstQueueFamilyIndex = family;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = length;
+    // release. the dstAccessMask is ignored
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(current.transfer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, //
+                         0, nullptr, 1, &barrier, 0, nullptr);
+    // acquire. the srcAccessMask is ignored
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = access;
+    try {
+        acquires.emplace_back(barrier);
+    } catch (const std::bad_alloc&) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    return VK_SUCCESS;
+}
+
+VkResult vulkan_uploader_t::submit(uint64_t& value, VkPipelineStageFlags stage) noexcept {
+    value = submitted;
+    // `acquires` can remain without `current` if the acquire half failed in the last call
+    if (current.transfer == VK_NULL_HANDLE && acquires.empty())
+        return VK_SUCCESS;
+    try {
+        batches.reserve(batches.size() + 2); // transfer half, acquire half
+    } catch (const std::bad_alloc&) {
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    if (current.transfer != VK_NULL_HANDLE) {
+        if (auto ec = vkEndCommandBuffer(current.transfer))
+            return ec;
+        const uint64_t released = submitted + 1;
+        VkTimelineSemaphoreSubmitInfo timeline_info{};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.signalSemaphoreValueCount = 1;
+        timeline_info.pSignalSemaphoreValues = &released;
+        VkSubmitInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        info.pNext = &timeline_info;
+        info.commandBufferCount = 1;
+        info.pCommandBuffers = &current.transfer;
+        info.signalSemaphoreCount = 1;
+        info.pSignalSemaphores = &timeline;
+        if (auto ec = vkQueueSubmit(transfer_queue, 1, &info, VK_NULL_HANDLE))
+            return ec;
+        // the queue owns the command buffer now. it must be tracked even if the acquire half fails
+        current.value = submitted = released;
+        batches.emplace_back(current);
+        current = batch_t{};
+    }
+    if (acquires.empty() == false) {
+        batch_t batch{};
+        if (auto ec = begin(1, batch.acquire)) {
+            // not recorded. `begin` resets it again for the next use
+            if (batch.acquire != VK_NULL_HANDLE) {
+                batch.value = submitted;
+                batches.emplace_back(batch);
+            }
+            return ec;
+        }
+        vkCmdPipelineBarrier(batch.acquire, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, stage, 0, //
+                             0, nullptr, static_cast<uint32_t>(acquires.size()), acquires.data(), 0, nullptr);
+        // the last signaled value covers the release in the transfer queue
+        const uint64_t released = submitted;
+        const uint64_t acquired = released + 1;
+        VkTimelineSemaphoreSubmitInfo timeline_info{};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timeline_info.waitSemaphoreValueCount = 1;
+        timeline_info.pWaitSemaphoreValues = &released;
+        timeline_info.signalSemaphoreValueCount = 1;
+        timeline_info.pSignalSemaphoreValues = &acquired;
+        VkSubmitInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        info.pNext = &timeline_info;
+        info.waitSemaphoreCount = 1;
+        info.pWaitSemaphores = &timeline;
+        info.pWaitDstStageMask = &stage;
+        info.commandBufferCount = 1;
+        info.pCommandBuffers = &batch.acquire;
+        info.signalSemaphoreCount = 1;
+        info.pSignalSemaphores = &timeline;
+        auto ec = vkEndCommandBuffer(batch.acquire);
+        if (ec == VK_SUCCESS)
+            ec = vkQueueSubmit(queue, 1, &info, VK_NULL_HANDLE);
+        if (ec != VK_SUCCESS) {
+            // recycle the command buffer with the reached value. `acquires` are kept for the next call
+            batch.value = submitted;
+            batches.emplace_back(batch);
+            return ec;
+        }
+        batch.value = submitted = acquired;
+        batches.emplace_back(batch);
+        acquires.clear();
+    }
+    value = submitted;
+    return VK_SUCCESS;
+}
+
+VkResult vulkan_uploader_t::wait(uint64_t value, uint64_t timeout) noexcept {
+    VkSemaphoreWaitInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    info.semaphoreCount = 1;
+    info.pSemaphores = &timeline;
+    info.pValues = &value;
+    return vkWaitSemaphores(device, &info, timeout);
+}
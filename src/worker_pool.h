@@ -0,0 +1,97 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed number of threads which consume the tasks in the submitted order.
+ *        The owners keep their own queue of the works when a thread needs a specific resource, and submit a task
+ *        which pops 1 work from it.
+ *
+ * @note  `pbo_reader_t`, `egl_worker_pool_t`, `asset_loader_t`, `vulkan_parallel_recorder_t` use this
+ */
+class worker_pool_t final {
+  public:
+    using task_t = std::function<void()>;
+    /**
+     * @brief The body of each thread. Prepare the thread(EGLContext, etc.), then call `loop` to consume the tasks.
+     *        The thread can clean up after the `loop` returns
+     */
+    using entry_t = std::function<void(worker_pool_t& pool, uint32_t index)>;
+
+  private:
+    std::mutex mtx{};
+    std::condition_variable cv{};
+    std::deque<task_t> tasks{};
+    std::vector<std::thread> threads{};
+    bool stop = false;
+
+  public:
+    /// @throw std::system_error if a thread can't start. The started threads are joined
+    explicit worker_pool_t(uint32_t count, entry_t entry = {}) noexcept(false) {
+        try {
+            threads.reserve(count);
+            for (auto i = 0u; i < count; ++i) {
+                if (entry)
+                    threads.emplace_back(entry, std::ref(*this), i);
+                else
+                    threads.emplace_back(&worker_pool_t::loop, this);
+            }
+        } catch (...) {
+            join();
+            throw;
+        }
+    }
+    /// @note runs the queued tasks, then joins the threads
+    ~worker_pool_t() noexcept {
+        join();
+    }
+    worker_pool_t(worker_pool_t const&) = delete;
+    worker_pool_t& operator=(worker_pool_t const&) = delete;
+    worker_pool_t(worker_pool_t&&) = delete;
+    worker_pool_t& operator=(worker_pool_t&&) = delete;
+
+    uint32_t size() const noexcept {
+        return static_cast<uint32_t>(threads.size());
+    }
+
+    void submit(task_t task) noexcept(false) {
+        {
+            std::lock_guard lck{mtx};
+            tasks.emplace_back(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    /// @brief consume the tasks until `join`. The `entry_t` must call this
+    void loop() noexcept {
+        while (true) {
+            task_t task{};
+            {
+                std::unique_lock lck{mtx};
+                cv.wait(lck, [this]() { return stop || tasks.empty() == false; });
+                if (tasks.empty()) // stop requested and nothing left
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    /// @note `submit` must not be used after this
+    void join() noexcept {
+        {
+            std::lock_guard lck{mtx};
+            stop = true;
+        }
+        cv.notify_all();
+        for (auto& t : threads)
+            t.join();
+        threads.clear();
+    }
+};
@@ -0,0 +1,198 @@
+/**
+ * @see https://www.fourcc.org/pixel-format/yuv-i420/
+ * @see https://www.itu.int/rec/R-REC-BT.601
+ */
+#include <graphics.h>
+#include <spdlog/spdlog.h>
+
+// full screen triangle without vertex buffer
+constexpr auto yuv_vert_code = R"(#version 300 es
+void main() {
+    vec2 p = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+// each fragment writes 4 bytes of the NV12/I420 layout.
+// the row of the fragment(gl_FragCoord.y) is the row in the `glReadPixels` result
+constexpr auto yuv_frag_code = R"(#version 300 es
+precision highp float;
+precision highp int;
+uniform sampler2D u_image;
+uniform ivec2 u_size; // width, height of the source
+uniform int u_layout; // 0: NV12, 1: I420
+uniform bool u_flip;
+out vec4 o_color;
+
+// BT.601 limited range
+const vec3 k_y = vec3(0.257, 0.504, 0.098);
+const vec3 k_u = vec3(-0.148, -0.291, 0.439);
+const vec3 k_v = vec3(0.439, -0.368, -0.071);
+
+vec3 fetch(vec2 pixel) {
+    vec2 uv = pixel / vec2(u_size);
+    if (u_flip)
+        uv.y = 1.0 - uv.y;
+    return texture(u_image, uv).rgb;
+}
+float luma(vec2 pixel) {
+    return dot(k_y, fetch(pixel)) + 16.0 / 255.0;
+}
+// the center of 2x2 pixels. GL_LINEAR makes their average
+vec2 chroma(int x, int y) {
+    vec3 rgb = fetch(vec2(float(x * 2 + 1), float(y * 2 + 1)));
+    return vec2(dot(k_u, rgb), dot(k_v, rgb)) + 128.0 / 255.0;
+}
+
+void main() {
+    ivec2 o = ivec2(gl_FragCoord.xy);
+    int w = u_size.x;
+    int h = u_size.y;
+    if (o.y < h) { // Y plane
+        vec2 p = vec2(float(o.x * 4) + 0.5, float(o.y) + 0.5);
+        o_color = vec4(luma(p), luma(p + vec2(1.0, 0.0)), luma(p + vec2(2.0, 0.0)), luma(p + vec2(3.0, 0.0)));
+        return;
+    }
+    int row = o.y - h;
+    if (u_layout == 0) { // UVUV...
+        o_color = vec4(chroma(o.x * 2, row), chroma(o.x * 2 + 1, row));
+        return;
+    }
+    // U plane, then V plane. each one is (w/2) x (h/2) bytes
+    int plane = w * h / 4;
+    int offset = row * w + o.x * 4;
+    bool is_v = offset >= plane;
+    if (is_v)
+        offset -= plane;
+    vec4 values;
+    for (int k = 0; k < 4; ++k) {
+        int i = offset + k;
+        vec2 uv = chroma(i % (w / 2), i / (w / 2));
+        values[k] = is_v ? uv.y : uv.x;
+    }
+    o_color = values;
+}
+)";
+
+yuv_converter_t::yuv_converter_t(GLsizei width, GLsizei height, yuv_layout_t layout) noexcept
+    : width{width}, height{height}, layout{layout} {
+    SPDLOG_TRACE(__FUNCTION__);
+    if (width <= 0 || height <= 0 || width % 8 || height % 2) {
+        ec = GL_INVALID_VALUE;
+        return;
+    }
+    program = glCreateProgram();
+    try {
+        shaders[0] = create_compile_attach(program, GL_VERTEX_SHADER, yuv_vert_code);
+        shaders[1] = create_compile_attach(program, GL_FRAGMENT_SHADER, yuv_frag_code);
+    } catch (const std::runtime_error& ex) {
+        spdlog::error("{} {}", __FUNCTION__, ex.what());
+        ec = GL_INVALID_OPERATION;
+        return;
+    }
+    glLinkProgram(program);
+    if (std::string message{}; get_program_info(message, program) == false) {
+        spdlog::error("{} {}", __FUNCTION__, message);
+        ec = GL_INVALID_OPERATION;
+        return;
+    }
+    locations[0] = glGetUniformLocation(program, "u_image");
+    locations[1] = glGetUniformLocation(program, "u_size");
+    locations[2] = glGetUniformLocation(program, "u_layout");
+    locations[3] = glGetUniformLocation(program, "u_flip");
+
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    GLint frame[4]{};
+    get_frame(frame);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, frame[2], frame[3]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    if (auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER); status != GL_FRAMEBUFFER_COMPLETE)
+        spdlog::error("{} framebuffer: {:#x}", __FUNCTION__, status);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    SPDLOG_DEBUG("- yuv:");
+    SPDLOG_DEBUG("  layout: {}", layout == yuv_layout_t::nv12 ? "NV12" : "I420");
+    SPDLOG_DEBUG("  source: {}x{}", width, height);
+    SPDLOG_DEBUG("  target: {}x{}", frame[2], frame[3]);
+    ec = glGetError();
+}
+
+yuv_converter_t::~yuv_converter_t() noexcept {
+    SPDLOG_TRACE(__FUNCTION__);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &texture);
+    glDeleteSamplers(1, &sampler);
+    for (auto shader : shaders)
+        if (shader)
+            glDeleteShader(shader);
+    if (program)
+        glDeleteProgram(program);
+    if (auto ec = glGetError())
+        spdlog::error("{} {}", __FUNCTION__, get_opengl_category().message(ec));
+}
+
+GLenum yuv_converter_t::is_valid() const noexcept {
+    return ec;
+}
+
+GLenum yuv_converter_t::convert(GLuint tex2d, bool flip) noexcept {
+    SPDLOG_TRACE(__FUNCTION__);
+    if (ec != GL_NO_ERROR)
+        return ec;
+    GLint frame[4]{};
+    get_frame(frame);
+    // the caller's state to restore
+    GLint viewport[4]{};
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    const GLboolean blend = glIsEnabled(GL_BLEND);
+    const GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(frame[0], frame[1], frame[2], frame[3]);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tex2d);
+    glBindSampler(0, sampler);
+    glUniform1i(locations[0], 0);
+    glUniform2i(locations[1], width, height);
+    glUniform1i(locations[2], static_cast<GLint>(layout));
+    glUniform1i(locations[3], flip);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    const auto ec = glGetError();
+    glBindSampler(0, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    if (depth_test)
+        glEnable(GL_DEPTH_TEST);
+    if (blend)
+        glEnable(GL_BLEND);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(framebuffer));
+    return ec;
+}
+
+GLuint yuv_converter_t::handle() const noexcept {
+    return fbo;
+}
+
+void yuv_converter_t::get_frame(GLint frame[4]) const noexcept {
+    frame[0] = frame[1] = 0;
+    frame[2] = width / 4;
+    frame[3] = height * 3 / 2;
+}
+
+uint32_t yuv_converter_t::get_length() const noexcept {
+    return static_cast<uint32_t>(width) * height * 3 / 2;
+}
@@ -3,8 +3,12 @@
  */
 #include <catch2/catch.hpp>
 #include <spdlog/spdlog.h>
+#include <graphics.h>
 
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 #define TINYGLTF_IMPLEMENTATION
@@ -17,6 +21,7 @@
 namespace fs = std::filesystem;
 
 fs::path get_asset_dir() noexcept;
+auto read_all(const fs::path& p, size_t& fsize) -> std::unique_ptr<std::byte[], void (*)(void*)>;
 
 TEST_CASE("Load GLB", "[gltf]") {
     auto fpath = get_asset_dir() / "Igloo.glb";
@@ -29,3 +34,73 @@ TEST_CASE("Load GLB", "[gltf]") {
     }
     REQUIRE(model.extensionsRequired.size() == 1);
 }
+
+TEST_CASE("Load GLB from mapped_file_t", "[gltf]") {
+    auto fpath = get_asset_dir() / "Igloo.glb";
+    REQUIRE(fs::exists(fpath));
+    const mapped_file_t file{fpath};
+    const auto blob = file.get();
+    tinygltf::TinyGLTF loader{};
+    tinygltf::Model model{};
+    if (std::string e, w; loader.LoadBinaryFromMemory(&model, &e, &w, reinterpret_cast<const unsigned char*>(blob.data()),
+                                                      gsl::narrow_cast<unsigned int>(blob.size())) == false) {
+        spdlog::warn(w);
+        FAIL(e);
+    }
+    REQUIRE(model.extensionsRequired.size() == 1);
+}
+
+TEST_CASE("mapped_file_t", "[io]") {
+    SECTION("image") {
+        const auto fpath = get_asset_dir() / "image_1080_608.png";
+        const mapped_file_t file{fpath};
+        const auto blob = file.get();
+        REQUIRE(file.is_mapped());
+        REQUIRE(static_cast<uintmax_t>(blob.size()) == fs::file_size(fpath));
+        // PNG signature
+        REQUIRE(blob[1] == std::byte{'P'});
+        REQUIRE(blob[2] == std::byte{'N'});
+        REQUIRE(blob[3] == std::byte{'G'});
+    }
+    SECTION("empty file") {
+        const auto fpath = fs::temp_directory_path() / "mapped_file_empty.bin";
+        std::ofstream{fpath, std::ios::binary | std::ios::trunc};
+        auto on_return = gsl::finally([&fpath]() { fs::remove(fpath); });
+        const mapped_file_t file{fpath};
+        REQUIRE(file.get().empty());
+    }
+    SECTION("not exists") {
+        REQUIRE_THROWS_AS(mapped_file_t{get_asset_dir() / "not_exists.bin"}, std::system_error);
+    }
+}
+
+TEST_CASE("read_all", "[io]") {
+    const auto fpath = get_asset_dir() / "image_1080_608.png";
+    size_t fsize = 0;
+    const auto blob = read_all(fpath, fsize);
+    REQUIRE(fsize == fs::file_size(fpath));
+    const mapped_file_t file{fpath};
+    REQUIRE(std::memcmp(blob.get(), file.get().data(), fsize) == 0);
+    REQUIRE_THROWS_AS(read_all(get_asset_dir() / "not_exists.bin", fsize), std::system_error);
+}
+
+/// @note 64 MiB or larger file uses O_DIRECT. The temp directory may be tmpfs which doesn't support it
+TEST_CASE("read_all with large file", "[io]") {
+    const auto fpath = fs::current_path() / "read_all_large.bin";
+    // not a multiple of the block size. the last read is short
+    const size_t length = (64 << 20) + 1234;
+    {
+        std::vector<uint32_t> words(length / sizeof(uint32_t) + 1);
+        for (auto i = 0u; i < words.size(); ++i)
+            words[i] = i * 2654435761u;
+        std::ofstream stream{fpath, std::ios::binary | std::ios::trunc};
+        stream.write(reinterpret_cast<const char*>(words.data()), static_cast<std::streamsize>(length));
+        REQUIRE(stream.good());
+    }
+    auto on_return = gsl::finally([&fpath]() { fs::remove(fpath); });
+    size_t fsize = 0;
+    const auto blob = read_all(fpath, fsize);
+    REQUIRE(fsize == length);
+    const mapped_file_t file{fpath};
+    REQUIRE(std::memcmp(blob.get(), file.get().data(), fsize) == 0);
+}
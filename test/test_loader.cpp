@@ -0,0 +1,144 @@
+#include <catch2/catch.hpp>
+#include <spdlog/spdlog.h>
+#include <graphics.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+fs::path get_asset_dir() noexcept;
+
+struct asset_result_t final {
+    fs::path fpath{};
+    uint32_t ec = 0;
+    bool matched = false;
+    std::atomic_uint32_t count{};
+};
+
+void compare_asset(void* user_data, gsl::span<const std::byte> contents, uint32_t ec) {
+    auto result = static_cast<asset_result_t*>(user_data);
+    result->ec = ec;
+    if (ec == 0) {
+        const mapped_file_t file{result->fpath};
+        const auto expected = file.get();
+        result->matched = expected.size() == contents.size() &&
+                          std::memcmp(expected.data(), contents.data(), contents.size()) == 0;
+    }
+    ++result->count;
+}
+
+TEST_CASE("asset_loader_t", "[io]") {
+    // small buffers, so the large images are read into the heap memory
+    asset_loader_t loader{2, 4, 64 << 10};
+    spdlog::info("asset_loader_t: io_uring {}", loader.uses_io_uring());
+
+    std::vector<std::unique_ptr<asset_result_t>> results{};
+    for (const auto& entry : fs::directory_iterator{get_asset_dir()}) {
+        if (entry.is_regular_file() == false)
+            continue;
+        auto& result = results.emplace_back(std::make_unique<asset_result_t>());
+        result->fpath = entry.path();
+        loader.submit(result->fpath, &compare_asset, result.get());
+    }
+    asset_result_t missing{};
+    missing.fpath = get_asset_dir() / "not_exists.bin";
+    loader.submit(missing.fpath, &compare_asset, &missing);
+    loader.wait();
+
+    for (const auto& result : results) {
+        INFO(result->fpath.generic_u8string());
+        REQUIRE(result->count == 1);
+        REQUIRE(result->ec == 0);
+        REQUIRE(result->matched);
+    }
+    REQUIRE(missing.count == 1);
+    REQUIRE(missing.ec == ENOENT);
+}
+
+TEST_CASE("asset_archive_t", "[io]") {
+    std::vector<archive_source_t> sources{};
+    for (const auto& entry : fs::directory_iterator{get_asset_dir()})
+        if (entry.is_regular_file())
+            sources.emplace_back(archive_source_t{entry.path().filename().generic_u8string(), entry.path()});
+    const auto fpath = fs::temp_directory_path() / "graphics_test.pack";
+    auto on_return = gsl::finally([&fpath]() { fs::remove(fpath); });
+
+    SECTION("none") {
+        write_archive(fpath, sources, archive_codec_t::none, 256);
+        const asset_archive_t archive{fpath};
+        REQUIRE(archive.size() == sources.size());
+        for (const auto& source : sources) {
+            const auto* entry = archive.find(source.name);
+            REQUIRE(entry);
+            REQUIRE(archive.get_name(*entry) == source.name);
+            REQUIRE(entry->offset % 256 == 0);
+            const mapped_file_t file{source.fpath};
+            const auto expected = file.get();
+            const auto contents = archive.get(*entry);
+            REQUIRE(contents.size() == expected.size());
+            REQUIRE(std::memcmp(contents.data(), expected.data(), expected.size()) == 0);
+        }
+        REQUIRE(archive.find("not_exists.bin") == nullptr);
+    }
+    SECTION("compressed") {
+        const auto codec = GENERATE(archive_codec_t::lz4, archive_codec_t::zstd);
+        try {
+            write_archive(fpath, sources, codec);
+        } catch (const std::system_error& ex) {
+            spdlog::warn("codec {}: {}", static_cast<uint32_t>(codec), ex.what());
+            return; // not in this build
+        }
+        const asset_archive_t archive{fpath};
+        for (const auto& source : sources) {
+            const auto* entry = archive.find(source.name);
+            REQUIRE(entry);
+            std::vector<std::byte> contents(entry->size);
+            REQUIRE(archive.read(*entry, contents) == 0);
+            const mapped_file_t file{source.fpath};
+            const auto expected = file.get();
+            REQUIRE(contents.size() == static_cast<size_t>(expected.size()));
+            REQUIRE(std::memcmp(contents.data(), expected.data(), contents.size()) == 0);
+        }
+    }
+    SECTION("duplicated name") {
+        sources.emplace_back(sources.front());
+        REQUIRE_THROWS_AS(write_archive(fpath, sources), std::invalid_argument);
+    }
+    SECTION("broken index") {
+        REQUIRE(sources.size() >= 2);
+        write_archive(fpath, sources, archive_codec_t::none, 256);
+        uint64_t index_offset = 0;
+        {
+            std::ifstream fin{fpath, std::ios::binary};
+            fin.seekg(16); // archive_header_t::index_offset
+            fin.read(reinterpret_cast<char*>(&index_offset), sizeof(index_offset));
+        }
+        // overwrite a field of the archive_entry_t
+        auto patch = [&fpath, index_offset](size_t idx, size_t field, uint64_t value) {
+            std::fstream fout{fpath, std::ios::binary | std::ios::in | std::ios::out};
+            fout.seekp(static_cast<std::streamoff>(index_offset + idx * sizeof(archive_entry_t) + field));
+            fout.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+        const archive_entry_t first = [&fpath]() {
+            const asset_archive_t archive{fpath};
+            return archive.get_entries()[0];
+        }();
+        SECTION("misaligned offset") {
+            patch(0, offsetof(archive_entry_t, offset), first.offset + 1);
+            REQUIRE_THROWS_AS(asset_archive_t{fpath}, std::runtime_error);
+        }
+        SECTION("stored size of uncompressed") {
+            patch(0, offsetof(archive_entry_t, size), first.size + 1);
+            REQUIRE_THROWS_AS(asset_archive_t{fpath}, std::runtime_error);
+        }
+        SECTION("unsorted hash") {
+            patch(0, offsetof(archive_entry_t, hash), UINT64_MAX);
+            REQUIRE_THROWS_AS(asset_archive_t{fpath}, std::runtime_error);
+        }
+    }
+}
@@ -29,6 +29,11 @@ fs::path get_asset_dir() noexcept {
     return fs::current_path();
 }
 
+/// @see main
+auto get_current_stream() noexcept -> std::shared_ptr<spdlog::logger> {
+    return spdlog::default_logger();
+}
+
 int main(int argc, char* argv[]) {
     setlocale(LC_ALL, ".65001");
 
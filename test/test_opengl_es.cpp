@@ -18,12 +18,17 @@
 #include <GLFW/glfw3native.h>
 // clang-format on
 
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <pplawait.h>
 #include <ppltasks.h>
+#include <thread>
 #include <winrt/Windows.Foundation.h> // namespace winrt::Windows::Foundation
 #include <winrt/Windows.System.h>     // namespace winrt::Windows::System
 
 using winrt::com_ptr;
+namespace fs = std::filesystem;
 
 TEST_CASE("eglGetProcAddress != GetProcAddress", "[egl]") {
     auto hmodule = LoadLibraryW(L"libEGL");
@@ -168,6 +173,41 @@ TEST_CASE("EGL_KHR_fence_sync/EGL_KHR_wait_sync", "[egl][!mayfail]") {
     }
 }
 
+TEST_CASE("EGLContext - Surfaceless", "[egl][headless][!mayfail]") {
+    EGLint count = 0;
+    if (get_egl_devices(nullptr, count) == EGL_SUCCESS)
+        spdlog::info("EGL devices: {}", count);
+    // negative index for EGL_MESA_platform_surfaceless
+    const auto device_index = GENERATE(-1, 0);
+    EGLDisplay es_display = get_headless_display(device_index);
+    REQUIRE(es_display != EGL_NO_DISPLAY);
+    auto on_return = gsl::finally([es_display]() { eglTerminate(es_display); });
+    {
+        egl_context_t context{es_display, EGL_NO_CONTEXT};
+        REQUIRE(context.is_valid());
+        REQUIRE(context.resume() == EGL_SUCCESS);
+        REQUIRE(eglGetCurrentSurface(EGL_DRAW) == EGL_NO_SURFACE);
+
+        // render to the FBO
+        GLuint tex2d = 0, fbo = 0;
+        glGenTextures(1, &tex2d);
+        glBindTexture(GL_TEXTURE_2D, tex2d);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 16, 16);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex2d, 0);
+        REQUIRE(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+        glClearColor(1, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        uint32_t pixel = 0;
+        glReadPixels(0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, &pixel);
+        REQUIRE(glGetError() == GL_NO_ERROR);
+        REQUIRE(pixel == 0xFF0000FF); // ABGR
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &tex2d);
+    }
+}
+
 void setup_egl_config(EGLDisplay display, EGLConfig& config, EGLint& minor) {
     EGLint versions[2]{};
     REQUIRE(eglInitialize(display, versions + 0, versions + 1));
@@ -336,6 +376,19 @@ TEST_CASE("OpenGL Sync - Fence", "[opengl][synchronization][!mayfail]") {
             }
         }
     }
+    SECTION("gpu_future_t") {
+        gpu_future_t future{glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)};
+        REQUIRE(future.get_type() == gpu_future_t::type_t::gl);
+        glClear(GL_COLOR_BUFFER_BIT);
+        REQUIRE(future.wait_gpu() == 0);
+        REQUIRE(future.wait(std::chrono::seconds{1}) == 0);
+        REQUIRE(future.is_ready());
+
+        gpu_future_t moved{std::move(future)};
+        REQUIRE(future.valid() == false);
+        REQUIRE(future.wait(std::chrono::seconds{1}) == EINVAL);
+        REQUIRE(moved.valid());
+    }
     SECTION("Multiple Fence") {
         auto fence1 = std::unique_ptr<std::remove_pointer_t<GLsync>, void (*)(GLsync)>{
             glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), &glDeleteSync};
@@ -778,19 +831,677 @@ TEST_CASE_METHOD(glfw_test_case, "GL_PIXEL_PACK_BUFFER 2", "[opengl][glfw]") {
         if (auto ec = reader.pack(back, fbo, frame))
             FAIL(ec);
         // map the front buffer and read
-        if (count == 9) {
-            // if there was no read, the pixel buffer object is clean and must hold zero (0,0,0,0)
-            // this is the first read, so it will be untouched
-            if (auto ec = reader.map_and_invoke(front, is_untouched, nullptr))
+        // if there was no read, the pixel buffer object is clean and must hold zero (0,0,0,0)
+        // this is the first read, so it will be untouched
+        // if back == 0, (2nd, 4th... read) the clear color of previous frame is (0,1,1,1). this is blue_green.
+        // if back == 1, (3rd, 5rh... read) the color is (0,0,1,1), which is blue.
+        reader_callback_t callback = count == 9 ? is_untouched : back == 0 ? is_blue_green : is_blue;
+        GLenum ec = GL_NO_ERROR;
+        while ((ec = reader.map_and_invoke(front, callback, nullptr)) == GL_TIMEOUT_EXPIRED)
+            std::this_thread::yield(); // the GPU is still writing. poll again
+        if (ec)
+            FAIL(ec);
+        glfwSwapBuffers(window.get());
+    }
+}
+
+TEST_CASE_METHOD(glfw_test_case, "GL_PIXEL_PACK_BUFFER 3", "[opengl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    GLint frame[4]{};
+    glGetIntegerv(GL_VIEWPORT, frame);
+    REQUIRE(glGetError() == GL_NO_ERROR);
+
+    const auto length = static_cast<GLuint>(frame[2] * frame[3] * 4);
+    SECTION("invalid depth") {
+        pbo_reader_t reader{length, 0};
+        REQUIRE(reader.is_valid() == GL_INVALID_VALUE);
+        pbo_reader_t reader2{length, pbo_reader_t::max_capacity + 1};
+        REQUIRE(reader2.is_valid() == GL_INVALID_VALUE);
+    }
+    SECTION("ring of 3") {
+        pbo_reader_t reader{length, 3};
+        REQUIRE(reader.is_valid() == GL_NO_ERROR);
+        REQUIRE(reader.size() == 3);
+        glReadBuffer(GL_BACK);
+
+        reader_callback_t on_mapping = [](void* ptr, const void*, size_t) { //
+            ++*reinterpret_cast<uint32_t*>(ptr);
+        };
+        uint32_t count = 0;
+        for (auto i = 0u; i < 30; ++i) {
+            glClearColor(0, 0, 1, 1);
+            glClear(GL_COLOR_BUFFER_BIT);
+            const auto back = static_cast<uint16_t>(i % reader.size());
+            const auto front = static_cast<uint16_t>((i + 1) % reader.size()); // the oldest one
+            if (auto ec = reader.pack(back, 0, frame))
                 FAIL(ec);
-        } else {
-            // if back == 0, (2nd, 4th... read) the clear color of previous frame is (0,1,1,1). this is blue_green.
-            // if back == 1, (3rd, 5rh... read) the color is (0,0,1,1), which is blue.
-            if (auto ec = reader.map_and_invoke(front, back == 0 ? is_blue_green : is_blue, nullptr))
+            // the result can be not ready. never wait here
+            if (auto ec = reader.map_and_invoke(front, on_mapping, &count); ec != GL_TIMEOUT_EXPIRED && ec)
                 FAIL(ec);
+            glfwSwapBuffers(window.get());
+        }
+        uint32_t ready = 0, busy = 0;
+        reader.get_statistics(ready, busy);
+        CAPTURE(ready, busy, count);
+        // the first `size() - 1` fronts were never packed. mapped, but not counted
+        REQUIRE(ready + busy == 30 - (reader.size() - 1));
+        REQUIRE(ready + reader.size() - 1 == count);
+    }
+}
+
+/// @note The library is built with SPDLOG_ACTIVE_LEVEL. Compare Debug/Release builds for the per-frame overhead
+TEST_CASE_METHOD(glfw_test_case, "GL_PIXEL_PACK_BUFFER logging overhead", "[opengl][glfw][!benchmark]") {
+    glfwMakeContextCurrent(window.get());
+    constexpr GLint frame[4]{0, 0, 64, 64};
+    pbo_reader_t reader{static_cast<GLuint>(frame[2] * frame[3] * 4), 2};
+    REQUIRE(reader.is_valid() == GL_NO_ERROR);
+    glReadBuffer(GL_BACK);
+    reader_callback_t on_mapping = [](void*, const void*, size_t) {};
+    uint32_t i = 0;
+    auto per_frame = [&]() {
+        const auto back = static_cast<uint16_t>(i % 2);
+        const auto front = static_cast<uint16_t>(++i % 2);
+        reader.pack(back, 0, frame);
+        return reader.map_and_invoke(front, on_mapping, nullptr);
+    };
+    const auto level = spdlog::get_level();
+    auto on_return = gsl::finally([level]() { spdlog::set_level(level); });
+
+    spdlog::set_level(spdlog::level::info);
+    BENCHMARK("pack/map") {
+        return per_frame();
+    };
+}
+
+TEST_CASE_METHOD(glfw_test_case, "GL_PIXEL_PACK_BUFFER tiles", "[opengl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    GLint frame[4]{};
+    glGetIntegerv(GL_VIEWPORT, frame);
+    REQUIRE(glGetError() == GL_NO_ERROR);
+
+    pbo_reader_t reader{static_cast<GLuint>(frame[2] * frame[3] * 4), 1};
+    REQUIRE(reader.is_valid() == GL_NO_ERROR);
+    glReadBuffer(GL_BACK);
+    glClearColor(0, 0, 1, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    const GLint tiles[]{0, 0, 64, 64, 128, 256, 32, 16, frame[2] - 8, frame[3] - 8, 8, 8};
+    REQUIRE(reader.pack_tiles(0, 0, frame[2], tiles) == GL_NO_ERROR);
+
+    tile_callback_t is_blue = [](void* ptr, const GLint tile[4], const void* mapping, size_t stride) {
+        auto& count = *reinterpret_cast<uint32_t*>(ptr);
+        for (auto y = 0; y < tile[3]; ++y) {
+            auto row = reinterpret_cast<const uint32_t*>(reinterpret_cast<const std::byte*>(mapping) + y * stride);
+            REQUIRE(row[0] == 0xFF'FF'00'00);
+            REQUIRE(row[tile[2] - 1] == 0xFF'FF'00'00);
+        }
+        ++count;
+    };
+    uint32_t count = 0;
+    GLenum ec = GL_NO_ERROR;
+    while ((ec = reader.map_tiles_and_invoke(0, tiles, is_blue, &count)) == GL_TIMEOUT_EXPIRED)
+        std::this_thread::yield();
+    REQUIRE(ec == GL_NO_ERROR);
+    REQUIRE(count == 3);
+
+    SECTION("out of buffer") {
+        const GLint tile[]{0, frame[3], 8, 8};
+        REQUIRE(reader.pack_tiles(0, 0, frame[2], tile) == GL_OUT_OF_MEMORY);
+    }
+    SECTION("map out of the area") {
+        const GLint tile1[]{frame[2] - 4, 0, 8, 8};
+        REQUIRE(reader.map_tiles_and_invoke(0, tile1, is_blue, &count) == GL_INVALID_VALUE);
+        // the offset wraps in 32 bit
+        const GLint tile2[]{0, 0x7FFF'FFFF, 1, 1};
+        REQUIRE(reader.map_tiles_and_invoke(0, tile2, is_blue, &count) == GL_INVALID_VALUE);
+        const GLint tile3[]{0, frame[3] - 4, 8, 8};
+        REQUIRE(reader.map_tiles_and_invoke(0, tile3, is_blue, &count) == GL_INVALID_VALUE);
+        REQUIRE(count == 3);
+    }
+    SECTION("unknown format") {
+        REQUIRE(reader.pack_tiles(0, 0, frame[2], tiles, GL_DEPTH_COMPONENT, GL_FLOAT) == GL_INVALID_VALUE);
+    }
+    SECTION("negative size") {
+        const GLint tile1[]{8, 8, -4, 8};
+        REQUIRE(reader.pack_tiles(0, 0, frame[2], tile1) == GL_INVALID_VALUE);
+        const GLint tile2[]{8, 8, 8, -4};
+        REQUIRE(reader.pack_tiles(0, 0, frame[2], tile2) == GL_INVALID_VALUE);
+    }
+    SECTION("caller's alignment") {
+        glPixelStorei(GL_PACK_ALIGNMENT, 8);
+        REQUIRE(reader.pack_tiles(0, 0, frame[2], tiles) == GL_NO_ERROR);
+        GLint alignment = 0;
+        glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+        REQUIRE(alignment == 8);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
+}
+
+TEST_CASE_METHOD(glfw_test_case, "GL_PIXEL_PACK_BUFFER async", "[opengl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    GLint frame[4]{};
+    glGetIntegerv(GL_VIEWPORT, frame);
+    REQUIRE(glGetError() == GL_NO_ERROR);
+
+    pbo_reader_t reader{static_cast<GLuint>(frame[2] * frame[3] * 4), 3};
+    REQUIRE(reader.is_valid() == GL_NO_ERROR);
+    glReadBuffer(GL_BACK);
+
+    // invoked in the worker thread
+    reader_callback_t is_blue = [](void* ptr, const void* mapping, size_t) {
+        const auto value = *reinterpret_cast<const uint32_t*>(mapping);
+        *reinterpret_cast<uint32_t*>(ptr) = value;
+    };
+
+    SECTION("drain") {
+        uint32_t values[3]{};
+        std::future<GLenum> tokens[3]{};
+        for (auto i = 0u; i < 3; ++i) {
+            glClearColor(0, 0, 1, 1);
+            glClear(GL_COLOR_BUFFER_BIT);
+            tokens[i] = reader.read_async(0, frame, is_blue, values + i);
+            glfwSwapBuffers(window.get());
+        }
+        reader.drain();
+        for (auto i = 0u; i < 3; ++i) {
+            REQUIRE(tokens[i].get() == GL_NO_ERROR);
+            REQUIRE(values[i] == 0xFF'FF'00'00);
+        }
+    }
+    SECTION("all slots in flight") {
+        uint32_t values[4]{};
+        std::future<GLenum> tokens[4]{};
+        for (auto i = 0u; i < 4; ++i)
+            tokens[i] = reader.read_async(0, frame, is_blue, values + i);
+        REQUIRE(tokens[3].get() == GL_OUT_OF_MEMORY);
+        while (reader.poll())
+            std::this_thread::yield();
+        for (auto i = 0u; i < 3; ++i)
+            REQUIRE(tokens[i].get() == GL_NO_ERROR);
+    }
+}
+
+TEST_CASE_METHOD(glfw_test_case, "GL_PIXEL_UNPACK_BUFFER stream", "[opengl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    constexpr GLint frame[4]{0, 0, 256, 256};
+    GLuint tex2d = 0;
+    glGenTextures(1, &tex2d);
+    auto on_return = gsl::finally([&tex2d]() { glDeleteTextures(1, &tex2d); });
+    glBindTexture(GL_TEXTURE_2D, tex2d);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, frame[2], frame[3]);
+    REQUIRE(glGetError() == GL_NO_ERROR);
+
+    pbo_stream_writer_t writer{static_cast<GLuint>(frame[2] * frame[3] * 4), 3};
+    REQUIRE(writer.is_valid() == GL_NO_ERROR);
+    CAPTURE(writer.is_persistent());
+
+    writer_callback_t fill = [](void* ptr, void* mapping, size_t length) {
+        memset(mapping, *reinterpret_cast<int*>(ptr), length);
+    };
+    for (auto i = 0; i < 30; ++i) {
+        switch (auto ec = writer.upload(tex2d, frame, fill, &i)) {
+        case GL_NO_ERROR:
+        case GL_TIMEOUT_EXPIRED: // the ring is full. skip this frame
+            break;
+        default:
+            FAIL(ec);
         }
         glfwSwapBuffers(window.get());
     }
+    uint32_t ready = 0, busy = 0;
+    writer.get_statistics(ready, busy);
+    CAPTURE(ready, busy);
+    REQUIRE(ready + busy == 30);
+    REQUIRE(ready > 0);
+}
+
+/// @brief BT.601 limited range. Same with the shader of `yuv_converter_t`
+static void rgb_to_yuv(const uint8_t rgb[3], uint8_t yuv[3]) noexcept {
+    const auto r = rgb[0], g = rgb[1], b = rgb[2];
+    yuv[0] = static_cast<uint8_t>(std::lround(0.257 * r + 0.504 * g + 0.098 * b + 16));
+    yuv[1] = static_cast<uint8_t>(std::lround(-0.148 * r - 0.291 * g + 0.439 * b + 128));
+    yuv[2] = static_cast<uint8_t>(std::lround(0.439 * r - 0.368 * g - 0.071 * b + 128));
+}
+
+/// @brief convert the `tex2d` and read the planes with `pbo_reader_t`
+static auto read_yuv_planes(GLuint tex2d, GLsizei width, GLsizei height, yuv_layout_t layout, bool flip)
+    -> std::vector<uint8_t> {
+    yuv_converter_t converter{width, height, layout};
+    REQUIRE(converter.is_valid() == GL_NO_ERROR);
+    REQUIRE(converter.get_length() == width * height * 3 / 2);
+    REQUIRE(converter.convert(tex2d, flip) == GL_NO_ERROR);
+
+    GLint frame[4]{};
+    converter.get_frame(frame);
+    pbo_reader_t reader{converter.get_length(), 1};
+    REQUIRE(reader.is_valid() == GL_NO_ERROR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, converter.handle());
+    REQUIRE(reader.pack(0, converter.handle(), frame) == GL_NO_ERROR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    reader_callback_t on_mapping = [](void* ptr, const void* mapping, size_t length) {
+        auto& planes = *reinterpret_cast<std::vector<uint8_t>*>(ptr);
+        const auto bytes = reinterpret_cast<const uint8_t*>(mapping);
+        planes.assign(bytes, bytes + length);
+    };
+    std::vector<uint8_t> planes{};
+    GLenum ec = GL_TIMEOUT_EXPIRED;
+    while (ec == GL_TIMEOUT_EXPIRED) {
+        ec = reader.map_and_invoke(0, on_mapping, &planes);
+        std::this_thread::yield();
+    }
+    REQUIRE(ec == GL_NO_ERROR);
+    REQUIRE(planes.size() == converter.get_length());
+    return planes;
+}
+
+TEST_CASE_METHOD(glfw_test_case, "yuv_converter_t", "[opengl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    constexpr GLsizei width = 64, height = 32;
+    SECTION("invalid size") {
+        yuv_converter_t converter{width + 2, height, yuv_layout_t::nv12};
+        REQUIRE(converter.is_valid() == GL_INVALID_VALUE);
+    }
+    SECTION("caller's state") {
+        GLuint tex2d = 0;
+        glGenTextures(1, &tex2d);
+        auto on_return = gsl::finally([&tex2d]() { glDeleteTextures(1, &tex2d); });
+        glBindTexture(GL_TEXTURE_2D, tex2d);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        yuv_converter_t target{width, height, yuv_layout_t::nv12};
+        REQUIRE(target.is_valid() == GL_NO_ERROR);
+        yuv_converter_t converter{width, height, yuv_layout_t::i420};
+        REQUIRE(converter.is_valid() == GL_NO_ERROR);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.handle());
+        glViewport(1, 2, 3, 4);
+        glEnable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        REQUIRE(converter.convert(tex2d, false) == GL_NO_ERROR);
+        GLint framebuffer = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+        REQUIRE(static_cast<GLuint>(framebuffer) == target.handle());
+        GLint viewport[4]{};
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        REQUIRE(viewport[0] == 1);
+        REQUIRE(viewport[3] == 4);
+        REQUIRE(glIsEnabled(GL_BLEND));
+        REQUIRE(glIsEnabled(GL_DEPTH_TEST));
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    SECTION("quadrants") {
+        // the 2x2 blocks never cross the quadrants. so the chroma is the color of the quadrant
+        // the first row of `pixels` is the first row of the texture(v = 0)
+        constexpr uint8_t colors[4][3]{
+            {255, 0, 0},    // top-left: red
+            {0, 255, 0},    // top-right: green
+            {0, 0, 255},    // bottom-left: blue
+            {128, 128, 128} // bottom-right: gray
+        };
+        auto get_color = [&colors](GLsizei x, GLsizei y) -> const uint8_t* {
+            return colors[(y < height / 2 ? 0 : 2) + (x < width / 2 ? 0 : 1)];
+        };
+        std::vector<uint8_t> pixels(width * height * 4, 0xFF);
+        for (auto y = 0; y < height; ++y)
+            for (auto x = 0; x < width; ++x)
+                std::memcpy(pixels.data() + (y * width + x) * 4, get_color(x, y), 3);
+        GLuint tex2d = 0;
+        glGenTextures(1, &tex2d);
+        auto on_return = gsl::finally([&tex2d]() { glDeleteTextures(1, &tex2d); });
+        glBindTexture(GL_TEXTURE_2D, tex2d);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        REQUIRE(glGetError() == GL_NO_ERROR);
+
+        const auto luma = width * height;
+        for (auto layout : {yuv_layout_t::nv12, yuv_layout_t::i420}) {
+            for (auto flip : {false, true}) {
+                CAPTURE(static_cast<int32_t>(layout), flip);
+                const auto planes = read_yuv_planes(tex2d, width, height, layout, flip);
+                // the row `y` of the result is the row `sy` of the source
+                auto source_row = [flip](GLsizei y) { return flip ? height - 1 - y : y; };
+                uint8_t expected[3]{};
+                for (auto y = 0; y < height; ++y) {
+                    for (auto x = 0; x < width; ++x) {
+                        rgb_to_yuv(get_color(x, source_row(y)), expected);
+                        CAPTURE(x, y);
+                        REQUIRE(std::abs(planes[y * width + x] - expected[0]) <= 2);
+                    }
+                }
+                for (auto cy = 0; cy < height / 2; ++cy) {
+                    for (auto cx = 0; cx < width / 2; ++cx) {
+                        rgb_to_yuv(get_color(cx * 2, source_row(cy * 2)), expected);
+                        size_t u = 0, v = 0;
+                        if (layout == yuv_layout_t::nv12) {
+                            u = luma + cy * width + cx * 2;
+                            v = u + 1;
+                        } else {
+                            u = luma + cy * (width / 2) + cx;
+                            v = u + luma / 4;
+                        }
+                        CAPTURE(cx, cy);
+                        REQUIRE(std::abs(planes[u] - expected[1]) <= 2);
+                        REQUIRE(std::abs(planes[v] - expected[2]) <= 2);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE_METHOD(glfw_test_case, "egl_worker_pool_t", "[egl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    SECTION("invalid count") {
+        egl_worker_pool_t pool{glfwGetEGLDisplay(), glfwGetEGLContext(window.get()), 0};
+        REQUIRE(pool.is_valid() == EGL_BAD_PARAMETER);
+        REQUIRE_THROWS(pool.submit([](void*) {}, nullptr));
+    }
+    SECTION("upload in shared context") {
+        egl_worker_pool_t pool{glfwGetEGLDisplay(), glfwGetEGLContext(window.get()), 4};
+        REQUIRE(pool.is_valid() == EGL_SUCCESS);
+        REQUIRE(pool.size() == 4);
+        // the current context must stay after the construction
+        REQUIRE(eglGetCurrentContext() == glfwGetEGLContext(window.get()));
+
+        GLuint textures[8]{};
+        std::future<EGLSync> fences[8]{};
+        egl_task_t upload = [](void* ptr) {
+            auto& tex2d = *reinterpret_cast<GLuint*>(ptr);
+            std::vector<uint32_t> pixels(64 * 64, 0xFF00FF00); // ABGR
+            glGenTextures(1, &tex2d);
+            glBindTexture(GL_TEXTURE_2D, tex2d);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 64, 64);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 64, 64, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            glBindTexture(GL_TEXTURE_2D, 0);
+        };
+        for (auto i = 0u; i < 8; ++i)
+            fences[i] = pool.submit(upload, textures + i);
+
+        GLuint fbo = 0;
+        glGenFramebuffers(1, &fbo);
+        auto on_return = gsl::finally([&]() {
+            glDeleteFramebuffers(1, &fbo);
+            glDeleteTextures(8, textures);
+        });
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        for (auto i = 0u; i < 8; ++i) {
+            REQUIRE(pool.wait(fences[i].get()) == EGL_SUCCESS);
+            REQUIRE(glIsTexture(textures[i]));
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
+            uint32_t pixel = 0;
+            glReadPixels(32, 32, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, &pixel);
+            REQUIRE(glGetError() == GL_NO_ERROR);
+            REQUIRE(pixel == 0xFF00FF00);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+}
+
+TEST_CASE_METHOD(glfw_test_case, "extension cache", "[egl][opengl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    EGLDisplay es_display = glfwGetEGLDisplay();
+    SECTION("EGL") {
+        for (auto i = 0u; i < static_cast<uint32_t>(egl_extension_t::count); ++i) {
+            const auto name = static_cast<egl_extension_t>(i);
+            CAPTURE(get_name(name));
+            REQUIRE(has_extension(es_display, name) == has_extension(es_display, get_name(name)));
+        }
+    }
+    SECTION("reset_extensions") {
+        REQUIRE(has_extension(es_display, egl_extension_t::KHR_fence_sync) ==
+                has_extension(es_display, get_name(egl_extension_t::KHR_fence_sync)));
+        // the next lookup scans the display again
+        reset_extensions(es_display);
+        for (auto i = 0u; i < static_cast<uint32_t>(egl_extension_t::count); ++i) {
+            const auto name = static_cast<egl_extension_t>(i);
+            CAPTURE(get_name(name));
+            REQUIRE(has_extension(es_display, name) == has_extension(es_display, get_name(name)));
+        }
+    }
+    SECTION("OpenGL ES") {
+        for (auto i = 0u; i < static_cast<uint32_t>(gl_extension_t::count); ++i) {
+            const auto name = static_cast<gl_extension_t>(i);
+            CAPTURE(get_name(name));
+            REQUIRE(has_extension(name) == has_extension(get_name(name)));
+        }
+    }
+    SECTION("no current context") {
+        glfwMakeContextCurrent(nullptr);
+        REQUIRE_FALSE(has_extension(gl_extension_t::KHR_debug));
+    }
+    SECTION("egl_context_t") {
+        // the next context may reuse the destroyed handle. the cache must not return the old bits
+        for (auto repeat = 0; repeat < 2; ++repeat) {
+            egl_context_t context{es_display, EGL_NO_CONTEXT};
+            REQUIRE(context.is_valid());
+            REQUIRE(context.resume() == EGL_SUCCESS);
+            for (auto i = 0u; i < static_cast<uint32_t>(gl_extension_t::count); ++i) {
+                const auto name = static_cast<gl_extension_t>(i);
+                CAPTURE(repeat, get_name(name));
+                REQUIRE(has_extension(name) == has_extension(get_name(name)));
+            }
+        }
+        glfwMakeContextCurrent(window.get());
+    }
+}
+
+TEST_CASE_METHOD(glfw_test_case, "program_cache_t", "[opengl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    const auto directory = fs::temp_directory_path() / "graphics_program_cache";
+    fs::remove_all(directory);
+    constexpr auto vert = R"(#version 300 es
+in vec4 a_position;
+void main() {
+    gl_Position = a_position;
+}
+)";
+    constexpr auto frag = R"(#version 300 es
+precision mediump float;
+out vec4 o_color;
+void main() {
+    o_color = vec4(1.0, 0.0, 0.0, 1.0);
+}
+)";
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    CAPTURE(num_formats);
+    std::string message{};
+    uint32_t hit = 0, miss = 0;
+    {
+        program_cache_t cache{directory};
+        GLuint program = 0;
+        REQUIRE(cache.create(program, vert, frag, message) == GL_NO_ERROR);
+        REQUIRE(glIsProgram(program));
+        glDeleteProgram(program);
+        cache.get_statistics(hit, miss);
+        REQUIRE(hit == 0);
+        REQUIRE(miss == 1);
+    }
+    SECTION("second launch") {
+        program_cache_t cache{directory};
+        GLuint program = 0;
+        REQUIRE(cache.create(program, vert, frag, message) == GL_NO_ERROR);
+        glDeleteProgram(program);
+        cache.get_statistics(hit, miss);
+        REQUIRE(hit == (num_formats > 0 ? 1 : 0));
+    }
+    SECTION("rejected binary") {
+        program_cache_t cache{directory};
+        for (const auto& entry : fs::directory_iterator{directory}) {
+            std::ofstream fout{entry.path(), std::ios::binary | std::ios::in | std::ios::out};
+            fout.seekp(24); // corrupt after the header
+            fout.write("garbage", 7);
+        }
+        GLuint program = 0;
+        REQUIRE(cache.create(program, vert, frag, message) == GL_NO_ERROR);
+        REQUIRE(glIsProgram(program));
+        glDeleteProgram(program);
+    }
+    SECTION("broken length") {
+        program_cache_t cache{directory};
+        for (const auto& entry : fs::directory_iterator{directory}) {
+            std::ofstream fout{entry.path(), std::ios::binary | std::ios::in | std::ios::out};
+            fout.seekp(16); // program_binary_header_t::length
+            const uint32_t length = 0xFFFF'FFF0;
+            fout.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        }
+        GLuint program = 0;
+        REQUIRE(cache.create(program, vert, frag, message) == GL_NO_ERROR);
+        REQUIRE(glIsProgram(program));
+        glDeleteProgram(program);
+        cache.get_statistics(hit, miss);
+        REQUIRE(hit == 0);
+        REQUIRE(miss == 1);
+    }
+    SECTION("compile error") {
+        program_cache_t cache{directory};
+        GLuint program = 0;
+        REQUIRE(cache.create(program, vert, "#version 300 es\n void main() { error }", message) == GL_INVALID_OPERATION);
+        REQUIRE(program == 0);
+        REQUIRE_FALSE(message.empty());
+    }
+}
+
+TEST_CASE_METHOD(glfw_test_case, "program_batch_t", "[opengl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    constexpr auto vert = R"(#version 300 es
+in vec4 a_position;
+void main() {
+    gl_Position = a_position;
+}
+)";
+    std::vector<std::string> frags{};
+    for (auto i = 0; i < 8; ++i)
+        frags.emplace_back(fmt::format(R"(#version 300 es
+precision mediump float;
+out vec4 o_color;
+void main() {{
+    o_color = vec4({}.0 / 8.0, 0.0, 0.0, 1.0);
+}}
+)",
+                                       i));
+    std::vector<program_source_t> sources{};
+    for (const auto& frag : frags)
+        sources.emplace_back(program_source_t{vert, frag});
+    sources.emplace_back(program_source_t{vert, "#version 300 es\n void main() { error }"});
+
+    program_batch_t batch{sources};
+    REQUIRE(batch.size() == sources.size());
+    CAPTURE(batch.is_parallel());
+    while (batch.poll() < batch.size())
+        std::this_thread::yield();
+
+    std::string message{};
+    for (auto i = 0u; i < frags.size(); ++i) {
+        GLuint program = 0;
+        REQUIRE(batch.get(i, program, message) == GL_NO_ERROR);
+        REQUIRE(glIsProgram(program));
+        glDeleteProgram(program);
+        // already taken
+        REQUIRE(batch.get(i, program, message) == GL_INVALID_VALUE);
+    }
+    GLuint program = 0;
+    REQUIRE(batch.get(frags.size(), program, message) == GL_INVALID_OPERATION);
+    REQUIRE(program == 0);
+    REQUIRE_FALSE(message.empty());
+    REQUIRE(glGetError() == GL_NO_ERROR);
+}
+
+static_assert(hash_name("") == 0x811c9dc5);
+static_assert(hash_name("a") == 0xe40c292c);
+
+TEST_CASE_METHOD(glfw_test_case, "gl_program_t", "[opengl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    constexpr auto vert = R"(#version 300 es
+layout(std140) uniform Transform {
+    mat4 u_mvp;
+};
+uniform vec2 u_offsets[4];
+in vec4 a_position;
+in vec2 a_uv;
+out vec2 v_uv;
+void main() {
+    v_uv = a_uv + u_offsets[gl_VertexID % 4];
+    gl_Position = u_mvp * a_position;
+}
+)";
+    constexpr auto frag = R"(#version 300 es
+precision mediump float;
+uniform vec4 u_color;
+in vec2 v_uv;
+out vec4 o_color;
+void main() {
+    o_color = u_color * vec4(v_uv, 0.0, 1.0);
+}
+)";
+    const auto directory = fs::temp_directory_path() / "graphics_program_cache";
+    program_cache_t cache{directory};
+    GLuint handle = 0;
+    std::string message{};
+    REQUIRE(cache.create(handle, vert, frag, message) == GL_NO_ERROR);
+
+    gl_program_t program{handle};
+    REQUIRE(program.is_valid() == GL_NO_ERROR);
+    REQUIRE(program.handle() == handle);
+    REQUIRE(program.get_uniform(hash_name("u_color")) == glGetUniformLocation(handle, "u_color"));
+    REQUIRE(program.get_uniform(hash_name("u_offsets")) == glGetUniformLocation(handle, "u_offsets"));
+    REQUIRE(program.get_uniform(hash_name("u_offsets[0]")) == glGetUniformLocation(handle, "u_offsets"));
+    REQUIRE(program.get_uniform(hash_name("u_unknown")) == -1);
+    REQUIRE(program.get_uniform_block(hash_name("Transform")) == glGetUniformBlockIndex(handle, "Transform"));
+    REQUIRE(program.get_uniform_block(hash_name("u_mvp")) == GL_INVALID_INDEX);
+    REQUIRE(program.get_attribute(hash_name("a_position")) == glGetAttribLocation(handle, "a_position"));
+    REQUIRE(program.get_attribute(hash_name("a_uv")) == glGetAttribLocation(handle, "a_uv"));
+
+    const auto entry = program.find_uniform(hash_name("u_offsets"));
+    REQUIRE(entry);
+    REQUIRE(entry->type == GL_FLOAT_VEC2);
+    REQUIRE(entry->size == 4);
+    const auto uniforms = program.get_uniforms();
+    REQUIRE(std::is_sorted(uniforms.begin(), uniforms.end(), [](const auto& lhs, const auto& rhs) { //
+        return lhs.hash < rhs.hash;
+    }));
+}
+
+// found with a brute-force search. FNV-1a 32 bit collision
+static_assert(hash_name("u_29pay6h8") == hash_name("u_72q47w30"));
+
+TEST_CASE_METHOD(glfw_test_case, "gl_program_t hash collision", "[opengl][glfw]") {
+    glfwMakeContextCurrent(window.get());
+    constexpr auto vert = R"(#version 300 es
+in vec4 a_position;
+void main() {
+    gl_Position = a_position;
+}
+)";
+    constexpr auto frag = R"(#version 300 es
+precision mediump float;
+uniform float u_29pay6h8;
+uniform float u_72q47w30;
+uniform vec4 u_color;
+out vec4 o_color;
+void main() {
+    o_color = u_color * (u_29pay6h8 + u_72q47w30);
+}
+)";
+    const auto directory = fs::temp_directory_path() / "graphics_program_cache";
+    program_cache_t cache{directory};
+    GLuint handle = 0;
+    std::string message{};
+    REQUIRE(cache.create(handle, vert, frag, message) == GL_NO_ERROR);
+    REQUIRE(glGetUniformLocation(handle, "u_29pay6h8") >= 0);
+    REQUIRE(glGetUniformLocation(handle, "u_72q47w30") >= 0);
+
+    gl_program_t program{handle};
+    REQUIRE(program.is_valid() == GL_NO_ERROR);
+    // both names must miss. returning the other's location is a silent error
+    REQUIRE(program.get_uniform(hash_name("u_29pay6h8")) == -1);
+    REQUIRE(program.get_uniform(hash_name("u_72q47w30")) == -1);
+    REQUIRE(program.find_uniform(hash_name("u_72q47w30")) == nullptr);
+    REQUIRE(program.get_uniform(hash_name("u_color")) == glGetUniformLocation(handle, "u_color"));
+    REQUIRE(program.get_uniforms().size() == 1);
 }
 
 auto start_opengl_test() -> gsl::final_action<void (*)()> {
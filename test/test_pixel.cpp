@@ -0,0 +1,127 @@
+#include <catch2/catch.hpp>
+#include <spdlog/spdlog.h>
+#include <graphics.h>
+#include <gsl/gsl>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/// @note odd count to run both of the SIMD body and the scalar tail
+constexpr size_t pixel_count = 37;
+
+auto make_pixels(size_t count) -> std::vector<uint8_t> {
+    std::vector<uint8_t> pixels(count * 4);
+    for (size_t i = 0; i < pixels.size(); ++i)
+        pixels[i] = static_cast<uint8_t>(i * 37 + 11);
+    return pixels;
+}
+
+TEST_CASE("pixel kernels", "[pixel]") {
+    const std::string selected{get_pixel_kernel_name()};
+    auto on_return = gsl::finally([&selected]() { use_pixel_kernels(selected); });
+    REQUIRE_FALSE(use_pixel_kernels("unknown"));
+    // run the checks with every kernel set the CPU supports
+    const auto name = GENERATE(as<std::string>{}, "avx2", "ssse3", "sse2", "neon", "scalar");
+    if (use_pixel_kernels(name) == false) {
+        spdlog::warn("pixel kernels: {} is not supported", name);
+        return;
+    }
+    REQUIRE(get_pixel_kernel_name() == name);
+    const auto src = make_pixels(pixel_count);
+
+    SECTION("swizzle_rgba_bgra") {
+        std::vector<uint8_t> dst(src.size());
+        swizzle_rgba_bgra(src.data(), dst.data(), pixel_count);
+        for (size_t i = 0; i < pixel_count; ++i) {
+            REQUIRE(dst[i * 4 + 0] == src[i * 4 + 2]);
+            REQUIRE(dst[i * 4 + 1] == src[i * 4 + 1]);
+            REQUIRE(dst[i * 4 + 2] == src[i * 4 + 0]);
+            REQUIRE(dst[i * 4 + 3] == src[i * 4 + 3]);
+        }
+        auto inplace = src;
+        swizzle_rgba_bgra(inplace.data(), inplace.data(), pixel_count);
+        REQUIRE(inplace == dst);
+    }
+    SECTION("convert_rgba_rgb") {
+        std::vector<uint8_t> dst(pixel_count * 3);
+        convert_rgba_rgb(src.data(), dst.data(), pixel_count);
+        for (size_t i = 0; i < pixel_count; ++i)
+            for (size_t c = 0; c < 3; ++c)
+                REQUIRE(dst[i * 3 + c] == src[i * 4 + c]);
+        auto inplace = src;
+        convert_rgba_rgb(inplace.data(), inplace.data(), pixel_count);
+        REQUIRE(std::equal(dst.begin(), dst.end(), inplace.begin()));
+    }
+    SECTION("premultiply_rgba") {
+        std::vector<uint8_t> dst(src.size());
+        premultiply_rgba(src.data(), dst.data(), pixel_count);
+        for (size_t i = 0; i < pixel_count; ++i) {
+            const auto a = src[i * 4 + 3];
+            for (size_t c = 0; c < 3; ++c)
+                REQUIRE(dst[i * 4 + c] == static_cast<uint8_t>(src[i * 4 + c] * a / 255.0f + 0.5f));
+            REQUIRE(dst[i * 4 + 3] == a);
+        }
+        auto inplace = src;
+        premultiply_rgba(inplace.data(), inplace.data(), pixel_count);
+        REQUIRE(inplace == dst);
+    }
+    SECTION("flip_rows") {
+        constexpr size_t stride = 1000;
+        constexpr uint32_t rows = 5;
+        std::vector<uint8_t> image(stride * rows);
+        for (size_t i = 0; i < image.size(); ++i)
+            image[i] = static_cast<uint8_t>(i / stride);
+        std::vector<uint8_t> dst(image.size());
+        flip_rows(image.data(), dst.data(), stride, rows);
+        REQUIRE(dst.front() == rows - 1);
+        REQUIRE(dst.back() == 0);
+        flip_rows(image.data(), image.data(), stride, rows);
+        REQUIRE(image == dst);
+    }
+}
+
+/// @brief log GB/s of the `kernel` with the input byte length
+template <typename Fn>
+void report_throughput(std::string_view name, size_t length, Fn&& kernel) {
+    using namespace std::chrono;
+    constexpr auto repeat = 20;
+    const auto start = high_resolution_clock::now();
+    for (auto i = 0; i < repeat; ++i)
+        kernel();
+    const duration<double> elapsed = high_resolution_clock::now() - start;
+    spdlog::info("{}: {:.2f} GB/s", name, (length * repeat) / elapsed.count() / 1e9);
+}
+
+/// @see assets/image_2160_3840.png
+TEST_CASE("pixel kernels throughput", "[pixel][!benchmark]") {
+    const auto size = GENERATE(std::pair<uint32_t, uint32_t>{1920, 1080}, //
+                               std::pair<uint32_t, uint32_t>{2160, 3840});
+    const uint32_t width = size.first, height = size.second;
+    const size_t count = width * height;
+    const auto src = make_pixels(count);
+    std::vector<uint8_t> dst(src.size());
+    spdlog::info("{}x{} ({})", width, height, get_pixel_kernel_name());
+
+    report_throughput("swizzle_rgba_bgra", src.size(), [&]() { swizzle_rgba_bgra(src.data(), dst.data(), count); });
+    report_throughput("convert_rgba_rgb", src.size(), [&]() { convert_rgba_rgb(src.data(), dst.data(), count); });
+    report_throughput("premultiply_rgba", src.size(), [&]() { premultiply_rgba(src.data(), dst.data(), count); });
+    report_throughput("flip_rows", src.size(), [&]() { flip_rows(src.data(), dst.data(), width * 4, height); });
+
+    BENCHMARK("swizzle_rgba_bgra") {
+        swizzle_rgba_bgra(src.data(), dst.data(), count);
+        return dst[0];
+    };
+    BENCHMARK("convert_rgba_rgb") {
+        convert_rgba_rgb(src.data(), dst.data(), count);
+        return dst[0];
+    };
+    BENCHMARK("premultiply_rgba") {
+        premultiply_rgba(src.data(), dst.data(), count);
+        return dst[0];
+    };
+    BENCHMARK("flip_rows") {
+        flip_rows(src.data(), dst.data(), width * 4, height);
+        return dst[0];
+    };
+}
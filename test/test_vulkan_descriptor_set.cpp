@@ -4,6 +4,7 @@
 
 #include <catch2/catch.hpp>
 #include <spdlog/spdlog.h>
+#include <graphics.h>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #define STB_IMAGE_IMPLEMENTATION
@@ -141,12 +142,14 @@ VkResult read_image_data(VkDevice device, const VkPhysicalDeviceMemoryProperties
                          VkBuffer& buffer, VkDeviceMemory& memory,                         //
                          const fs::path& fpath) {
     auto stream = get_current_stream();
-    auto fin = open(fpath);
+    const mapped_file_t file{fpath};
+    const auto encoded = file.get();
     int width = 0, height = 0;
     component = STBI_rgb_alpha;
-    auto blob = std::unique_ptr<void, void (*)(void*)>{stbi_load_from_file(fin.get(), //
-                                                                           &width, &height, &component, component),
-                                                       &stbi_image_free};
+    auto blob = std::unique_ptr<void, void (*)(void*)>{
+        stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(encoded.data()), gsl::narrow_cast<int>(encoded.size()),
+                              &width, &height, &component, component),
+        &stbi_image_free};
     if (blob == nullptr)
         throw std::runtime_error{stbi_failure_reason()};
     extent.width = width;
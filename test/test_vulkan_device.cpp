@@ -2,8 +2,13 @@
 #include <spdlog/spdlog.h>
 
 #include "vulkan_1.h"
+#include <graphics.h>
 
 #include <GLFW/glfw3.h>
+#include <cstring>
+#include <vector>
+
+using namespace std;
 
 auto get_current_stream() noexcept -> std::shared_ptr<spdlog::logger>;
 fs::path get_asset_dir() noexcept;
@@ -288,4 +293,274 @@ TEST_CASE("VkDevice", "[vulkan]") {
         vkGetDeviceQueue(device, queues[2].queueFamilyIndex, 0, handles + 2);
         REQUIRE(handles[2] != VK_NULL_HANDLE);
     }
-}
\ No newline at end of file
+    SECTION("queue set") {
+        VkDevice device = VK_NULL_HANDLE;
+        vulkan_queue_set_t queues{};
+        REQUIRE(create_device(gpu, nullptr, 0, device, queues) == VK_SUCCESS);
+        auto on_return = gsl::finally([device]() { //
+            vkDestroyDevice(device, nullptr);
+        });
+        for (const auto& queue : {queues.graphics, queues.present, queues.compute, queues.transfer}) {
+            REQUIRE(queue.family < count);
+            REQUIRE(queue.index < properties[queue.family].queueCount);
+            REQUIRE(queue.handle != VK_NULL_HANDLE);
+        }
+        REQUIRE(properties[queues.graphics.family].queueFlags & VK_QUEUE_GRAPHICS_BIT);
+        REQUIRE(properties[queues.compute.family].queueFlags & VK_QUEUE_COMPUTE_BIT);
+        // without surface, the presentation shares the graphics queue
+        REQUIRE(queues.present.handle == queues.graphics.handle);
+    }
+}
+TEST_CASE("vulkan_allocator_t", "[vulkan]") {
+    const char* layers[1]{"VK_LAYER_KHRONOS_validation"};
+    vulkan_instance_t instance{__func__, gsl::make_span(layers, 1), {}};
+
+    VkPhysicalDevice gpu{};
+    REQUIRE(get_physical_device(instance.handle, gpu) == VK_SUCCESS);
+    VkDevice device{};
+    VkDeviceQueueCreateInfo qinfo{};
+    REQUIRE(create_device(gpu, device, qinfo) == VK_SUCCESS);
+    auto on_return = gsl::finally([device]() { //
+        vkDestroyDevice(device, nullptr);
+    });
+    const auto desired = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VkMemoryRequirements requirements{};
+    requirements.memoryTypeBits = UINT32_MAX;
+    requirements.alignment = 256;
+
+    SECTION("sub-allocation") {
+        vulkan_allocator_t allocator{device, gpu, 1 << 20};
+        vulkan_allocation_t allocations[16]{};
+        for (auto i = 0u; i < 16; ++i) {
+            requirements.size = 1000 * (i + 1);
+            REQUIRE(allocator.allocate(requirements, desired, true, allocations[i]) == VK_SUCCESS);
+            REQUIRE(allocations[i].mapping);
+            REQUIRE(allocations[i].offset % requirements.alignment == 0);
+        }
+        auto stats = allocator.get_stats();
+        REQUIRE(stats.block_count == 1);
+        REQUIRE(stats.allocation_count == 16);
+        REQUIRE(stats.used <= stats.allocated);
+        for (auto i = 0u; i < 16; i += 2)
+            allocator.free(allocations[i]);
+        REQUIRE(allocator.get_stats().fragmentation > 0);
+        for (auto i = 1u; i < 16; i += 2)
+            allocator.free(allocations[i]);
+        stats = allocator.get_stats();
+        REQUIRE(stats.allocated == 0);
+        REQUIRE(stats.fragmentation == 0);
+        REQUIRE(stats.largest_free == 1 << 20);
+    }
+    SECTION("dedicated") {
+        vulkan_allocator_t allocator{device, gpu, 1 << 20};
+        vulkan_allocation_t allocation{};
+        requirements.size = 1 << 20;
+        REQUIRE(allocator.allocate(requirements, desired, true, allocation) == VK_SUCCESS);
+        REQUIRE(allocation.block == vulkan_allocation_t::dedicated);
+        REQUIRE(allocator.get_stats().dedicated_count == 1);
+        allocator.free(allocation);
+        REQUIRE(allocator.get_stats().dedicated_count == 0);
+    }
+    SECTION("update_budget") {
+        vulkan_allocator_t allocator{device, gpu, 1 << 20};
+        vulkan_allocation_t allocations[2]{};
+        requirements.size = 1000;
+        REQUIRE(allocator.allocate(requirements, desired, true, allocations[0]) == VK_SUCCESS);
+        // the rankings are dropped. the next allocation uses the new ones
+        allocator.update_budget();
+        REQUIRE(allocator.allocate(requirements, desired, true, allocations[1]) == VK_SUCCESS);
+        REQUIRE(allocations[1].memory_type == allocations[0].memory_type);
+        for (auto& allocation : allocations)
+            allocator.free(allocation);
+    }
+}
+
+TEST_CASE("vulkan_memory_selector_t", "[vulkan]") {
+    const char* layers[1]{"VK_LAYER_KHRONOS_validation"};
+    vulkan_instance_t instance{__func__, gsl::make_span(layers, 1), {}};
+
+    VkPhysicalDevice gpu{};
+    REQUIRE(get_physical_device(instance.handle, gpu) == VK_SUCCESS);
+    vulkan_memory_selector_t selector{gpu};
+    const auto props = selector.get_properties();
+
+    const VkMemoryPropertyFlags required[]{VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
+    for (auto flags : required) {
+        const auto index = selector.select(UINT32_MAX, flags);
+        REQUIRE(index < props.memoryTypeCount);
+        REQUIRE((props.memoryTypes[index].propertyFlags & flags) == flags);
+        // same with the uncached version
+        REQUIRE(index == get_memory_type(props, UINT32_MAX, flags));
+        const auto ranking = selector.get_ranking(flags);
+        REQUIRE(ranking.count > 0);
+        REQUIRE(ranking.types[0] == index);
+    }
+    REQUIRE(selector.select(0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) == UINT32_MAX);
+}
+
+TEST_CASE("vulkan_uploader_t", "[vulkan]") {
+    const char* layers[1]{"VK_LAYER_KHRONOS_validation"};
+    vulkan_instance_t instance{__func__, gsl::make_span(layers, 1), {}};
+
+    VkPhysicalDevice gpu{};
+    REQUIRE(get_physical_device(instance.handle, gpu) == VK_SUCCESS);
+    if (is_timeline_semaphore_supported(gpu) == false)
+        return;
+    VkDevice device{};
+    VkDeviceQueueCreateInfo qinfo{};
+    REQUIRE(create_device(gpu, device, qinfo) == VK_SUCCESS);
+    auto on_return = gsl::finally([device]() { //
+        vkDestroyDevice(device, nullptr);
+    });
+    VkQueue queue{};
+    vkGetDeviceQueue(device, qinfo.queueFamilyIndex, 0, &queue);
+    vulkan_allocator_t allocator{device, gpu};
+
+    // host visible destination to read the result. the ring is smaller than the data
+    const auto desired = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    std::vector<uint32_t> data(1 << 20);
+    for (auto i = 0u; i < data.size(); ++i)
+        data[i] = i;
+    VkBufferCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = data.size() * sizeof(uint32_t);
+    info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer buffer{};
+    REQUIRE(vkCreateBuffer(device, &info, nullptr, &buffer) == VK_SUCCESS);
+    vulkan_allocation_t allocation{};
+    auto on_return_1 = gsl::finally([&]() {
+        allocator.free(allocation);
+        vkDestroyBuffer(device, buffer, nullptr);
+    });
+    REQUIRE(allocator.allocate(buffer, desired, allocation) == VK_SUCCESS);
+
+    uint64_t value = 0;
+    {
+        vulkan_uploader_t uploader{device, allocator, queue, qinfo.queueFamilyIndex, queue, qinfo.queueFamilyIndex,
+                                   1 << 20};
+        REQUIRE(uploader.copy(buffer, 0, gsl::as_bytes(gsl::make_span(data)), VK_ACCESS_HOST_READ_BIT) ==
+                VK_SUCCESS);
+        REQUIRE(uploader.submit(value, VK_PIPELINE_STAGE_HOST_BIT) == VK_SUCCESS);
+        REQUIRE(value > 0);
+        REQUIRE(uploader.wait(value) == VK_SUCCESS);
+    }
+    REQUIRE(std::memcmp(allocation.mapping, data.data(), info.size) == 0);
+}
+
+TEST_CASE("vulkan_uploader_t with transfer family", "[vulkan]") {
+    const char* layers[1]{"VK_LAYER_KHRONOS_validation"};
+    vulkan_instance_t instance{__func__, gsl::make_span(layers, 1), {}};
+
+    VkPhysicalDevice gpu{};
+    REQUIRE(get_physical_device(instance.handle, gpu) == VK_SUCCESS);
+    if (is_timeline_semaphore_supported(gpu) == false)
+        return;
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &count, nullptr);
+    auto families = std::make_unique<VkQueueFamilyProperties[]>(count);
+    vkGetPhysicalDeviceQueueFamilyProperties(gpu, &count, families.get());
+    if (get_transfer_queue_available(families.get(), count) == UINT32_MAX) {
+        WARN("no transfer-only queue family. the release/acquire path is not tested");
+        return;
+    }
+    VkDevice device{};
+    vulkan_queue_set_t queues{};
+    REQUIRE(create_device(gpu, nullptr, 0, device, queues) == VK_SUCCESS);
+    auto on_return = gsl::finally([device]() { //
+        vkDestroyDevice(device, nullptr);
+    });
+    REQUIRE(queues.transfer.family == get_transfer_queue_available(families.get(), count));
+    REQUIRE(queues.transfer.family != queues.graphics.family);
+    vulkan_allocator_t allocator{device, gpu};
+
+    // the ring is smaller than the data. the batches are submitted in the middle of the copies
+    const auto desired = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    std::vector<uint32_t> data(1 << 18);
+    for (auto i = 0u; i < data.size(); ++i)
+        data[i] = ~i;
+    VkBufferCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = data.size() * sizeof(uint32_t);
+    info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer buffers[4]{};
+    vulkan_allocation_t allocations[4]{};
+    auto on_return_1 = gsl::finally([&]() {
+        for (auto i = 0u; i < 4; ++i) {
+            allocator.free(allocations[i]);
+            vkDestroyBuffer(device, buffers[i], nullptr);
+        }
+    });
+    for (auto i = 0u; i < 4; ++i) {
+        REQUIRE(vkCreateBuffer(device, &info, nullptr, buffers + i) == VK_SUCCESS);
+        REQUIRE(allocator.allocate(buffers[i], desired, allocations[i]) == VK_SUCCESS);
+    }
+    uint64_t value = 0;
+    {
+        vulkan_uploader_t uploader{device,
+                                   allocator,
+                                   queues.transfer.handle,
+                                   queues.transfer.family,
+                                   queues.graphics.handle,
+                                   queues.graphics.family,
+                                   256 << 10};
+        for (auto buffer : buffers)
+            REQUIRE(uploader.copy(buffer, 0, gsl::as_bytes(gsl::make_span(data)), VK_ACCESS_HOST_READ_BIT) ==
+                    VK_SUCCESS);
+        REQUIRE(uploader.submit(value, VK_PIPELINE_STAGE_HOST_BIT) == VK_SUCCESS);
+        // the release in the transfer queue and the acquire in the graphics queue. 2 values for each batch
+        REQUIRE(value >= 2);
+        REQUIRE(uploader.wait(value) == VK_SUCCESS);
+    }
+    for (const auto& allocation : allocations)
+        REQUIRE(std::memcmp(allocation.mapping, data.data(), info.size) == 0);
+}
+
+TEST_CASE("gpu_timeline_t", "[vulkan]") {
+    const char* layers[1]{"VK_LAYER_KHRONOS_validation"};
+    vulkan_instance_t instance{__func__, gsl::make_span(layers, 1), {}};
+
+    VkPhysicalDevice gpu{};
+    REQUIRE(get_physical_device(instance.handle, gpu) == VK_SUCCESS);
+    if (is_timeline_semaphore_supported(gpu) == false)
+        return;
+    VkDevice device{};
+    vulkan_queue_set_t queues{};
+    REQUIRE(create_device(gpu, nullptr, 0, device, queues) == VK_SUCCESS);
+    auto on_return = gsl::finally([device]() { //
+        vkDestroyDevice(device, nullptr);
+    });
+    gpu_timeline_t graphics{device};
+    gpu_timeline_t compute{device};
+    REQUIRE(graphics.is_valid() == VK_SUCCESS);
+    REQUIRE(compute.is_valid() == VK_SUCCESS);
+
+    SECTION("cross queue") {
+        // graphics -> compute -> host. no fence in the middle
+        const timeline_point_t point1{graphics.handle, graphics.advance()};
+        REQUIRE(timeline_submit(queues.graphics.handle, {}, {}, gsl::make_span(&point1, 1)) == VK_SUCCESS);
+        const timeline_point_t point2{compute.handle, compute.advance()};
+        REQUIRE(timeline_submit(queues.compute.handle, {}, gsl::make_span(&point1, 1), gsl::make_span(&point2, 1)) ==
+                VK_SUCCESS);
+        auto future = compute.get_future(point2.value);
+        REQUIRE(future.get_type() == gpu_future_t::type_t::vulkan);
+        REQUIRE(future.wait(std::chrono::seconds{1}) == 0);
+        REQUIRE(future.is_ready());
+        uint64_t value = 0;
+        REQUIRE(graphics.query(value) == VK_SUCCESS);
+        REQUIRE(value >= point1.value);
+    }
+    SECTION("host signal") {
+        // the queue waits for the point from the host
+        const timeline_point_t point1{graphics.handle, graphics.advance()};
+        const timeline_point_t point2{compute.handle, compute.advance()};
+        REQUIRE(timeline_submit(queues.compute.handle, {}, gsl::make_span(&point1, 1), gsl::make_span(&point2, 1)) ==
+                VK_SUCCESS);
+        REQUIRE(compute.wait(point2.value, std::chrono::milliseconds{1}) == VK_TIMEOUT);
+        REQUIRE(graphics.signal(point1.value) == VK_SUCCESS);
+        const timeline_point_t points[2]{point1, point2};
+        REQUIRE(wait_timeline_points(device, points, std::chrono::seconds{1}) == VK_SUCCESS);
+    }
+}
@@ -114,11 +114,11 @@ TEST_CASE("Render Offscreen", "[vulkan]") {
         REQUIRE(vkCreateImage(device, &info, nullptr, &handle) == VK_SUCCESS);
         VkMemoryRequirements requirements{};
         vkGetImageMemoryRequirements(device, handle, &requirements);
-        VkMemoryAllocateInfo meminfo{};
-        meminfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        meminfo.allocationSize = requirements.size;
-        // meminfo.memoryTypeIndex;
-        REQUIRE(vkAllocateMemory(device, &meminfo, nullptr, &memory) == VK_SUCCESS);
+        VkMemoryAllocateInfo allocate_info{};
+        allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocate_info.allocationSize = requirements.size;
+        // allocate_info.memoryTypeIndex;
+        REQUIRE(vkAllocateMemory(device, &allocate_info, nullptr, &memory) == VK_SUCCESS);
         REQUIRE(vkBindImageMemory(device, handle, memory, 0) == VK_SUCCESS);
     }
     auto image_views = make_unique<VkImageView[]>(num_images);
@@ -177,6 +177,34 @@ TEST_CASE("Render Offscreen", "[vulkan]") {
         REQUIRE(vkWaitForFences(fence.device, 1, &fence.handle, VK_TRUE, timeout) == VK_SUCCESS);
         REQUIRE(vkResetFences(fence.device, 1, &fence.handle) == VK_SUCCESS);
     }
+    // record the draws with the multiple threads. each secondary buffer binds its own pipeline
+    struct draw_list_t final {
+        vulkan_pipeline_t& pipeline;
+        vulkan_pipeline_input_t& input;
+    } draws{pipeline, *input};
+    auto record_draws = [](void* user_data, VkCommandBuffer commands, uint32_t begin, uint32_t end) {
+        auto& list = *reinterpret_cast<draw_list_t*>(user_data);
+        vkCmdBindPipeline(commands, VK_PIPELINE_BIND_POINT_GRAPHICS, list.pipeline.handle);
+        for (auto i = begin; i < end; ++i)
+            list.input.record(commands, list.pipeline.handle, list.pipeline.layout);
+    };
+    vulkan_parallel_recorder_t parallel{device, index, std::max(2u, std::thread::hardware_concurrency())};
+    for (auto i = 0u; i < num_images; ++i) {
+        {
+            vulkan_command_recorder_t recorder{command_pool.buffers[i], renderpass.handle, framebuffers[i], //
+                                               image_extent, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS};
+            VkCommandBufferInheritanceInfo inheritance{};
+            inheritance.renderPass = renderpass.handle;
+            inheritance.framebuffer = framebuffers[i];
+            REQUIRE(parallel.record(recorder.commands, i % parallel.frame_count, inheritance, //
+                                    1000, 64, record_draws, &draws) == VK_SUCCESS);
+        }
+        REQUIRE(render_submit(queues[0],                                         //
+                              gsl::make_span(command_pool.buffers.get() + i, 1), //
+                              fence.handle, VK_NULL_HANDLE, VK_NULL_HANDLE) == VK_SUCCESS);
+        REQUIRE(vkWaitForFences(fence.device, 1, &fence.handle, VK_TRUE, 1'000'000'000) == VK_SUCCESS);
+        REQUIRE(vkResetFences(fence.device, 1, &fence.handle) == VK_SUCCESS);
+    }
     REQUIRE(vkDeviceWaitIdle(device) == VK_SUCCESS);
 }
 
@@ -251,50 +279,26 @@ TEST_CASE("render single surface", "[vulkan][glfw]") {
             REQUIRE(vkDeviceWaitIdle(device) == VK_SUCCESS);
         });
 
-        // command buffer
-        vulkan_command_pool_t command_pool{device, graphics_index, presentation->num_images};
-        for (auto i = 0u; i < presentation->num_images; ++i) {
-            // record: command buffer + renderpass + pipeline
-            vulkan_command_recorder_t recorder{command_pool.buffers[i], renderpass.handle,
-                                               presentation->framebuffers[i], capabilities.maxImageExtent};
-            vkCmdBindPipeline(recorder.commands, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
-            input->record(recorder.commands, pipeline.handle, pipeline.layout);
-        }
-
-        // synchronization + timer
+        // frames in flight: recording of the next frame overlaps with the GPU execution
+        vulkan_frame_scheduler_t scheduler{device, graphics_index, 2, presentation->num_images};
         stop_watch_t timer{};
-        vulkan_semaphore_t semaphore_1{device}; // image ready
-        vulkan_semaphore_t semaphore_2{device}; // rendering
-        vulkan_fence_t fence{device};
 
         auto repeat = 120u;
         while (!glfwWindowShouldClose(window.get()) && repeat--) {
             glfwPollEvents();
-            /// render: select command buffer for current image and submit to GFX queue
             uint32_t image_index{};
+            VkCommandBuffer commands{};
+            if (auto ec = scheduler.begin(swapchain->handle, image_index, commands); ec < VK_SUCCESS)
+                FAIL(ec);
             {
-                if (auto ec = vkAcquireNextImageKHR(device, swapchain->handle, UINT64_MAX, semaphore_1.handle,
-                                                    VK_NULL_HANDLE, &image_index))
-                    FAIL(ec);
-                if (auto ec = render_submit(queues[0],                                                   //
-                                            gsl::make_span(command_pool.buffers.get() + image_index, 1), //
-                                            fence.handle, semaphore_1.handle, semaphore_2.handle))
-                    FAIL(ec);
-            }
-            /// present: semaphore for synchronization and request presentation
-            {
-                // glfwSwapBuffers(window);
-                if (auto ec = present_submit(queues[1], image_index, swapchain->handle, semaphore_2.handle))
-                    FAIL(ec);
-                if (auto ec = vkQueueWaitIdle(queues[1]))
-                    FAIL(ec);
+                // record: command buffer + renderpass + pipeline
+                vulkan_command_recorder_t recorder{commands, renderpass.handle, presentation->framebuffers[image_index],
+                                                   capabilities.maxImageExtent};
+                vkCmdBindPipeline(recorder.commands, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
+                input->record(recorder.commands, pipeline.handle, pipeline.layout);
             }
-            /// wait for each loop
-            VkFence fences[1]{fence.handle};
-            uint64_t nano = UINT64_MAX;
-            if (auto ec = vkWaitForFences(device, 1, fences, VK_TRUE, nano))
-                FAIL(ec);
-            if (auto ec = vkResetFences(device, 1, fences))
+            /// render + present: the scheduler submits to the GFX queue and requests presentation
+            if (auto ec = scheduler.end(queues[0], queues[1], swapchain->handle); ec < VK_SUCCESS)
                 FAIL(ec);
             sleep_for_fps(timer, 120);
         }
@@ -405,10 +409,10 @@ TEST_CASE("render multiple surface", "[vulkan][glfw]") {
         });
         // command buffer
         vulkan_command_pool_t command_pool{device, queue_infos[0].queueFamilyIndex, presentation->num_images};
-        for (auto i = 0u; i < presentation->num_images; ++i) {
+        for (auto j = 0u; j < presentation->num_images; ++j) {
             // record: command buffer + renderpass + pipeline
-            vulkan_command_recorder_t recorder{command_pool.buffers[i], //
-                                               renderpass.handle, presentation->framebuffers[i],
+            vulkan_command_recorder_t recorder{command_pool.buffers[j], //
+                                               renderpass.handle, presentation->framebuffers[j],
                                                surfaces[i].capabilities.maxImageExtent};
             vkCmdBindPipeline(recorder.commands, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
             input.record(recorder.commands, pipeline.handle, pipeline.layout);
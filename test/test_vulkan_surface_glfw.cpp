@@ -186,6 +186,46 @@ TEST_CASE("VkDevice + VkSurfaceKHR", "[vulkan][glfw]") {
     REQUIRE(handles[1] != VK_NULL_HANDLE);
 }
 
+TEST_CASE("VkDevice + VkSurfaceKHR + vulkan_queue_set_t", "[vulkan][glfw]") {
+    auto stream = get_current_stream();
+    auto glfw = open_glfw();
+    auto instance = make_vulkan_instance_glfw("app0");
+    REQUIRE(instance.handle);
+
+    VkPhysicalDevice physical_device{};
+    REQUIRE(get_physical_device(instance.handle, physical_device) == VK_SUCCESS);
+
+    vulkan_surface_owner_t surface{"window0", instance.handle, physical_device};
+
+    uint32_t count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, nullptr);
+    auto properties = std::make_unique<VkQueueFamilyProperties[]>(count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, properties.get());
+    // the first family which can do both graphics and presentation
+    uint32_t both = UINT32_MAX;
+    for (auto i = 0u; i < count && both == UINT32_MAX; ++i) {
+        VkBool32 support = false;
+        REQUIRE(vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, surface.handle, &support) == VK_SUCCESS);
+        if (support && (properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+            both = i;
+    }
+
+    VkDevice device = VK_NULL_HANDLE;
+    vulkan_queue_set_t queues{};
+    REQUIRE(create_device(physical_device, &surface.handle, 1, device, queues) == VK_SUCCESS);
+    auto on_return_2 = gsl::finally([device]() { //
+        vkDestroyDevice(device, nullptr);
+    });
+    if (both != UINT32_MAX) {
+        REQUIRE(queues.graphics.family == both);
+        REQUIRE(queues.present.family == both);
+        REQUIRE(queues.present.handle == queues.graphics.handle);
+    } else {
+        REQUIRE(queues.graphics.family != queues.present.family);
+    }
+    REQUIRE(properties[queues.graphics.family].queueFlags & VK_QUEUE_GRAPHICS_BIT);
+}
+
 TEST_CASE("VkDevice + VkSurfaceKHR[]", "[vulkan][glfw]") {
     auto stream = get_current_stream();
     auto glfw = open_glfw();
@@ -0,0 +1,59 @@
+/**
+ * @brief   Pack the files under the directory into one `asset_archive_t`
+ * @code
+ * asset_packer <output> <asset_dir> [--lz4|--zstd] [--align <N>]
+ * @endcode
+ */
+#include <graphics.h>
+#include <spdlog/spdlog.h>
+
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        spdlog::error("usage: {} <output> <asset_dir> [--lz4|--zstd] [--align <N>]", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const fs::path output{argv[1]};
+    const fs::path asset_dir{argv[2]};
+    archive_codec_t codec = archive_codec_t::none;
+    uint32_t alignment = 64;
+    for (int i = 3; i < argc; ++i) {
+        const std::string_view option{argv[i]};
+        if (option == "--lz4")
+            codec = archive_codec_t::lz4;
+        else if (option == "--zstd")
+            codec = archive_codec_t::zstd;
+        else if (option == "--align" && i + 1 < argc)
+            alignment = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else {
+            spdlog::error("unknown option: {}", option);
+            return EXIT_FAILURE;
+        }
+    }
+    try {
+        std::vector<archive_source_t> sources{};
+        for (const auto& entry : fs::recursive_directory_iterator{asset_dir}) {
+            if (entry.is_regular_file() == false)
+                continue;
+            const auto name = fs::relative(entry.path(), asset_dir).generic_u8string();
+            sources.emplace_back(archive_source_t{name, entry.path()});
+        }
+        write_archive(output, sources, codec, alignment);
+        const asset_archive_t archive{output};
+        uint64_t size = 0, stored_size = 0;
+        for (const auto& entry : archive.get_entries()) {
+            size += entry.size;
+            stored_size += entry.stored_size;
+        }
+        spdlog::info("{}: {} entries, {} -> {} bytes", output.generic_u8string(), archive.size(), size, stored_size);
+    } catch (const std::exception& ex) {
+        spdlog::error(ex.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}